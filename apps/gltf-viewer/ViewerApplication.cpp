@@ -1,21 +1,108 @@
 #include "ViewerApplication.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/io.hpp>
 
+#include "utils/asset_cache.hpp"
 #include "utils/cameras.hpp"
+#include "utils/file_watcher.hpp"
+#include "utils/glb.hpp"
 #include "utils/gltf.hpp"
+#include "utils/gltf_json.hpp"
+#include "utils/hlod.hpp"
+#include "utils/image_decoder.hpp"
 #include "utils/images.hpp"
+#include "utils/index_optimizer.hpp"
+#include "utils/mesh_lod.hpp"
+#include "utils/meshlets.hpp"
+#include "utils/meshopt_decoder.hpp"
+#include "utils/mipmaps.hpp"
+#include "utils/node_table.hpp"
+#include "utils/residency_manager.hpp"
+#include "utils/hash.hpp"
+#include "utils/scene_resources.hpp"
+#include "utils/texture_channels.hpp"
+#include "utils/texture_compression.hpp"
+#include "utils/texture_containers.hpp"
+#include "utils/vertex_quantizer.hpp"
 
 #include <stb_image_write.h>
 #include <tiny_gltf.h>
 
+const GLuint VERTEX_ATTRIB_POSITION_IDX = 0;
+const GLuint VERTEX_ATTRIB_NORMAL_IDX = 1;
+const GLuint VERTEX_ATTRIB_TEXCOORD0_IDX = 2;
+
+// Material features of the geometry pass, each variant of its program is
+// compiled with the defines of its features (see geometryPass.fs.glsl)
+const uint32_t MATERIAL_BASE_COLOR_TEXTURE = 1;
+const uint32_t MATERIAL_METALLIC_ROUGHNESS_TEXTURE = 2;
+const uint32_t MATERIAL_EMISSIVE_TEXTURE = 4;
+const uint32_t MATERIAL_OCCLUSION_TEXTURE = 8;
+const uint32_t MATERIAL_OCCLUSION_IN_METALLIC_ROUGHNESS = 16;
+const uint32_t MATERIAL_ALPHA_MASK = 32;
+const char *const MATERIAL_FEATURE_DEFINES[] = {"BASE_COLOR_TEXTURE",
+    "METALLIC_ROUGHNESS_TEXTURE", "EMISSIVE_TEXTURE", "OCCLUSION_TEXTURE",
+    "OCCLUSION_IN_METALLIC_ROUGHNESS", "ALPHA_MASK"};
+// m_geometryProgram, the only variant where all uniforms are active
+const uint32_t MATERIAL_ALL_UNIFORMS = 63 & ~MATERIAL_OCCLUSION_IN_METALLIC_ROUGHNESS;
+
+std::vector<std::string> getMaterialDefines(uint32_t features)
+{
+  std::vector<std::string> defines;
+  for (size_t i = 0; i < 6; ++i) {
+    if (features & (1u << i)) {
+      defines.push_back(MATERIAL_FEATURE_DEFINES[i]);
+    }
+  }
+  return defines;
+}
+
+bool hasGLExtension(const char *name)
+{
+  GLint extensionCount = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+  for (GLint i = 0; i < extensionCount; ++i) {
+    const auto extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+    if (extension && std::strcmp(extension, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Let the driver compile shaders on its own threads, with
+// KHR_parallel_shader_compile (or the ARB version). Not in our GL loader.
+bool enableParallelShaderCompile()
+{
+  const auto name = hasGLExtension("GL_KHR_parallel_shader_compile") ? "glMaxShaderCompilerThreadsKHR"
+      : hasGLExtension("GL_ARB_parallel_shader_compile") ? "glMaxShaderCompilerThreadsARB"
+      : nullptr;
+  if (!name) {
+    return false;
+  }
+  using MaxShaderCompilerThreads = void(APIENTRYP)(GLuint count);
+  const auto maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreads>(glfwGetProcAddress(name));
+  if (maxShaderCompilerThreads) {
+    maxShaderCompilerThreads(0xFFFFFFFF); // As many as the driver wants
+  }
+  return true;
+}
+
 float lerp(float a, float b, float f) {
   return a + f * (b - a);
 }
@@ -30,31 +117,90 @@ void keyCallback(
 
 int ViewerApplication::run()
 {
+  // Shaders compile in the background while the scene loads
   initPrograms();
-  initUniforms();
+  m_textureStreamer.init(m_textureUploadBudget);
 
-  tinygltf::Model model;
-  // Load the glTF file
-  if (!loadGltfFile(model)) {
+  // Load the glTF file, from the preprocessed cache if possible
+  const auto loadStartTime = glfwGetTime();
+  Scene scene;
+  if (!loadScene(scene)) {
     return -1;
   }
+  const auto objectsStartTime = glfwGetTime();
+  createSceneObjects(scene);
+  const auto loadEndTime = glfwGetTime();
+  submitGeometryPrograms(scene);
+  finishPrograms();
+  initUniforms();
 
-  // Creation of texture object
-  const auto textureObjects = createTextureObjects(model);
-
-  // Default white texture
-  GLuint whiteTexture = createDefaultTexture();
-
-  // Creation of Buffer Objects
-  const auto bufferObjects = createBufferObjects(model);
+  std::clog << "Startup: glTF loading " << 1000. * (objectsStartTime - loadStartTime)
+            << " ms, textures and VAOs " << 1000. * (loadEndTime - objectsStartTime)
+            << " ms" << std::endl;
+
+  // The scene is replaced in place when its files change, these stay valid
+  const auto &model = scene.model;
+  const auto &lods = scene.lods;
+  const auto &quantizedVertices = scene.geometry.quantizedVertices;
+  const auto &meshlets = scene.geometry.meshlets;
+  const auto &primitiveLodRanges = scene.geometry.primitiveLodRanges;
+  const auto &nodeLodRanges = scene.geometry.nodeLodRanges;
+  const auto &hlodProxyIndices = scene.geometry.hlodProxyIndices;
+  const auto &meshBounds = scene.geometry.meshBounds;
+  auto &nodeTable = scene.geometry.nodeTable; // Transforms may change, see setLocalTransform
+  const auto &materialFeatures = scene.materialFeatures;
+  const auto &textureObjects = scene.textureObjects;
+  const auto &primitiveBuffers = scene.primitiveBuffers;
+  const auto &meshIndexToVaoRange = scene.meshIndexToVaoRange;
+  const auto &vertexArrayObjects = scene.vertexArrayObjects;
+  auto &residency = scene.residency;
+
+  // Images, then primitives (in VAO order). Objects kept from the previous
+  // version of the scene are already resident.
+  size_t imageCount = 0;
+  const auto initResidency = [&]() {
+    imageCount = model.images.size();
+    auto resourceSizes = textureObjects.imageByteSizes;
+    for (const auto &primitiveBuffer : primitiveBuffers) {
+      resourceSizes.push_back(primitiveBuffer.byteSize);
+    }
+    residency.init(std::move(resourceSizes),
+        [&](size_t resource) {
+          if (resource < imageCount) {
+            loadImageTexture(scene, resource);
+          } else {
+            loadPrimitiveBuffer(scene, resource - imageCount);
+          }
+        },
+        [&](size_t resource) {
+          if (resource < imageCount) {
+            evictImageTexture(scene.textureObjects, resource);
+          } else {
+            evictPrimitiveBuffer(scene.primitiveBuffers[resource - imageCount],
+                scene.vertexArrayObjects[resource - imageCount]);
+          }
+        },
+        m_gpuMemoryBudget);
+    for (size_t i = 0; i < imageCount; ++i) {
+      if (textureObjects.imageTextures[i]) {
+        residency.markResident(i);
+      }
+    }
+    for (size_t i = 0; i < primitiveBuffers.size(); ++i) {
+      if (primitiveBuffers[i].buffer) {
+        residency.markResident(imageCount + i);
+      }
+    }
+  };
+  initResidency();
 
-  // Creation of Vertex Array Objects
-  std::vector<VaoRange> meshIndexToVaoRange;
-  const auto vertexArrayObjects = createVertexArrayObjects(model, bufferObjects, meshIndexToVaoRange);
+  // Default textures: white multiplies factors by 1, black adds no emission
+  GLuint whiteTexture = createDefaultTexture(glm::vec4(1.f));
+  GLuint blackTexture = createDefaultTexture(glm::vec4(0.f, 0.f, 0.f, 1.f));
 
   // Compute scene bounds and get min and max of bounding box
   glm::vec3 bboxMin, bboxMax;
-  computeSceneBounds(model, bboxMin, bboxMax);
+  computeSceneBounds(model, scene.bufferSpans, bboxMin, bboxMax);
   glm::vec3 diag = bboxMax - bboxMin;
 
   // Build projection matrix
@@ -91,7 +237,105 @@ int ViewerApplication::run()
   bool useOcclusionMap = true;
   m_useSSAO = true;
 
-  const auto bindMaterial = [&](const auto materialIndex) {
+  // Meshlets of big primitives are culled against the frustum and by their
+  // normal cone, the visible ones are drawn with glMultiDrawElements
+  bool useMeshletCulling = true;
+  size_t drawnMeshletCount = 0, totalMeshletCount = 0;
+  const auto frustum = Frustum::fromProjection(projMatrix);
+  std::vector<GLsizei> drawCounts;
+  std::vector<const GLvoid *> drawOffsets;
+
+  // Levels of detail are picked from the size of the bounding spheres on
+  // screen: simplified primitives while their error stays under
+  // maxPixelError pixels, MSFT_lod nodes by screen coverage
+  bool useLods = true;
+  float maxPixelError = 1.f;
+  size_t simplifiedPrimitiveCount = 0;
+  // Out-of-core rendering: meshes in the view frustum are requested by size
+  // on screen, those close to it or in the frustum predicted
+  // prefetchFrameCount frames ahead (from the motion of the camera) by
+  // distance, after them. Only resident primitives are drawn.
+  const auto prefetchMargin = 0.25f; // Of the distance
+  const auto prefetchFrameCount = 30;
+  glm::mat4 previousViewMatrix(1.f);
+  bool hasPreviousView = false;
+  int gpuMemoryBudgetMB = int(m_gpuMemoryBudget >> 20);
+
+  // HLOD: the proxy of a subtree is drawn instead of it while its bounding
+  // sphere is smaller than hlodMaxPixels (radius) and its error small enough
+  bool useHlods = true;
+  float hlodMaxPixels = 64.f;
+  size_t drawnProxyCount = 0;
+  // Node drawn for each entry of the node table: itself, one of its MSFT_lod
+  // levels or none (-1)
+  std::vector<int> selectedNodeLods;
+  size_t updatedEntryCount = 0;
+  // Debug: spin a node around its local Y axis to move its subtree, -1 for
+  // none. Its HLOD ancestors fall back to their subtrees.
+  int spunNode = -1;
+  auto lastFrameTime = 0.;
+
+  // Textures not loaded, without storage or still streaming are replaced by
+  // the white texture, or the black one for emission
+  const auto residentTexture = [&](int textureIdx, GLuint fallback) {
+    const auto imageIdx = textureObjects.textureImages[textureIdx];
+    const auto texture = imageIdx >= 0 ? textureObjects.imageTextures[imageIdx] : 0u;
+    return texture && m_textureStreamer.isResident(texture) ? texture : fallback;
+  };
+  const auto requestMaterial = [&](int materialIdx, float priority) {
+    if (materialIdx < 0) {
+      return;
+    }
+    const auto &material = model.materials[materialIdx];
+    for (const auto textureIdx : {material.pbrMetallicRoughness.baseColorTexture.index,
+             material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+             material.emissiveTexture.index, material.occlusionTexture.index}) {
+      if (textureIdx >= 0 && textureObjects.textureImages[textureIdx] >= 0) {
+        residency.request(textureObjects.textureImages[textureIdx], priority);
+      }
+    }
+  };
+  const auto isMeshResident = [&](int meshIdx) {
+    const auto &vaoRange = meshIndexToVaoRange[meshIdx];
+    for (auto i = vaoRange.begin; i < vaoRange.begin + vaoRange.count; ++i) {
+      if (primitiveBuffers[i].byteSize && !residency.isResident(imageCount + i)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  // Sampler state is not in the texture objects, they can be shared
+  const auto bindTexture = [&](GLuint unit, GLuint texture, int textureIdx) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindSampler(unit, textureIdx >= 0 ? textureObjects.samplers[textureIdx] : 0);
+  };
+
+  // Features of the material of a primitive, less those turned off in the
+  // GUI: its program draws it
+  const auto getDrawFeatures = [&](int materialIdx) -> uint32_t {
+    if (materialIdx < 0) {
+      return 0;
+    }
+    auto features = materialFeatures[materialIdx];
+    if (!useBaseColor) {
+      features &= ~MATERIAL_BASE_COLOR_TEXTURE;
+    }
+    if (!useMetallicRoughnessTexture) {
+      features &= ~(MATERIAL_METALLIC_ROUGHNESS_TEXTURE | MATERIAL_OCCLUSION_IN_METALLIC_ROUGHNESS);
+    }
+    if (!useEmissive) {
+      features &= ~MATERIAL_EMISSIVE_TEXTURE;
+    }
+    if (!useOcclusionMap) {
+      features &= ~(MATERIAL_OCCLUSION_TEXTURE | MATERIAL_OCCLUSION_IN_METALLIC_ROUGHNESS);
+    }
+    return features;
+  };
+
+  // Samplers are set once per program (see initGeometryProgram), only the
+  // textures its features read are bound
+  const auto bindMaterial = [&](int materialIndex, uint32_t features) {
     float baseColorFactor[] = {1.f, 1.f, 1.f, 1.f};
     
     // Material binding
@@ -99,30 +343,20 @@ int ViewerApplication::run()
       // Get Material
       const auto &material = model.materials[materialIndex];
 
-      // Default Base Color
-      auto baseColorTex = whiteTexture;
       // Default Metallic Roughness
-      auto metallicRoughnessTex = 0u;
       auto metallicFactor = 0;
       auto roughnessFactor = 0;
-      // Default Emissive Texture
-      auto emissiveTex = 0u;
-      float emissiveFactor[] = {1.f, 1.f, 1.f};
-      // Default Occlusion
-      auto occlusionTex = 0u;
       
       // Base color texture
-      if (useBaseColor && material.pbrMetallicRoughness.baseColorTexture.index >= 0) {
-        baseColorTex = textureObjects[material.pbrMetallicRoughness.baseColorTexture.index];
+      if (features & MATERIAL_BASE_COLOR_TEXTURE) {
+        const auto baseColorIdx = material.pbrMetallicRoughness.baseColorTexture.index;
+        bindTexture(0, residentTexture(baseColorIdx, whiteTexture), baseColorIdx);
         baseColorFactor[0] = (float) material.pbrMetallicRoughness.baseColorFactor[0];
         baseColorFactor[1] = (float) material.pbrMetallicRoughness.baseColorFactor[1];
         baseColorFactor[2] = (float) material.pbrMetallicRoughness.baseColorFactor[2];
         baseColorFactor[3] = (float) material.pbrMetallicRoughness.baseColorFactor[3];
       }
 
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, baseColorTex);
-      glUniform1i(m_uBaseColorTextureLocation, 0);
       glUniform4f(m_uBaseColorFactorLocation,
         baseColorFactor[0],
         baseColorFactor[1],
@@ -130,52 +364,43 @@ int ViewerApplication::run()
         baseColorFactor[3]);
 
       // Metallic / Roughness texture
-      if (useMetallicRoughnessTexture && material.pbrMetallicRoughness.metallicRoughnessTexture.index >= 0) {
-        metallicRoughnessTex = textureObjects[material.pbrMetallicRoughness.metallicRoughnessTexture.index];
+      if (features & MATERIAL_METALLIC_ROUGHNESS_TEXTURE) {
+        const auto metallicRoughnessIdx = material.pbrMetallicRoughness.metallicRoughnessTexture.index;
+        bindTexture(1, residentTexture(metallicRoughnessIdx, whiteTexture), metallicRoughnessIdx);
         metallicFactor = material.pbrMetallicRoughness.metallicFactor;
         roughnessFactor = material.pbrMetallicRoughness.roughnessFactor;
       }
 
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, metallicRoughnessTex);
-      glUniform1i(m_uMetallicRoughnessTextureLocation, 1);
       glUniform1f(m_uMetallicFactorLocation, metallicFactor);
       glUniform1f(m_uRoughnessFactorLocation, roughnessFactor);
 
       // EmissiveTexture
-      if (useEmissive && material.emissiveTexture.index >= 0) {
-        emissiveTex = textureObjects[material.emissiveTexture.index];
-        emissiveFactor[0] = (float) material.emissiveFactor[0];
-        emissiveFactor[1] = (float) material.emissiveFactor[1];
-        emissiveFactor[2] = (float) material.emissiveFactor[2];
+      if (features & MATERIAL_EMISSIVE_TEXTURE) {
+        const auto emissiveIdx = material.emissiveTexture.index;
+        bindTexture(2, residentTexture(emissiveIdx, blackTexture), emissiveIdx);
+        glUniform3f(m_uEmissiveFactorLocation,
+          (float) material.emissiveFactor[0],
+          (float) material.emissiveFactor[1],
+          (float) material.emissiveFactor[2]);
       }
 
-      glActiveTexture(GL_TEXTURE2);
-      glBindTexture(GL_TEXTURE_2D, emissiveTex);
-      glUniform1i(m_uEmissiveTextureLocation, 2);
-      glUniform3f(m_uEmissiveFactorLocation, 
-        emissiveFactor[0],
-        emissiveFactor[1],
-        emissiveFactor[2]);
-
       // OcclusionTexture
-      glActiveTexture(GL_TEXTURE3);
-      if (useOcclusionMap && material.occlusionTexture.index >= 0) {
-        occlusionTex = textureObjects[material.occlusionTexture.index];
+      // Packed occlusion-roughness-metallic maps are already bound on unit 1
+      if (features & MATERIAL_OCCLUSION_TEXTURE) {
         occlusionStrength = material.occlusionTexture.strength;
-        glBindTexture(GL_TEXTURE_2D, occlusionTex);
-      } else {
-        glBindTexture(GL_TEXTURE_2D, whiteTexture);
+        if (!(features & MATERIAL_OCCLUSION_IN_METALLIC_ROUGHNESS)) {
+          bindTexture(3, residentTexture(material.occlusionTexture.index, whiteTexture), material.occlusionTexture.index);
+        }
+      }
+
+      if (features & MATERIAL_ALPHA_MASK) {
+        glUniform1f(m_uAlphaCutoffLocation, (float) material.alphaCutoff);
       }
-      glUniform1i(m_uOcclusionTextureLocation, 3);
 
       return;
     }
 
-    // Set default white texture if no material
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    glUniform1i(m_uBaseColorTextureLocation, 0);
+    // Factors only if no material
     glUniform4f(m_uBaseColorFactorLocation, 
       baseColorFactor[0], 
       baseColorFactor[1], 
@@ -189,6 +414,19 @@ int ViewerApplication::run()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     const auto viewMatrix = camera.getViewMatrix();
+    const auto cameraMotion = hasPreviousView ? viewMatrix * glm::inverse(previousViewMatrix) : glm::mat4(1.f);
+    auto prefetchViewMatrix = viewMatrix;
+    for (int i = 0; i < prefetchFrameCount; ++i) {
+      prefetchViewMatrix = cameraMotion * prefetchViewMatrix;
+    }
+    previousViewMatrix = viewMatrix;
+    hasPreviousView = true;
+    drawnMeshletCount = totalMeshletCount = 0;
+    simplifiedPrimitiveCount = 0;
+    drawnProxyCount = 0;
+    // Variants of the geometry program, switched only between primitives
+    // with different material features
+    GLuint currentProgram = 0;
 
     // if (m_uLightDirectionLocation >= 0) {
     //   const auto lightDirectionInViewSpace =
@@ -202,62 +440,221 @@ int ViewerApplication::run()
     //     lightIntensity[2]);
     // }
 
-    // The recursive function that should draw a node
-    // We use a std::function because a simple lambda cannot be recursive
-    const std::function<void(int, const glm::mat4 &)> drawNode =
-        [&](int nodeIdx, const glm::mat4 &parentMatrix) {
-          // The drawNode function
-          const auto &node = model.nodes[nodeIdx];
-          glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
-
-          // If the node is a mesh (and not a camera or light)
-          if (node.mesh >= 0) {
-            const auto &modelViewMatrix = viewMatrix * modelMatrix;
-            const auto &modelViewProjectionMatrix = projMatrix * modelViewMatrix;
-            const auto &normalMatrix = glm::transpose(glm::inverse(modelViewMatrix));
-
-            glUniformMatrix4fv(m_modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-            glUniformMatrix4fv(m_modelViewProjMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
-            glUniformMatrix4fv(m_normalMatrixLocation, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-            const auto &mesh = model.meshes[node.mesh];
-            const auto &vaoRange = meshIndexToVaoRange[node.mesh];
-            for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
-              const auto &primitive = mesh.primitives[primIdx];
-              bindMaterial(primitive.material);
-              auto const &vao = vertexArrayObjects[vaoRange.begin + primIdx];
-              glBindVertexArray(vao);
-              if (primitive.indices >= 0) {
-                const auto &accessor = model.accessors[primitive.indices];
-                const auto &bufferView = model.bufferViews[accessor.bufferView];
-                const auto byteOffset = accessor.byteOffset + bufferView.byteOffset;
-                glDrawElements(primitive.mode, GLsizei(accessor.count), accessor.componentType, (const GLvoid *)byteOffset);
-              } else {
-                const auto accessorIdx = (*begin(primitive.attributes)).second;
-                const auto &accessor = model.accessors[accessorIdx];
-                glDrawArrays(primitive.mode, 0, GLsizei(accessor.count));
-              }
-            }
+    // Draw the primitives of a mesh with the matrices of a node entry
+    const auto viewNormalMatrix = glm::transpose(glm::inverse(viewMatrix));
+    // worldBounds is the bounding sphere of the mesh in world space
+    const auto drawMesh = [&](int meshIdx, size_t entryIdx, const glm::vec4 &worldBounds) {
+      const auto &modelMatrix = nodeTable.worldMatrices[entryIdx];
+      const auto &modelViewMatrix = viewMatrix * modelMatrix;
+      const auto &normalMatrix = viewNormalMatrix * nodeTable.normalMatrices[entryIdx];
+      // The transpose of the normal matrix is the inverse of the model matrix
+      const auto cameraInMeshSpace = glm::vec3(glm::vec4(camera.eye(), 1) * nodeTable.normalMatrices[entryIdx]);
+      // Scale of the bounding spheres, and mirrored nodes swap front and back faces
+      const auto meshScale = nodeTable.worldScales[entryIdx];
+      const auto isMirrored = glm::determinant(glm::mat3(modelMatrix)) < 0.f;
+
+      const auto &mesh = model.meshes[meshIdx];
+      const auto &vaoRange = meshIndexToVaoRange[meshIdx];
+      const auto worldCenter = glm::vec4(glm::vec3(worldBounds), 1);
+      const auto meshViewCenter = glm::vec3(viewMatrix * worldCenter);
+      const auto meshRadius = worldBounds.w;
+      const auto meshDistance = glm::length(meshViewCenter);
+      const auto isVisible = frustum.intersectsSphere(meshViewCenter, meshRadius);
+      if (!isVisible && !frustum.intersectsSphere(meshViewCenter, meshRadius + prefetchMargin * meshDistance) &&
+          !frustum.intersectsSphere(glm::vec3(prefetchViewMatrix * worldCenter), meshRadius)) {
+        return;
+      }
+      const auto priority = isVisible
+          ? meshRadius * projMatrix[1][1] * 0.5f * m_nWindowHeight / std::max(meshDistance, meshRadius)
+          : -meshDistance;
+      for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
+        if (primitiveBuffers[vaoRange.begin + primIdx].byteSize) {
+          residency.request(imageCount + vaoRange.begin + primIdx, priority);
+          requestMaterial(mesh.primitives[primIdx].material, priority);
+        }
+      }
+      if (!isVisible) {
+        return;
+      }
+
+      for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
+        const auto &primitive = mesh.primitives[primIdx];
+        const auto &quantized = quantizedVertices.primitives[meshIdx][primIdx];
+        const auto &primitiveBuffer = primitiveBuffers[vaoRange.begin + primIdx];
+        if (!quantized.vertexCount || !residency.isResident(imageCount + vaoRange.begin + primIdx)) {
+          continue;
+        }
+
+        // Positions are quantized in the box of the primitive, normals
+        // are not and keep the normal matrix of the node
+        const auto primitiveModelViewMatrix = modelViewMatrix * quantized.getDequantizationMatrix();
+        const auto modelViewProjectionMatrix = projMatrix * primitiveModelViewMatrix;
+        // Uniforms are per program, set after it is selected
+        const auto features = getDrawFeatures(primitive.material);
+        const auto &program = getGeometryProgram(features);
+        if (program.glId() != currentProgram) {
+          program.use();
+          currentProgram = program.glId();
+        }
+        glUniformMatrix4fv(m_normalMatrixLocation, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+        glUniformMatrix4fv(m_modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(primitiveModelViewMatrix));
+        glUniformMatrix4fv(m_modelViewProjMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMatrix));
+
+        bindMaterial(primitive.material, features);
+        auto const &vao = vertexArrayObjects[vaoRange.begin + primIdx];
+        glBindVertexArray(vao);
+        // Radius in pixels of the bounding sphere of the primitive,
+        // LOD errors are relative to it
+        auto lodIdx = -1;
+        const auto &lodRange = primitiveLodRanges[meshIdx][primIdx];
+        if (useLods && lodRange.count) {
+          const auto center = quantized.positionMin + 0.5f * quantized.positionScale;
+          const auto radius = 0.5f * glm::length(quantized.positionScale) * meshScale;
+          const auto distance = -(modelViewMatrix * glm::vec4(center, 1)).z;
+          if (distance > radius) {
+            const auto radiusInPixels = radius * projMatrix[1][1] * 0.5f * m_nWindowHeight / distance;
+            lodIdx = selectPrimitiveLod(lods, lodRange, radiusInPixels, maxPixelError);
           }
+        }
+        // The element buffer of the VAO is the buffer of the primitive, a
+        // level is only drawn if its indices were copied there
+        if (lodIdx >= 0 && size_t(lodIdx - lodRange.begin) >= primitiveBuffer.lodOffsets.size()) {
+          lodIdx = -1;
+        }
 
-          // Draw children
-          for (const auto childNodeIdx : node.children) {
-            drawNode(childNodeIdx, modelMatrix);
+        const auto &meshletRange = meshlets.primitives[meshIdx][primIdx];
+        if (lodIdx >= 0) {
+          // Simplified indices of the same vertices, meshlets are built
+          // for the full resolution only
+          const auto &accessor = model.accessors[lods.primitives[lodIdx].indices];
+          const auto byteOffset = primitiveBuffer.lodOffsets[lodIdx - lodRange.begin];
+          glDrawElements(primitive.mode, GLsizei(accessor.count), accessor.componentType, (const GLvoid *)byteOffset);
+          ++simplifiedPrimitiveCount;
+        } else if (primitive.indices >= 0 && useMeshletCulling && meshletRange.count) {
+          const auto &accessor = model.accessors[primitive.indices];
+          const auto byteOffset = primitiveBuffer.indexOffset;
+          const auto indexSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+          const auto cullBackFaces = !isMirrored &&
+              (primitive.material < 0 || !model.materials[primitive.material].doubleSided);
+
+          // Consecutive visible meshlets are merged in a single draw
+          drawCounts.clear();
+          drawOffsets.clear();
+          size_t lastEnd = size_t(-1);
+          for (size_t m = meshletRange.begin; m < meshletRange.begin + meshletRange.count; ++m) {
+            const auto &meshlet = meshlets.meshlets[m];
+            const auto viewCenter = glm::vec3(modelViewMatrix * glm::vec4(meshlet.center, 1));
+            if (!frustum.intersectsSphere(viewCenter, meshlet.radius * meshScale) ||
+                (cullBackFaces && isMeshletBackFacing(meshlet, cameraInMeshSpace))) {
+              continue;
+            }
+            if (lastEnd == meshlet.firstIndex) {
+              drawCounts.back() += GLsizei(meshlet.indexCount);
+            } else {
+              drawCounts.push_back(GLsizei(meshlet.indexCount));
+              drawOffsets.push_back((const GLvoid *)(byteOffset + meshlet.firstIndex * indexSize));
+            }
+            lastEnd = meshlet.firstIndex + meshlet.indexCount;
+            ++drawnMeshletCount;
+          }
+          totalMeshletCount += meshletRange.count;
+          if (!drawCounts.empty()) {
+            glMultiDrawElements(primitive.mode, drawCounts.data(), accessor.componentType,
+                drawOffsets.data(), GLsizei(drawCounts.size()));
+          }
+        } else if (primitive.indices >= 0) {
+          const auto &accessor = model.accessors[primitive.indices];
+          const auto byteOffset = primitiveBuffer.indexOffset;
+          glDrawElements(primitive.mode, GLsizei(accessor.count), accessor.componentType, (const GLvoid *)byteOffset);
+        } else {
+          glDrawArrays(primitive.mode, 0, GLsizei(quantized.vertexCount));
+        }
+      }
+    };
+
+    // World matrices of the subtrees whose transforms changed since the
+    // last frame, the others are kept
+    updatedEntryCount = updateWorldTransforms(nodeTable);
+
+    // The nodes of the default scene, in the order of the node table. A
+    // skipped entry skips its subtree.
+    selectedNodeLods.resize(nodeTable.size());
+    for (size_t entryIdx = 0; entryIdx < nodeTable.size();) {
+      const auto nodeIdx = nodeTable.nodes[entryIdx];
+      const auto meshIdx = nodeTable.meshes[entryIdx];
+      // MSFT_lod levels only when their node selected them
+      const auto lodOwner = nodeTable.lodOwners[entryIdx];
+      if (lodOwner >= 0 && selectedNodeLods[lodOwner] != nodeIdx) {
+        entryIdx = nodeTable.subtreeEnds[entryIdx];
+        continue;
+      }
+      selectedNodeLods[entryIdx] = nodeIdx;
+      const auto &modelMatrix = nodeTable.worldMatrices[entryIdx];
+
+      // HLOD: the proxy replaces the node and all its descendants, unless
+      // one of them moved since it was baked
+      const auto proxyIdx = hlodProxyIndices[nodeIdx];
+      if (useHlods && proxyIdx >= 0 && nodeTable.proxyValid[entryIdx]) {
+        const auto &proxy = lods.proxies[proxyIdx];
+        const auto &bounds = meshBounds[proxy.mesh];
+        const auto worldBounds = glm::vec4(glm::vec3(modelMatrix * glm::vec4(glm::vec3(bounds), 1)),
+            bounds.w * nodeTable.worldScales[entryIdx]);
+        const auto viewCenter = glm::vec3(viewMatrix * glm::vec4(glm::vec3(worldBounds), 1));
+        const auto radius = worldBounds.w;
+        const auto distance = -viewCenter.z;
+        if (distance > radius) {
+          const auto radiusInPixels = radius * projMatrix[1][1] * 0.5f * m_nWindowHeight / distance;
+          if (radiusInPixels <= hlodMaxPixels && proxy.error * radiusInPixels <= maxPixelError) {
+            // Full detail until the proxy is loaded
+            drawMesh(proxy.mesh, entryIdx, worldBounds);
+            if (isMeshResident(proxy.mesh)) {
+              ++drawnProxyCount;
+              entryIdx = nodeTable.subtreeEnds[entryIdx];
+              continue;
+            }
           }
-        };
+        }
+      }
 
-    // Draw the scene referenced by gltf file
-    if (model.defaultScene >= 0) {
-      // Draw all nodes
-      for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
-        drawNode(nodeIdx, glm::mat4(1));
+      // MSFT_lod: a coarser node replaces this one and its children when
+      // the mesh covers less of the screen. Its entries follow the children.
+      const auto &nodeLodRange = nodeLodRanges[nodeIdx];
+      if (useLods && nodeLodRange.count && meshIdx >= 0) {
+        const auto &worldBounds = nodeTable.worldBounds[entryIdx];
+        const auto viewCenter = glm::vec3(viewMatrix * glm::vec4(glm::vec3(worldBounds), 1));
+        const auto radius = worldBounds.w;
+        const auto distance = -viewCenter.z;
+        // Area of the projected sphere over the area of the screen
+        const auto coverage = distance > radius
+            ? glm::pi<float>() * radius * radius * projMatrix[0][0] * projMatrix[1][1] / (4.f * distance * distance)
+            : 1.f;
+        selectedNodeLods[entryIdx] = selectNodeLod(lods, nodeLodRange, coverage);
+        if (selectedNodeLods[entryIdx] != nodeIdx) {
+          entryIdx = nodeTable.childrenEnds[entryIdx];
+          continue;
+        }
       }
+
+      // If the node is a mesh (and not a camera or light)
+      if (meshIdx >= 0) {
+        drawMesh(meshIdx, entryIdx, nodeTable.worldBounds[entryIdx]);
+      }
+      ++entryIdx;
     }
     glBindVertexArray(0);
+    // The other passes use the parameters of their textures
+    for (GLuint unit = 0; unit < 4; ++unit) {
+      glBindSampler(unit, 0);
+    }
   };
 
   // Render to image
   if (!m_OutputPath.empty()) {
+    // No progressive display for a single image: a first traversal requests
+    // what the camera sees, loaded at once
+    drawScene(cameraController->getCamera());
+    residency.update(std::numeric_limits<size_t>::max());
+    m_textureStreamer.flush();
     std::clog << "Saving..." << std::endl;
     const auto numComponents = 3; // RGB
     std::vector<unsigned char> pixels(m_nWindowWidth * m_nWindowHeight * numComponents); // Store the image
@@ -271,16 +668,81 @@ int ViewerApplication::run()
     return 0; // Prevent the render loop to run
   }
 
+  // Hot reload: the glTF file and its buffers and images are watched. Once
+  // they stay untouched for reloadDelay seconds (exporters write in several
+  // steps), changed images are reloaded alone, anything else reloads the
+  // scene and keeps the GL objects whose content did not change. Programs,
+  // G-buffers and the camera are kept.
+  // Files of the scene may be mapped, once one changes nothing more is loaded
+  // from them: their pages could be read again half written (or truncated,
+  // SIGBUS). If the reload fails, the scene stays as it is until a reload
+  // succeeds.
+  FileWatcher fileWatcher;
+  fileWatcher.watch(getAssetDependencies(m_gltfFilePath));
+  std::vector<fs::path> changedFiles;
+  const auto reloadDelay = 0.05;
+  auto lastChangeTime = 0.;
+  auto sceneFilesChanged = false;
+
   // Loop until the user closes the window
   for (auto iterationCount = 0u; !m_GLFWHandle.shouldClose();
        ++iterationCount) {
     const auto seconds = glfwGetTime();
 
+    for (const auto &path : fileWatcher.poll()) {
+      if (std::find(begin(changedFiles), end(changedFiles), path) == end(changedFiles)) {
+        changedFiles.push_back(path);
+      }
+      lastChangeTime = seconds;
+      sceneFilesChanged = true;
+    }
+    if (!changedFiles.empty() && seconds - lastChangeTime >= reloadDelay) {
+      if (reloadImages(scene, changedFiles)) {
+        std::clog << "Reloaded " << changedFiles.size() << " images in "
+                  << 1000. * (glfwGetTime() - seconds) << " ms" << std::endl;
+        sceneFilesChanged = false;
+      } else {
+        Scene newScene;
+        if (loadScene(newScene)) {
+          createSceneObjects(newScene);
+          const auto keptCount = adoptSceneObjects(newScene, scene);
+          destroySceneObjects(scene);
+          scene = std::move(newScene);
+          initResidency();
+          std::clog << "Reloaded " << m_gltfFilePath << " in " << 1000. * (glfwGetTime() - seconds)
+                    << " ms, kept " << keptCount << " buffers and textures" << std::endl;
+          sceneFilesChanged = false;
+        } else {
+          std::cerr << "Unable to reload " << m_gltfFilePath << ", keeping the previous version as it is" << std::endl;
+        }
+      }
+      // Images or buffers may have been added or renamed
+      fileWatcher.watch(getAssetDependencies(m_gltfFilePath));
+      changedFiles.clear();
+    }
+
+    if (!sceneFilesChanged) {
+      // Continue texture uploads, within the per-frame budget
+      m_textureStreamer.update();
+      // Load what the previous frame requested, within the same budget
+      residency.update(m_textureUploadBudget);
+    }
+
+    if (spunNode >= 0 && size_t(spunNode) < model.nodes.size() &&
+        nodeTable.firstEntries[spunNode] >= 0) {
+      const auto entry = nodeTable.firstEntries[spunNode];
+      const auto angle = float(seconds - lastFrameTime);
+      setLocalTransform(nodeTable, spunNode, nodeTable.translations[entry],
+          nodeTable.rotations[entry] * glm::angleAxis(angle, glm::vec3(0, 1, 0)),
+          nodeTable.scales[entry]);
+    }
+    lastFrameTime = seconds;
+
     const auto camera = cameraController->getCamera();
 
     // 1. Geometry Pass
-    // Draw the scene in the GBuffers
-    m_geometryProgram.use();
+    // Draw the scene in the GBuffers, each primitive with the program of its
+    // material features
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_GBufferFBO);
     drawScene(camera);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
@@ -466,6 +928,36 @@ int ViewerApplication::run()
       ImGui::Begin("GUI");
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
           1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+      if (totalMeshletCount) {
+        ImGui::Text("Meshlets drawn: %zu / %zu", drawnMeshletCount, totalMeshletCount);
+        ImGui::Checkbox("Meshlet culling", &useMeshletCulling);
+      }
+      if (!lods.primitives.empty() || !lods.nodes.empty()) {
+        ImGui::Text("Simplified primitives drawn: %zu", simplifiedPrimitiveCount);
+        ImGui::Checkbox("Levels of detail", &useLods);
+        ImGui::SliderFloat("Max pixel error", &maxPixelError, 0.1f, 16.f, "%.1f");
+      }
+      if (!lods.proxies.empty()) {
+        ImGui::Text("HLOD proxies drawn: %zu / %zu", drawnProxyCount, lods.proxies.size());
+        ImGui::Checkbox("HLOD", &useHlods);
+        ImGui::SliderFloat("HLOD max radius (pixels)", &hlodMaxPixels, 1.f, 512.f, "%.0f");
+      }
+      ImGui::Text("World transforms updated: %zu / %zu", updatedEntryCount, nodeTable.size());
+      if (ImGui::InputInt("Spin node (-1 for none)", &spunNode)) {
+        spunNode = glm::clamp(spunNode, -1, int(model.nodes.size()) - 1);
+      }
+      ImGui::Text("GPU memory: %.1f MB in %zu buffers and textures, %zu waiting",
+          residency.residentBytes() / (1024.f * 1024.f), residency.residentCount(),
+          residency.pendingCount());
+      if (ImGui::SliderInt("GPU budget (MB, 0 for none)", &gpuMemoryBudgetMB, 0, 16384)) {
+        m_gpuMemoryBudget = size_t(gpuMemoryBudgetMB) << 20;
+        residency.setBudget(m_gpuMemoryBudget);
+      }
+      if (m_textureStreamer.pendingCount()) {
+        ImGui::Text("Streaming %zu textures (%.1f MB left)",
+            m_textureStreamer.pendingCount(),
+            m_textureStreamer.pendingBytes() / (1024.f * 1024.f));
+      }
       if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::Text("eye: %.3f %.3f %.3f", camera.eye().x, camera.eye().y,
             camera.eye().z);
@@ -583,20 +1075,419 @@ int ViewerApplication::run()
   }
 
   // Clean up allocated GL data
-  glDeleteBuffers(GLsizei(bufferObjects.size()), bufferObjects.data());
-  glDeleteVertexArrays(GLsizei(vertexArrayObjects.size()), vertexArrayObjects.data());
-  glDeleteTextures(GLsizei(textureObjects.size()), textureObjects.data());
+  destroySceneObjects(scene);
   glDeleteTextures(1, &whiteTexture);
+  glDeleteTextures(1, &blackTexture);
 
   return 0;
 }
 
-bool ViewerApplication::loadGltfFile(tinygltf::Model & model) {
+bool ViewerApplication::loadScene(Scene &scene) {
+  auto &model = scene.model;
+  auto &bufferSpans = scene.bufferSpans;
+  auto &imageSpans = scene.imageSpans;
+  auto &imageEncodings = scene.imageEncodings;
+  auto &lods = scene.lods;
+  auto &geometry = scene.geometry;
+
+  // Images are compressed before being cached, the key depends on how
+  const bool allowS3tc = hasGLExtension("GL_EXT_texture_compression_s3tc");
+  const uint8_t textureCompression = m_compressTextures ? (allowS3tc ? 2 : 1) : 0;
+  auto cacheKey = m_CacheDirectory.empty() ? 0 : computeAssetCacheKey(m_CacheDirectory, m_gltfFilePath);
+  if (cacheKey) {
+    cacheKey = hashBytes(&textureCompression, sizeof(textureCompression), cacheKey);
+    const uint8_t geometryOptions = uint8_t(m_generateLods) | uint8_t(m_buildHlods) << 1 |
+                                    uint8_t(m_optimizeIndices) << 2;
+    cacheKey = hashBytes(&geometryOptions, sizeof(geometryOptions), cacheKey);
+  }
+  if (!loadCachedGltfFile(cacheKey, scene)) {
+    if (!loadGltfFile(scene)) {
+      return false;
+    }
+    // Non-color maps only keep the channels the shaders read
+    size_t decodedSize = 0, packedSize = 0;
+    for (const auto &span : imageSpans) {
+      decodedSize += span.size;
+    }
+    packImageChannels(model, imageSpans, imageEncodings, m_threadPool);
+    for (const auto &span : imageSpans) {
+      packedSize += span.size;
+    }
+    std::clog << "Packed image channels: " << decodedSize << " bytes of pixels to "
+              << packedSize << " bytes" << std::endl;
+    // Proxies bake their atlas from the decoded images, it gets its mip
+    // levels and compression with the others
+    if (m_buildHlods) {
+      const auto hlodStartTime = glfwGetTime();
+      lods.proxies = buildHlodProxies(model, bufferSpans, imageSpans, imageEncodings, m_threadPool);
+      std::clog << "Built HLOD proxies in " << 1000. * (glfwGetTime() - hlodStartTime)
+                << " ms: " << lods.proxies.size() << " proxies" << std::endl;
+    }
+    // Mip levels are computed here, not by the driver, and cached with the rest
+    const auto mipmapsStartTime = glfwGetTime();
+    generateMipmaps(model, imageSpans, imageEncodings, m_threadPool);
+    std::clog << "Generated mip levels in " << 1000. * (glfwGetTime() - mipmapsStartTime)
+              << " ms" << std::endl;
+    if (m_compressTextures) {
+      const auto compressStartTime = glfwGetTime();
+      size_t rawSize = 0, compressedSize = 0;
+      for (const auto &span : imageSpans) {
+        rawSize += span.size;
+      }
+      compressImages(model, imageSpans, imageEncodings, m_threadPool, allowS3tc);
+      for (const auto &span : imageSpans) {
+        compressedSize += span.size;
+      }
+      std::clog << "Compressed textures in " << 1000. * (glfwGetTime() - compressStartTime)
+                << " ms: " << rawSize << " bytes of pixels to " << compressedSize
+                << " bytes with all mip levels" << std::endl;
+    }
+    // MSFT_lod levels are part of the geometry built below
+    readNodeLods(model, lods);
+    if (m_generateLods) {
+      const auto lodStartTime = glfwGetTime();
+      generatePrimitiveLods(model, bufferSpans, lods, m_threadPool);
+      std::clog << "Simplified primitives in " << 1000. * (glfwGetTime() - lodStartTime)
+                << " ms: " << lods.primitives.size() << " levels of detail" << std::endl;
+    }
+    // Vertices are quantized and interleaved in a new buffer, cached with the
+    // others. They go in the buffer of their primitive with its indices.
+    geometry.quantizedVertices = quantizeVertices(model, bufferSpans);
+    // Reordered indices and vertices are cached too
+    if (m_optimizeIndices) {
+      VertexCacheStats before, after;
+      optimizeIndices(model, bufferSpans, geometry.quantizedVertices, lods, before, after);
+      std::clog << "Optimized indices of " << after.triangleCount
+                << " triangles: ACMR " << before.acmr() << " -> " << after.acmr()
+                << ", ATVR " << before.atvr() << " -> " << after.atvr() << std::endl;
+    }
+    // Meshlets, LOD ranges, buffer layouts and the node table, so that a
+    // cache hit builds nothing
+    buildSceneGeometry(model, bufferSpans, lods, geometry);
+    if (cacheKey) {
+      const auto cachePath = getAssetCachePath(m_CacheDirectory, cacheKey);
+      if (writeAssetCache(cachePath, cacheKey, model, bufferSpans, imageSpans, imageEncodings, lods, geometry)) {
+        std::clog << "Stored in cache " << cachePath << std::endl;
+      } else {
+        std::cerr << "Unable to write cache " << cachePath << std::endl;
+      }
+    }
+  }
+
+  std::clog << "Number of meshlets: " << geometry.meshlets.meshlets.size() << std::endl;
+  // Resident GL buffers start from their layout
+  scene.primitiveBuffers.assign(geometry.primitiveLayouts.size(), PrimitiveBuffer());
+  size_t totalSize = 0;
+  for (size_t i = 0; i < geometry.primitiveLayouts.size(); ++i) {
+    static_cast<PrimitiveLayout &>(scene.primitiveBuffers[i]) = geometry.primitiveLayouts[i];
+    totalSize += geometry.primitiveLayouts[i].byteSize;
+  }
+  std::clog << totalSize << " bytes of geometry in " << scene.primitiveBuffers.size()
+            << " primitive buffers, loaded on demand" << std::endl;
+
+  return true;
+}
+
+void ViewerApplication::createSceneObjects(Scene &scene) {
+  scene.textureObjects = createTextureObjects(scene.model, scene.imageSpans, scene.imageEncodings);
+  scene.vertexArrayObjects = createVertexArrayObjects(scene.model, scene.meshIndexToVaoRange);
+
+  // Features of each material, for the cheapest variant of the geometry
+  // program. Occlusion packed with metallic roughness (same image and
+  // sampler) is read with the same fetch.
+  const auto &objects = scene.textureObjects;
+  scene.materialFeatures.clear();
+  for (const auto &material : scene.model.materials) {
+    const auto &pbr = material.pbrMetallicRoughness;
+    uint32_t features = 0;
+    if (pbr.baseColorTexture.index >= 0) {
+      features |= MATERIAL_BASE_COLOR_TEXTURE;
+    }
+    if (pbr.metallicRoughnessTexture.index >= 0) {
+      features |= MATERIAL_METALLIC_ROUGHNESS_TEXTURE;
+    }
+    if (material.emissiveTexture.index >= 0) {
+      features |= MATERIAL_EMISSIVE_TEXTURE;
+    }
+    if (material.occlusionTexture.index >= 0) {
+      features |= MATERIAL_OCCLUSION_TEXTURE;
+      const auto metallicRoughnessIdx = pbr.metallicRoughnessTexture.index;
+      const auto occlusionIdx = material.occlusionTexture.index;
+      if (metallicRoughnessIdx >= 0 &&
+          objects.textureImages[metallicRoughnessIdx] == objects.textureImages[occlusionIdx] &&
+          objects.samplers[metallicRoughnessIdx] == objects.samplers[occlusionIdx]) {
+        features |= MATERIAL_OCCLUSION_IN_METALLIC_ROUGHNESS;
+      }
+    }
+    if (material.alphaMode == "MASK") {
+      features |= MATERIAL_ALPHA_MASK;
+    }
+    scene.materialFeatures.push_back(features);
+  }
+}
+
+void ViewerApplication::destroySceneObjects(Scene &scene) {
+  scene.residency.clear();
+  glDeleteVertexArrays(GLsizei(scene.vertexArrayObjects.size()), scene.vertexArrayObjects.data());
+  glDeleteSamplers(GLsizei(scene.textureObjects.samplerObjects.size()), scene.textureObjects.samplerObjects.data());
+  scene.vertexArrayObjects.clear();
+  scene.textureObjects.samplerObjects.clear();
+}
+
+bool ViewerApplication::reloadImages(Scene &scene, const std::vector<fs::path> &changedFiles) {
+  auto &model = scene.model;
+  auto &objects = scene.textureObjects;
+
+  // Only images decoded with stb that have their own texture storage are
+  // reloaded here, anything else needs the whole scene
+  std::vector<size_t> changedImages;
+  for (const auto &path : changedFiles) {
+    auto extension = path.extension().string();
+    std::transform(begin(extension), end(extension), begin(extension), ::tolower);
+    if (extension == ".ktx2" || extension == ".dds") {
+      return false;
+    }
+    const auto changedCount = changedImages.size();
+    for (size_t i = 0; i < model.images.size(); ++i) {
+      const auto &uri = model.images[i].uri;
+      if (uri.empty() || m_gltfFilePath.parent_path() / uri != path) {
+        continue;
+      }
+      if (!objects.imageLevelCounts[i]) {
+        return false; // Duplicate of another image, or never sampled
+      }
+      for (size_t t = 0; t < model.textures.size(); ++t) {
+        if ((model.textures[t].source == int(i)) != (objects.textureImages[t] == int(i))) {
+          return false; // Shared with a duplicate
+        }
+      }
+      changedImages.push_back(i);
+    }
+    if (changedImages.size() == changedCount) {
+      return false; // The glTF file or one of its buffers
+    }
+  }
+
+  // Nothing changes if one of them can't be decoded, it may still be written
+  std::vector<tinygltf::Image> decoded(changedImages.size());
+  std::vector<std::string> errors(changedImages.size());
+  m_threadPool.parallelFor(changedImages.size(), [&](size_t k) {
+    const auto imageIdx = changedImages[k];
+    MappedFile file;
+    decoded[k].name = model.images[imageIdx].name;
+    if (!file.open(m_gltfFilePath.parent_path() / model.images[imageIdx].uri)) {
+      errors[k] = "Unable to read " + model.images[imageIdx].uri + "\n";
+    } else {
+      decodeImage(decoded[k], int(imageIdx), errors[k], 0, 0, file.data(), int(file.size()));
+    }
+  });
+  for (const auto &err : errors) {
+    if (!err.empty()) {
+      // The previous pixels stay, the next write reloads them
+      std::cerr << "Err: " << err;
+      return true;
+    }
+  }
+
+  // Same preprocessing as on load, but without compression: the changed
+  // images alone go through it
+  std::vector<BufferSpan> imageSpans(model.images.size());
+  auto imageEncodings = scene.imageEncodings;
+  for (size_t k = 0; k < changedImages.size(); ++k) {
+    const auto imageIdx = changedImages[k];
+    // Release the texture before its pixels
+    scene.residency.resize(imageIdx, 0);
+    auto &image = model.images[imageIdx];
+    image.width = decoded[k].width;
+    image.height = decoded[k].height;
+    image.component = decoded[k].component;
+    image.bits = decoded[k].bits;
+    image.pixel_type = decoded[k].pixel_type;
+    image.image = std::move(decoded[k].image);
+    imageSpans[imageIdx] = {image.image.data(), image.image.size()};
+    imageEncodings[imageIdx] = ImageEncoding{};
+  }
+  packImageChannels(model, imageSpans, imageEncodings, m_threadPool);
+  generateMipmaps(model, imageSpans, imageEncodings, m_threadPool);
+  for (const auto imageIdx : changedImages) {
+    scene.imageSpans[imageIdx] = imageSpans[imageIdx];
+    scene.imageEncodings[imageIdx] = imageEncodings[imageIdx];
+    layoutImageTexture(model, scene.imageEncodings, objects, imageIdx);
+    scene.residency.resize(imageIdx, objects.imageByteSizes[imageIdx]);
+  }
+
+  return true;
+}
+
+size_t ViewerApplication::adoptSceneObjects(Scene &scene, Scene &previous) {
+  // Resident objects of the previous scene by hash of their content. Textures
+  // still streaming read pixels that go away with it, they are not kept.
+  std::unordered_map<uint64_t, size_t> textures, buffers;
+  std::unordered_set<size_t> textureSizes, bufferSizes;
+  auto &previousObjects = previous.textureObjects;
+  for (size_t i = 0; i < previousObjects.imageTextures.size(); ++i) {
+    const auto texture = previousObjects.imageTextures[i];
+    if (texture && m_textureStreamer.isResident(texture)) {
+      textures.emplace(previousObjects.imageHashes[i], i);
+      textureSizes.insert(previousObjects.imageByteSizes[i]);
+    }
+  }
+  for (size_t i = 0; i < previous.primitiveBuffers.size(); ++i) {
+    const auto &primitiveBuffer = previous.primitiveBuffers[i];
+    if (primitiveBuffer.buffer) {
+      buffers.emplace(primitiveBuffer.hash, i);
+      bufferSizes.insert(primitiveBuffer.byteSize);
+    }
+  }
+
+  // Only what has the size of a candidate is hashed. The objects that are
+  // taken are zeroed in the previous scene, which then leaves them alone.
+  size_t keptCount = 0;
+  auto &objects = scene.textureObjects;
+  for (size_t i = 0; i < objects.imageTextures.size() && !textures.empty(); ++i) {
+    if (!objects.imageLevelCounts[i] || !textureSizes.count(objects.imageByteSizes[i])) {
+      continue;
+    }
+    const auto hash = hashImageTexture(scene, i);
+    const auto it = textures.find(hash);
+    if (it != end(textures)) {
+      objects.imageTextures[i] = previousObjects.imageTextures[it->second];
+      objects.imageHashes[i] = hash;
+      previousObjects.imageTextures[it->second] = 0;
+      textures.erase(it);
+      ++keptCount;
+    }
+  }
+  for (size_t i = 0; i < scene.primitiveBuffers.size() && !buffers.empty(); ++i) {
+    auto &primitiveBuffer = scene.primitiveBuffers[i];
+    if (!primitiveBuffer.byteSize || !bufferSizes.count(primitiveBuffer.byteSize)) {
+      continue;
+    }
+    const auto hash = hashPrimitiveBuffer(scene.bufferSpans, primitiveBuffer);
+    const auto it = buffers.find(hash);
+    if (it != end(buffers)) {
+      auto &previousBuffer = previous.primitiveBuffers[it->second];
+      primitiveBuffer.buffer = previousBuffer.buffer;
+      primitiveBuffer.hash = hash;
+      previousBuffer.buffer = 0;
+      setupVertexArrayObject(primitiveBuffer, scene.vertexArrayObjects[i]);
+      buffers.erase(it);
+      ++keptCount;
+    }
+  }
+
+  return keptCount;
+}
+
+uint64_t ViewerApplication::hashImageTexture(const Scene &scene, size_t imageIdx) const {
+  // Everything its storage, swizzle and levels come from
+  const auto &image = scene.model.images[imageIdx];
+  const auto &encoding = scene.imageEncodings[imageIdx];
+  const auto &pixels = scene.imageSpans[imageIdx];
+  const int32_t layout[] = {image.width, image.height, image.component, image.bits,
+      int32_t(encoding.format), encoding.levelCount, scene.textureObjects.imageLevelCounts[imageIdx],
+      encoding.swizzle[0], encoding.swizzle[1], encoding.swizzle[2], encoding.swizzle[3]};
+  return hashBytes(pixels.data, pixels.size, hashBytes(layout, sizeof(layout)));
+}
+
+uint64_t ViewerApplication::hashPrimitiveBuffer(const std::vector<BufferSpan> &bufferSpans, const PrimitiveBuffer &primitiveBuffer) const {
+  auto hash = hashBytes(&primitiveBuffer.byteSize, sizeof(primitiveBuffer.byteSize));
+  for (const auto &source : primitiveBuffer.sources) {
+    hash = hashBytes(&source.offset, sizeof(source.offset), hash);
+    const auto bytes = getSourceBytes(bufferSpans, source);
+    hash = hashBytes(bytes.data, bytes.size, hash);
+  }
+  return hash;
+}
+
+bool ViewerApplication::loadCachedGltfFile(uint64_t cacheKey, Scene &scene) {
+  if (!cacheKey) {
+    return false;
+  }
+  const auto cachePath = getAssetCachePath(m_CacheDirectory, cacheKey);
+  if (!readAssetCache(cachePath, cacheKey, *scene.cacheFile, scene.model, scene.bufferSpans, scene.imageSpans, scene.imageEncodings, scene.lods, scene.geometry)) {
+    std::clog << "Cache miss for " << m_gltfFilePath << std::endl;
+    return false;
+  }
+  std::clog << "Cache hit for " << m_gltfFilePath << ": " << cachePath << std::endl;
+  return true;
+}
+
+bool ViewerApplication::loadGltfFile(Scene &scene) {
+  auto &model = scene.model;
+  auto &bufferSpans = scene.bufferSpans;
+  auto &imageSpans = scene.imageSpans;
+  auto &imageEncodings = scene.imageEncodings;
   tinygltf::TinyGLTF loader;
   std::string err;
   std::string warn;
 
-  bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, m_gltfFilePath.string());
+  // Images are decoded in parallel while tinygltf parses the rest of the file
+  ParallelImageDecoder imageDecoder{m_threadPool};
+  imageDecoder.install(loader);
+
+  // Only the default scene is displayed, what it does not use is not read
+  SceneResourceFilter sceneFilter;
+  imageDecoder.addSkippedImages(&sceneFilter.skippedImages());
+  // Buffer views compressed with EXT_meshopt_compression are decoded after
+  // parsing. Fallback buffers are declared first so that the scene filter
+  // can skip them too.
+  MeshoptDecompressor meshopt;
+  // KTX2 and DDS images are not decoded, their levels are uploaded as is.
+  // DDS sources of MSFT_texture_dds are selected before the scene filter so
+  // that the fallback images are skipped.
+  TextureContainerLoader containers;
+  containers.setSkippedImages(&sceneFilter.skippedImages());
+  imageDecoder.addSkippedImages(&containers.containerImages());
+  const auto patch = [&](nlohmann::json &gltf, VirtualFileSystem &vfs, const std::string &baseDir) {
+    meshopt.apply(gltf, vfs, baseDir);
+    containers.selectTextureSources(gltf, baseDir);
+    sceneFilter.apply(gltf, vfs, baseDir);
+    containers.apply(gltf, vfs, baseDir);
+  };
+
+  const auto parseStartTime = glfwGetTime();
+  bool ret = false;
+  if (m_gltfFilePath.extension() == ".glb") {
+    // Binary chunk stays in the mapped file, see loadGlbFile
+    ret = loadGlbFile(loader, model, err, warn, m_gltfFilePath, *scene.glbFile, bufferSpans, patch);
+  } else {
+    ret = loadGltfTextFile(loader, model, err, warn, m_gltfFilePath, patch);
+    bufferSpans = getBufferSpans(model);
+  }
+  sceneFilter.restore(model, bufferSpans);
+
+  if (ret && meshopt.compressedBufferViewCount()) {
+    const auto meshoptStartTime = glfwGetTime();
+    ret = meshopt.decompress(model, bufferSpans, m_threadPool, err);
+    std::clog << "Decoded " << meshopt.compressedBufferViewCount()
+              << " compressed buffer views in "
+              << 1000. * (glfwGetTime() - meshoptStartTime) << " ms" << std::endl;
+  }
+
+  // Always join, the workers may still be decoding if parsing failed
+  const auto decodeStartTime = glfwGetTime();
+  const auto imageCount = imageDecoder.imageCount();
+  ret = imageDecoder.join(model, err) && ret;
+  imageSpans = getImageSpans(model);
+  imageEncodings.assign(model.images.size(), ImageEncoding{});
+  if (ret && containers.imageCount()) {
+    containers.load(model, bufferSpans, imageSpans, imageEncodings, scene.imageFiles, warn);
+  }
+  const auto decodeEndTime = glfwGetTime();
+
+  std::clog << "Parsed glTF in " << 1000. * (decodeStartTime - parseStartTime)
+            << " ms, then waited " << 1000. * (decodeEndTime - decodeStartTime)
+            << " ms for " << imageCount << " images decoded on "
+            << m_threadPool.size() << " threads" << std::endl;
+  if (containers.imageCount()) {
+    std::clog << "Loaded " << containers.imageCount() << " KTX2 or DDS images with their mip levels" << std::endl;
+  }
+  if (sceneFilter.skippedBufferCount() || sceneFilter.skippedImageCount()) {
+    std::clog << "Skipped " << sceneFilter.skippedBufferCount() << " buffers and "
+              << sceneFilter.skippedImageCount() << " images unused by the default scene ("
+              << sceneFilter.skippedBytes() << " bytes not read)" << std::endl;
+  }
 
   if (!warn.empty()) {
     printf("Warn: %s\n", warn.c_str());
@@ -614,35 +1505,64 @@ bool ViewerApplication::loadGltfFile(tinygltf::Model & model) {
   return true;
 }
 
-std::vector<GLuint> ViewerApplication::createBufferObjects(const tinygltf::Model &model) {
-  std::vector<GLuint> bufferObjects(model.buffers.size(), 0);
-
-  glGenBuffers(GLsizei(model.buffers.size()), bufferObjects.data());
-  for (size_t i = 0; i < model.buffers.size(); ++i) {
-    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[i]);
-    glBufferStorage(GL_ARRAY_BUFFER, model.buffers[i].data.size(), // Assume a Buffer has a data member variable of type std::vector
-      model.buffers[i].data.data(), 0);
+void ViewerApplication::loadPrimitiveBuffer(Scene &scene, size_t primitiveIdx) {
+  auto &primitiveBuffer = scene.primitiveBuffers[primitiveIdx];
+  primitiveBuffer.hash = hashPrimitiveBuffer(scene.bufferSpans, primitiveBuffer);
+  glGenBuffers(1, &primitiveBuffer.buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, primitiveBuffer.buffer);
+  glBufferStorage(GL_ARRAY_BUFFER, primitiveBuffer.byteSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+  for (const auto &source : primitiveBuffer.sources) {
+    const auto bytes = getSourceBytes(scene.bufferSpans, source);
+    glBufferSubData(GL_ARRAY_BUFFER, source.offset, bytes.size, bytes.data);
+    // Pages of the mapped files are read again from disk if it comes back
+    scene.glbFile->evict(bytes.data, bytes.size);
+    scene.cacheFile->evict(bytes.data, bytes.size);
   }
-  glBindBuffer(GL_ARRAY_BUFFER, 0); // Cleanup the binding point after the loop
+  setupVertexArrayObject(primitiveBuffer, scene.vertexArrayObjects[primitiveIdx]);
+}
+
+void ViewerApplication::setupVertexArrayObject(const PrimitiveBuffer &primitiveBuffer, GLuint vertexArrayObject) {
+  // POSITION, NORMAL, TEXCOORD_0 interleaved at the start of the buffer, see
+  // QuantizedVertex, then the indices
+  const auto stride = GLsizei(sizeof(QuantizedVertex));
+  glBindBuffer(GL_ARRAY_BUFFER, primitiveBuffer.buffer);
+  glBindVertexArray(vertexArrayObject);
+  glEnableVertexAttribArray(VERTEX_ATTRIB_POSITION_IDX);
+  glVertexAttribPointer(VERTEX_ATTRIB_POSITION_IDX, 3, GL_UNSIGNED_SHORT,
+      GL_TRUE, stride, (const GLvoid *)offsetof(QuantizedVertex, position));
+  glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL_IDX);
+  glVertexAttribPointer(VERTEX_ATTRIB_NORMAL_IDX, 2, GL_SHORT, GL_TRUE,
+      stride, (const GLvoid *)offsetof(QuantizedVertex, normal));
+  glEnableVertexAttribArray(VERTEX_ATTRIB_TEXCOORD0_IDX);
+  glVertexAttribPointer(VERTEX_ATTRIB_TEXCOORD0_IDX, 2, GL_HALF_FLOAT,
+      GL_FALSE, stride, (const GLvoid *)offsetof(QuantizedVertex, texCoord));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, primitiveBuffer.buffer);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-  return bufferObjects;
+void ViewerApplication::evictPrimitiveBuffer(PrimitiveBuffer &primitiveBuffer, GLuint vertexArrayObject) {
+  // A buffer still attached to the VAO is not freed by glDeleteBuffers
+  glBindVertexArray(vertexArrayObject);
+  glDisableVertexAttribArray(VERTEX_ATTRIB_POSITION_IDX);
+  glDisableVertexAttribArray(VERTEX_ATTRIB_NORMAL_IDX);
+  glDisableVertexAttribArray(VERTEX_ATTRIB_TEXCOORD0_IDX);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glVertexAttribPointer(VERTEX_ATTRIB_POSITION_IDX, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0, nullptr);
+  glVertexAttribPointer(VERTEX_ATTRIB_NORMAL_IDX, 2, GL_SHORT, GL_TRUE, 0, nullptr);
+  glVertexAttribPointer(VERTEX_ATTRIB_TEXCOORD0_IDX, 2, GL_HALF_FLOAT, GL_FALSE, 0, nullptr);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+  glDeleteBuffers(1, &primitiveBuffer.buffer);
+  primitiveBuffer.buffer = 0;
 }
 
-std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshIndexToVaoRange) {
+std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model, std::vector<VaoRange> &meshIndexToVaoRange) {
   std::vector<GLuint> vertexArrayObjects;
 
   // For each mesh of model we keep its range of VAOs
   meshIndexToVaoRange.resize(model.meshes.size());
 
-  const GLuint VERTEX_ATTRIB_POSITION_IDX = 0;
-  const GLuint VERTEX_ATTRIB_NORMAL_IDX = 1;
-  const GLuint VERTEX_ATTRIB_TEXCOORD0_IDX = 2;
-
-  std::map<std::string, GLuint> attributes;
-  attributes.insert(std::make_pair("POSITION", VERTEX_ATTRIB_POSITION_IDX));
-  attributes.insert(std::make_pair("NORMAL", VERTEX_ATTRIB_NORMAL_IDX));
-  attributes.insert(std::make_pair("TEXCOORD_0", VERTEX_ATTRIB_TEXCOORD0_IDX));
-
   for (size_t i = 0; i < model.meshes.size(); ++i) {
     const auto &mesh = model.meshes[i];
     const auto vaoOffset = vertexArrayObjects.size();
@@ -651,60 +1571,17 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
     auto &vaoRange = meshIndexToVaoRange[i];
     vaoRange.begin = GLsizei(vaoOffset); // Range for this mesh will be at the end of vertexArrayObjects
     vaoRange.count = GLsizei(mesh.primitives.size()); // One VAO for each primitive
+    // Their attributes are set when the buffer of the primitive is loaded
     glGenVertexArrays(vaoRange.count, &vertexArrayObjects[vaoRange.begin]);
-
-    for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
-      const auto vao = vertexArrayObjects[vaoRange.begin + pIdx];
-      const auto &primitive = mesh.primitives[pIdx];
-      glBindVertexArray(vao);
-
-      // Loop over POSITION, NORMAL, TEXCOORD_0
-      for (auto attribute : attributes) {
-        const auto iterator = primitive.attributes.find(attribute.first); // for example attribute.first = "POSITION"
-        if (iterator != end(primitive.attributes)) {
-          const auto accessorIdx = (*iterator).second;
-          const auto &accessor = model.accessors[accessorIdx];
-          const auto &bufferView = model.bufferViews[accessor.bufferView];
-          const auto bufferIdx = bufferView.buffer;
-
-          glEnableVertexAttribArray(attribute.second);
-
-          assert(GL_ARRAY_BUFFER == bufferView.target);
-
-          // Theorically we could also use bufferView.target, but it is safer
-          // Here it is important to know that the next call
-          // (glVertexAttribPointer) use what is currently bound
-          glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[bufferIdx]);
-
-          // tinygltf converts strings type like "VEC3, "VEC2" to the number of
-          // components, stored in accessor.type
-          const auto byteOffset = accessor.byteOffset + bufferView.byteOffset;
-          glVertexAttribPointer(attribute.second, accessor.type,
-              accessor.componentType, GL_FALSE, GLsizei(bufferView.byteStride),
-              (const GLvoid *)byteOffset);
-        }
-      }
-
-      if (primitive.indices >= 0) {
-        const auto accessorIdx = primitive.indices;
-        const auto &accessor = model.accessors[accessorIdx];
-        const auto &bufferView = model.bufferViews[accessor.bufferView];
-        const auto bufferIdx = bufferView.buffer;
-
-        assert(GL_ELEMENT_ARRAY_BUFFER == bufferView.target);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObjects[bufferIdx]);
-      }
-    }
   }
-  glBindVertexArray(0); // Unbind VAO
 
   std::clog << "Number of VAOs: " << vertexArrayObjects.size() << std::endl;
 
   return vertexArrayObjects;
 }
 
-std::vector<GLuint> ViewerApplication::createTextureObjects(const tinygltf::Model &model) const {
-  std::vector<GLuint> textureObjects(model.textures.size(), 0);
+ViewerApplication::TextureObjects ViewerApplication::createTextureObjects(const tinygltf::Model &model, const std::vector<BufferSpan> &imageSpans, const std::vector<ImageEncoding> &imageEncodings) {
+  TextureObjects objects;
 
   tinygltf::Sampler defaultSampler;
   defaultSampler.minFilter = GL_LINEAR;
@@ -713,49 +1590,137 @@ std::vector<GLuint> ViewerApplication::createTextureObjects(const tinygltf::Mode
   defaultSampler.wrapT = GL_REPEAT;
   defaultSampler.wrapR = GL_REPEAT;
 
-  glActiveTexture(GL_TEXTURE0);
-  glGenTextures(GLsizei(model.textures.size()), textureObjects.data());
+  // One sampler object per glTF sampler, the last one for textures without
+  objects.samplerObjects.resize(model.samplers.size() + 1, 0);
+  glGenSamplers(GLsizei(objects.samplerObjects.size()), objects.samplerObjects.data());
+  for (size_t i = 0; i < objects.samplerObjects.size(); ++i) {
+    const auto &sampler = i < model.samplers.size() ? model.samplers[i] : defaultSampler;
+    const auto samplerObject = objects.samplerObjects[i];
+    glSamplerParameteri(samplerObject, GL_TEXTURE_MIN_FILTER, sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
+    glSamplerParameteri(samplerObject, GL_TEXTURE_MAG_FILTER, sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
+    glSamplerParameteri(samplerObject, GL_TEXTURE_WRAP_S, sampler.wrapS);
+    glSamplerParameteri(samplerObject, GL_TEXTURE_WRAP_T, sampler.wrapT);
+    glSamplerParameteri(samplerObject, GL_TEXTURE_WRAP_R, sampler.wrapR);
+  }
+
+  // Images with the same content share their storage, it needs mip levels if
+  // one of its textures samples them
+  const auto firstImages = findDuplicateImages(model, imageSpans, imageEncodings, m_threadPool);
+  std::vector<bool> usedImages(model.images.size(), false);
+  std::vector<bool> imageMipmaps(model.images.size(), false);
+  objects.samplers.resize(model.textures.size(), 0);
   for (size_t i = 0; i < model.textures.size(); ++i) {
-    // Assume a texture object has been created and bound to GL_TEXTURE_2D
-    const auto &texture = model.textures[i]; // get i-th texture
+    const auto &texture = model.textures[i];
     assert(texture.source >= 0); // ensure a source image is present
-    const auto &image = model.images[texture.source]; // get the image
-
-    glBindTexture(GL_TEXTURE_2D, textureObjects[i]); // Bind to target GL_TEXTURE_2D
-
-    // fill the texture object with the data from the image
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0,
-            GL_RGBA, image.pixel_type, image.image.data());
-
-    const auto &sampler = texture.sampler >= 0 ? model.samplers[texture.sampler] : defaultSampler;
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, sampler.wrapR);
-
-    if (sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST ||
-      sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR ||
-      sampler.minFilter == GL_LINEAR_MIPMAP_NEAREST ||
-      sampler.minFilter == GL_LINEAR_MIPMAP_LINEAR) {
-      glGenerateMipmap(GL_TEXTURE_2D);
+    const auto samplerIdx = texture.sampler >= 0 ? size_t(texture.sampler) : model.samplers.size();
+    objects.samplers[i] = objects.samplerObjects[samplerIdx];
+    const auto imageIdx = firstImages[texture.source];
+    usedImages[imageIdx] = true;
+    if (isMipmapFilter(texture.sampler >= 0 ? model.samplers[texture.sampler].minFilter : defaultSampler.minFilter)) {
+      imageMipmaps[imageIdx] = true;
+    }
+  }
+
+  // Texture objects are created by loadImageTexture, only the size of their
+  // storage is known here
+  objects.imageTextures.resize(model.images.size(), 0);
+  objects.imageLevelCounts.resize(model.images.size(), 0);
+  objects.imageByteSizes.resize(model.images.size(), 0);
+  objects.imageMipmaps = std::move(imageMipmaps);
+  objects.imageHashes.resize(model.images.size(), 0);
+  size_t textureCount = 0, duplicateCount = 0, totalSize = 0;
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    const auto &pixels = imageSpans[i];
+    if (firstImages[i] != i) {
+      ++duplicateCount;
+      continue;
+    }
+    if (!usedImages[i] || !pixels.size) {
+      continue; // Image not decoded or not used, no storage: it is never sampled
     }
+    layoutImageTexture(model, imageEncodings, objects, i);
+    totalSize += objects.imageByteSizes[i];
+    ++textureCount;
+  }
+
+  objects.textureImages.resize(model.textures.size(), -1);
+  for (size_t i = 0; i < model.textures.size(); ++i) {
+    const auto imageIdx = firstImages[model.textures[i].source];
+    if (objects.imageLevelCounts[imageIdx]) {
+      objects.textureImages[i] = int(imageIdx);
+    }
+  }
+
+  std::clog << textureCount << " texture objects for " << model.textures.size()
+            << " textures (" << duplicateCount << " duplicate images), " << totalSize
+            << " bytes loaded on demand" << std::endl;
+
+  return objects;
+}
+
+void ViewerApplication::layoutImageTexture(const tinygltf::Model &model, const std::vector<ImageEncoding> &imageEncodings, TextureObjects &objects, size_t imageIdx) {
+  // Images come with their mip levels (see generateMipmaps), the driver only
+  // computes those that could not be generated on the CPU.
+  const auto &image = model.images[imageIdx];
+  const auto &encoding = imageEncodings[imageIdx];
+  const bool storedLevels = encoding.format != TextureFormat::Raw || encoding.levelCount > 1;
+  const auto levelCount = storedLevels ? encoding.levelCount
+                          : objects.imageMipmaps[imageIdx] ? getMipLevelCount(image) : 1;
+  objects.imageLevelCounts[imageIdx] = levelCount;
+  objects.imageByteSizes[imageIdx] = 0;
+  for (int level = 0; level < levelCount; ++level) {
+    objects.imageByteSizes[imageIdx] += getLevelByteSize(image, encoding.format, level);
+  }
+}
 
+void ViewerApplication::loadImageTexture(Scene &scene, size_t imageIdx) {
+  auto &objects = scene.textureObjects;
+  const auto &image = scene.model.images[imageIdx];
+  const auto &encoding = scene.imageEncodings[imageIdx];
+  auto &texture = objects.imageTextures[imageIdx];
+  // No storage (nothing decoded): the texture stays 0 and the white texture
+  // is sampled instead
+  if (!objects.imageLevelCounts[imageIdx] || !scene.imageSpans[imageIdx].size) {
+    return;
   }
+  // Hashed while the bytes are known to be valid, a reload may come after
+  // the file is rewritten
+  objects.imageHashes[imageIdx] = hashImageTexture(scene, imageIdx);
 
+  // Only allocate the storage here, the pixels are streamed by m_textureStreamer
+  glActiveTexture(GL_TEXTURE0);
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexStorage2D(GL_TEXTURE_2D, objects.imageLevelCounts[imageIdx],
+      getTextureInternalFormat(image, encoding.format), image.width, image.height);
+  // Packed channels are read back where the shaders expect them
+  const GLint swizzleValues[] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA, GL_ZERO, GL_ONE};
+  const GLint swizzle[] = {swizzleValues[encoding.swizzle[0]], swizzleValues[encoding.swizzle[1]],
+      swizzleValues[encoding.swizzle[2]], swizzleValues[encoding.swizzle[3]]};
+  glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
   glBindTexture(GL_TEXTURE_2D, 0);
+  const bool storedLevels = encoding.format != TextureFormat::Raw || encoding.levelCount > 1;
+  m_textureStreamer.enqueue(texture, image, scene.imageSpans[imageIdx], encoding,
+      objects.imageMipmaps[imageIdx] && !storedLevels);
+}
 
-  return textureObjects;
+void ViewerApplication::evictImageTexture(TextureObjects &objects, size_t imageIdx) {
+  auto &texture = objects.imageTextures[imageIdx];
+  if (!texture) {
+    return;
+  }
+  m_textureStreamer.cancel(texture);
+  glDeleteTextures(1, &texture);
+  texture = 0;
 }
 
-GLuint ViewerApplication::createDefaultTexture() const {
-  GLuint whiteTexture;
+GLuint ViewerApplication::createDefaultTexture(const glm::vec4 &color) const {
+  GLuint texture;
 
-  float white[] = {1, 1, 1, 1};
-  glGenTextures(1, &whiteTexture);
-  glBindTexture(GL_TEXTURE_2D, whiteTexture);
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0,
-          GL_RGBA, GL_FLOAT, &white);
+          GL_RGBA, GL_FLOAT, glm::value_ptr(color));
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -765,59 +1730,138 @@ GLuint ViewerApplication::createDefaultTexture() const {
 
   glBindTexture(GL_TEXTURE_2D, 0);
 
-  return whiteTexture;
+  return texture;
 }
 
 void ViewerApplication::initPrograms() {
+  // Linked programs are cached next to the preprocessed assets. All are
+  // submitted before waiting for any, see finishPrograms.
+  m_programsStartTime = glfwGetTime();
+  m_programCache.init(m_CacheDirectory, enableParallelShaderCompile());
+  const auto submitProgram = [&](GLProgram &program, std::vector<fs::path> shaderPaths,
+      const std::vector<std::string> &defines = {}) {
+    m_pendingPrograms.emplace_back(&program, m_programCache.submit(std::move(shaderPaths), defines));
+  };
+
   // Forward rendering program
-  m_forwardProgram = compileProgram({
+  submitProgram(m_forwardProgram, {
     m_ShadersRootPath / m_AppName / m_vertexShader,
     m_ShadersRootPath / m_AppName / m_fragmentShader
   });
 
-  // Geometry pass program
-  m_geometryProgram = compileProgram({
+  // Geometry pass program, its other variants are submitted with the scene
+  m_geometryVariants.clear();
+  submitProgram(m_geometryProgram, {
     m_ShadersRootPath / m_AppName / m_geometryPassVSShader,
     m_ShadersRootPath / m_AppName / m_geometryPassFSShader
-  });
+  }, getMaterialDefines(MATERIAL_ALL_UNIFORMS));
 
   // Shading pass program
-  m_shadingProgram = compileProgram({
+  submitProgram(m_shadingProgram, {
     m_ShadersRootPath / m_AppName / m_shadingPassVSShader,
     m_ShadersRootPath / m_AppName / m_shadingPassFSShader
   });
 
   // SSAO pass program
-  m_ssaoProgram = compileProgram({
+  submitProgram(m_ssaoProgram, {
     m_ShadersRootPath / m_AppName / m_ssaoPassVSShader,
     m_ShadersRootPath / m_AppName / m_ssaoPassFSShader
   });
 
   // SSAO blur program
-  m_ssaoBlurProgram = compileProgram({
+  submitProgram(m_ssaoBlurProgram, {
     m_ShadersRootPath / m_AppName / m_ssaoPassVSShader,
     m_ShadersRootPath / m_AppName / m_ssaoBlurFSShader
   });
 
   // Display depth program
-  m_displayDepthProgram = compileProgram({
+  submitProgram(m_displayDepthProgram, {
     m_ShadersRootPath / m_AppName / m_ssaoPassVSShader,
     m_ShadersRootPath / m_AppName / m_displayDepthFSShader
   });
 
   // Blur program (for bloom)
-  m_blurProgram = compileProgram({
+  submitProgram(m_blurProgram, {
     m_ShadersRootPath / m_AppName / m_blurVSShader,
     m_ShadersRootPath / m_AppName / m_blurFSShader
   });
 
   // Bloom final program (final pass)
-  m_bloomProgram = compileProgram({
+  submitProgram(m_bloomProgram, {
     m_ShadersRootPath / m_AppName / m_bloomVSShader,
     m_ShadersRootPath / m_AppName / m_bloomFSShader
   });
 }
 
+void ViewerApplication::submitGeometryPrograms(const Scene &scene) {
+  // Those of the materials with every feature turned on, and without
+  // material. Others (features turned off in the GUI) are compiled when
+  // first drawn.
+  std::vector<uint32_t> featureSets = {0};
+  featureSets.insert(end(featureSets), begin(scene.materialFeatures), end(scene.materialFeatures));
+  for (const auto features : featureSets) {
+    if (features == MATERIAL_ALL_UNIFORMS || m_geometryVariants.count(features)) {
+      continue;
+    }
+    auto &program = m_geometryVariants[features];
+    m_pendingPrograms.emplace_back(&program, m_programCache.submit({
+      m_ShadersRootPath / m_AppName / m_geometryPassVSShader,
+      m_ShadersRootPath / m_AppName / m_geometryPassFSShader
+    }, getMaterialDefines(features)));
+  }
+}
+
+const GLProgram &ViewerApplication::getGeometryProgram(uint32_t features) {
+  if (features == MATERIAL_ALL_UNIFORMS) {
+    return m_geometryProgram;
+  }
+  const auto it = m_geometryVariants.find(features);
+  if (it != end(m_geometryVariants)) {
+    return it->second;
+  }
+  auto &program = m_geometryVariants[features];
+  program = m_programCache.finish(m_programCache.submit({
+    m_ShadersRootPath / m_AppName / m_geometryPassVSShader,
+    m_ShadersRootPath / m_AppName / m_geometryPassFSShader
+  }, getMaterialDefines(features)));
+  initGeometryProgram(program, features);
+  return program;
+}
+
+void ViewerApplication::initGeometryProgram(const GLProgram &program, uint32_t features) const {
+  // Uniforms have the same explicit locations in all variants, samplers
+  // read fixed texture units
+  if (features & MATERIAL_BASE_COLOR_TEXTURE) {
+    glProgramUniform1i(program.glId(), m_uBaseColorTextureLocation, 0);
+  }
+  if (features & MATERIAL_METALLIC_ROUGHNESS_TEXTURE) {
+    glProgramUniform1i(program.glId(), m_uMetallicRoughnessTextureLocation, 1);
+  }
+  if (features & MATERIAL_EMISSIVE_TEXTURE) {
+    glProgramUniform1i(program.glId(), m_uEmissiveTextureLocation, 2);
+  }
+  if ((features & MATERIAL_OCCLUSION_TEXTURE) && !(features & MATERIAL_OCCLUSION_IN_METALLIC_ROUGHNESS)) {
+    glProgramUniform1i(program.glId(), m_uOcclusionTextureLocation, 3);
+  }
+}
+
+void ViewerApplication::finishPrograms() {
+  size_t readyCount = 0;
+  for (const auto &pending : m_pendingPrograms) {
+    readyCount += m_programCache.isReady(pending.second);
+  }
+  const auto waitStartTime = glfwGetTime();
+  for (const auto &pending : m_pendingPrograms) {
+    *pending.first = m_programCache.finish(pending.second);
+  }
+  m_pendingPrograms.clear();
+  std::clog << "Programs ready in " << 1000. * (glfwGetTime() - m_programsStartTime)
+            << " ms (" << readyCount << " ready before waiting, then waited "
+            << 1000. * (glfwGetTime() - waitStartTime) << " ms): "
+            << m_programCache.hitCount() << " from the binary cache, "
+            << m_programCache.missCount() << " compiled" << std::endl;
+}
+
 void ViewerApplication::initUniforms() {
   // Geometry pass uniforms
   m_modelViewProjMatrixLocation = glGetUniformLocation(m_geometryProgram.glId(), "uModelViewProjMatrix");
@@ -831,6 +1875,11 @@ void ViewerApplication::initUniforms() {
   m_uEmissiveTextureLocation = glGetUniformLocation(m_geometryProgram.glId(), "uEmissiveTexture");
   m_uEmissiveFactorLocation = glGetUniformLocation(m_geometryProgram.glId(), "uEmissiveFactor");
   m_uOcclusionTextureLocation = glGetUniformLocation(m_geometryProgram.glId(), "uOcclusionTexture");
+  m_uAlphaCutoffLocation = glGetUniformLocation(m_geometryProgram.glId(), "uAlphaCutoff");
+  initGeometryProgram(m_geometryProgram, MATERIAL_ALL_UNIFORMS);
+  for (const auto &variant : m_geometryVariants) {
+    initGeometryProgram(variant.second, variant.first);
+  }
 
   // Shading pass uniforms
   m_uLightDirectionLocation = glGetUniformLocation(m_shadingProgram.glId(), "uLightDirection");
@@ -1067,7 +2116,10 @@ void ViewerApplication::initBloom() {
 ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
     uint32_t height, const fs::path &gltfFile,
     const std::vector<float> &lookatArgs, const std::string &vertexShader,
-    const std::string &fragmentShader, const fs::path &output) :
+    const std::string &fragmentShader, const fs::path &output,
+    const fs::path &cacheDirectory, bool optimizeIndices,
+    bool compressTextures, bool generateLods, bool buildHlods,
+    size_t gpuMemoryBudget) :
     m_nWindowWidth(width),
     m_nWindowHeight(height),
     m_AppPath{appPath},
@@ -1075,7 +2127,13 @@ ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
     m_ImGuiIniFilename{m_AppName + ".imgui.ini"},
     m_ShadersRootPath{m_AppPath.parent_path() / "shaders"},
     m_gltfFilePath{gltfFile},
-    m_OutputPath{output}
+    m_CacheDirectory{cacheDirectory},
+    m_optimizeIndices{optimizeIndices},
+    m_compressTextures{compressTextures},
+    m_generateLods{generateLods},
+    m_buildHlods{buildHlods},
+    m_OutputPath{output},
+    m_gpuMemoryBudget{gpuMemoryBudget}
 {
   if (!lookatArgs.empty()) {
     m_hasUserCamera = true;
@@ -3,8 +3,22 @@
 #include "utils/GLFWHandle.hpp"
 #include "utils/cameras.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/gltf.hpp"
+#include "utils/mapped_file.hpp"
+#include "utils/mesh_lod.hpp"
+#include "utils/meshlets.hpp"
+#include "utils/node_table.hpp"
+#include "utils/program_cache.hpp"
+#include "utils/residency_manager.hpp"
+#include "utils/scene_geometry.hpp"
 #include "utils/shaders.hpp"
+#include "utils/texture_compression.hpp"
+#include "utils/texture_streamer.hpp"
+#include "utils/thread_pool.hpp"
+#include "utils/vertex_quantizer.hpp"
+#include <memory>
 #include <tiny_gltf.h>
+#include <unordered_map>
 
 class ViewerApplication
 {
@@ -12,7 +26,9 @@ public:
   ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height,
       const fs::path &gltfFile, const std::vector<float> &lookatArgs,
       const std::string &vertexShader, const std::string &fragmentShader,
-      const fs::path &output);
+      const fs::path &output, const fs::path &cacheDirectory,
+      bool optimizeIndices, bool compressTextures, bool generateLods,
+      bool buildHlods, size_t gpuMemoryBudget);
 
   int run();
 
@@ -25,20 +41,98 @@ private:
     GLsizei count; // Number of elements in range
   };
 
+  // GL objects of the glTF textures. Texture objects are created per distinct
+  // image when it becomes resident, sampler objects per glTF sampler.
+  struct TextureObjects
+  {
+    std::vector<int> textureImages; // By glTF texture, -1 if its image is empty
+    std::vector<GLuint> samplers; // By glTF texture
+    std::vector<GLuint> imageTextures; // By image, 0 if not resident
+    std::vector<GLuint> samplerObjects; // By glTF sampler, then the default one
+    // By image, of the texture storage (0 levels for duplicates and images
+    // that are never sampled)
+    std::vector<int> imageLevelCounts;
+    std::vector<size_t> imageByteSizes;
+    std::vector<bool> imageMipmaps; // Sampled with mip levels
+    // Of what resident textures hold, see hashImageTexture
+    std::vector<uint64_t> imageHashes;
+  };
+
+  // GL buffer of a primitive, created when it becomes resident from its
+  // layout, whose sources are in the buffers of the scene
+  struct PrimitiveBuffer : PrimitiveLayout
+  {
+    GLuint buffer = 0; // 0 if not resident
+    uint64_t hash = 0; // Of what it holds once resident, see hashPrimitiveBuffer
+  };
+
+  // Everything that comes from the glTF file, replaced as a whole when it is
+  // reloaded. Programs, G-buffers and the camera do not depend on it.
+  struct Scene
+  {
+    // Buffers and images may point in these mappings, declared first to be
+    // destroyed last. Behind pointers so that they stay put when the scene
+    // is moved.
+    std::unique_ptr<MappedFile> glbFile = std::make_unique<MappedFile>(); // Its BIN chunk
+    std::unique_ptr<MappedFile> cacheFile = std::make_unique<MappedFile>(); // On a cache hit
+    std::vector<std::unique_ptr<MappedFile>> imageFiles; // KTX2 and DDS images
+
+    tinygltf::Model model;
+    std::vector<BufferSpan> bufferSpans;
+    std::vector<BufferSpan> imageSpans;
+    std::vector<ImageEncoding> imageEncodings;
+    MeshLods lods;
+    SceneGeometry geometry; // Built with the cache file, read from it on a hit
+    std::vector<uint32_t> materialFeatures; // See getGeometryProgram
+
+    TextureObjects textureObjects;
+    std::vector<PrimitiveBuffer> primitiveBuffers;
+    std::vector<VaoRange> meshIndexToVaoRange;
+    std::vector<GLuint> vertexArrayObjects;
+    // Images, then primitives (in VAO order) are loaded when the traversal
+    // first requests them, and released when the budget is full
+    ResidencyManager residency;
+  };
+
   GLsizei m_nWindowWidth = 1280;
   GLsizei m_nWindowHeight = 720;
 
-  bool loadGltfFile(tinygltf::Model &model);
-  std::vector<GLuint> createBufferObjects(const tinygltf::Model &model);
-  std::vector<GLuint> createVertexArrayObjects(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshIndexToVaoRange);
-  std::vector<GLuint> createTextureObjects(const tinygltf::Model &model) const;
-  GLuint createDefaultTexture() const;
+  bool loadScene(Scene &scene);
+  void createSceneObjects(Scene &scene);
+  void destroySceneObjects(Scene &scene);
+  bool reloadImages(Scene &scene, const std::vector<fs::path> &changedFiles);
+  size_t adoptSceneObjects(Scene &scene, Scene &previous);
+  uint64_t hashImageTexture(const Scene &scene, size_t imageIdx) const;
+  uint64_t hashPrimitiveBuffer(const std::vector<BufferSpan> &bufferSpans, const PrimitiveBuffer &primitiveBuffer) const;
+  bool loadGltfFile(Scene &scene);
+  bool loadCachedGltfFile(uint64_t cacheKey, Scene &scene);
+  void loadPrimitiveBuffer(Scene &scene, size_t primitiveIdx);
+  void setupVertexArrayObject(const PrimitiveBuffer &primitiveBuffer, GLuint vertexArrayObject);
+  void evictPrimitiveBuffer(PrimitiveBuffer &primitiveBuffer, GLuint vertexArrayObject);
+  std::vector<GLuint> createVertexArrayObjects(const tinygltf::Model &model, std::vector<VaoRange> &meshIndexToVaoRange);
+  TextureObjects createTextureObjects(const tinygltf::Model &model, const std::vector<BufferSpan> &imageSpans, const std::vector<ImageEncoding> &imageEncodings);
+  void layoutImageTexture(const tinygltf::Model &model, const std::vector<ImageEncoding> &imageEncodings, TextureObjects &objects, size_t imageIdx);
+  void loadImageTexture(Scene &scene, size_t imageIdx);
+  void evictImageTexture(TextureObjects &objects, size_t imageIdx);
+  GLuint createDefaultTexture(const glm::vec4 &color) const;
 
   const fs::path m_AppPath;
   const std::string m_AppName;
   const fs::path m_ShadersRootPath;
 
   fs::path m_gltfFilePath;
+  // Directory of the preprocessed asset cache, empty if disabled
+  fs::path m_CacheDirectory;
+  // Reorder triangles and vertices of indexed primitives at load time
+  bool m_optimizeIndices = false;
+  // Compress 8 bits images to BCn formats at load time (cached)
+  bool m_compressTextures = false;
+  // Simplify big primitives at load time (cached), MSFT_lod is always used
+  bool m_generateLods = false;
+  // Merge big subtrees into simplified proxies at load time (cached)
+  bool m_buildHlods = false;
+  // Workers for loading tasks (image decoding)
+  ThreadPool m_threadPool;
 
   std::string m_vertexShader = "geometryPass.vs.glsl";
   std::string m_fragmentShader = "geometryPass.fs.glsl";
@@ -104,12 +198,30 @@ private:
   // GL Programs
   GLProgram m_shadingProgram;
   GLProgram m_forwardProgram;
-  GLProgram m_geometryProgram;
+  GLProgram m_geometryProgram; // With every uniform, see initUniforms
+  // Variants of the geometry pass program by material features, compiled
+  // for the materials of the scene at startup, later on demand
+  std::unordered_map<uint32_t, GLProgram> m_geometryVariants;
   GLProgram m_ssaoProgram;
   GLProgram m_ssaoBlurProgram;
   GLProgram m_displayDepthProgram;
   GLProgram m_blurProgram;
   GLProgram m_bloomProgram;
+  // Binaries of the programs above, from a previous run
+  ProgramCache m_programCache;
+  // Submitted by initPrograms, with their index in m_programCache
+  std::vector<std::pair<GLProgram *, size_t>> m_pendingPrograms;
+  double m_programsStartTime = 0.;
+
+  // Texture uploads spread over frames, at most m_textureUploadBudget bytes
+  // per frame. Materials use the white texture until theirs are resident.
+  TextureStreamer m_textureStreamer;
+  size_t m_textureUploadBudget = 16 * 1024 * 1024;
+
+  // Buffers and textures are only created for the primitives near the view
+  // frustum and their materials, at most m_gpuMemoryBudget bytes of them
+  // (0 for no limit), the least recently visible ones are released first
+  size_t m_gpuMemoryBudget = 0;
 
   // Geometry Pass Uniforms Locations
   GLint m_modelViewProjMatrixLocation;
@@ -123,6 +235,7 @@ private:
   GLint m_uEmissiveTextureLocation;
   GLint m_uEmissiveFactorLocation;
   GLint m_uOcclusionTextureLocation;
+  GLint m_uAlphaCutoffLocation;
 
   // Shading Pass Uniforms Locations
   GLint m_uLightDirectionLocation;
@@ -165,7 +278,11 @@ private:
   GLint m_uShowBloomOnlyLocation;
 
   void initPrograms();
+  void submitGeometryPrograms(const Scene &scene);
+  void finishPrograms();
   void initUniforms();
+  const GLProgram &getGeometryProgram(uint32_t features);
+  void initGeometryProgram(const GLProgram &program, uint32_t features) const;
   void initTriangle();
   void renderTriangle() const;
   void initGBuffers();
@@ -1,11 +1,14 @@
 #include "ViewerApplication.hpp"
 #include "utils/GLFWHandle.hpp"
+#include "utils/embedded_shaders.hpp"
 #include "utils/filesystem.hpp"
 
 #include <args.hxx>
+#include <cstdlib>
 
 std::vector<std::string> split(
     const std::string &str, const std::string &delim);
+fs::path getUserCacheDirectory();
 
 int main(int argc, char **argv)
 {
@@ -43,8 +46,43 @@ int main(int argc, char **argv)
             "Output path to render the image. If specified no window is shown. "
             "Only png is supported.",
             {"o", "output"}};
+        args::ValueFlag<std::string> cacheDir{parser, "cache-dir",
+            "Directory of the preprocessed asset cache (default: "
+            "$XDG_CACHE_HOME/gltf-viewer or ~/.cache/gltf-viewer, "
+            "%LOCALAPPDATA%\\gltf-viewer on Windows)",
+            {"cache-dir"}};
+        args::Flag noCache{
+            parser, "no-cache", "Disable the asset cache", {"no-cache"}};
+        args::Flag optimizeIndices{parser, "optimize-indices",
+            "Reorder triangles and vertices for the vertex cache, overdraw "
+            "and vertex fetch at load time",
+            {"optimize-indices"}};
+        args::Flag compressTextures{parser, "compress-textures",
+            "Compress 8 bits textures to BCn formats at load time (cached) "
+            "instead of uploading them as decoded",
+            {"compress-textures"}};
+        args::Flag generateLods{parser, "generate-lods",
+            "Generate simplified levels of detail of big primitives at load "
+            "time (cached). MSFT_lod levels are used either way.",
+            {"generate-lods"}};
+        args::Flag buildHlods{parser, "build-hlods",
+            "Merge big node subtrees into simplified proxies drawn at a "
+            "distance, at load time (cached)",
+            {"build-hlods"}};
+        args::ValueFlag<size_t> gpuBudget{parser, "gpu-budget",
+            "GPU memory for buffers and textures, in MB. The least recently "
+            "visible ones are released to stay under it (default: no limit)",
+            {"gpu-budget"}};
+        args::Flag shadersFromDisk{parser, "shaders-from-disk",
+            "Read shaders from the shaders directory next to the executable "
+            "instead of those built in, to edit them without building again",
+            {"shaders-from-disk"}};
         parser.Parse();
 
+        if (shadersFromDisk) {
+          setEmbeddedShadersEnabled(false);
+        }
+
         std::vector<float> lookatParams;
         if (lookat) {
           const std::string &lookatArgs = args::get(lookat);
@@ -62,9 +100,19 @@ int main(int argc, char **argv)
         uint32_t width = imageWidth ? args::get(imageWidth) : 1280;
         uint32_t height = imageHeight ? args::get(imageHeight) : 720;
 
+        fs::path cacheDirectory;
+        if (!noCache) {
+          // The directory of the executable may not be writable. Without a
+          // user cache directory the cache is disabled.
+          cacheDirectory = cacheDir ? fs::path{args::get(cacheDir)}
+                                    : getUserCacheDirectory();
+        }
+
         ViewerApplication app{fs::path{argv[0]}, width, height, args::get(file),
             lookatParams, args::get(vertexShader), args::get(fragmentShader),
-            args::get(output)};
+            args::get(output), cacheDirectory, optimizeIndices,
+            compressTextures, generateLods, buildHlods,
+            (gpuBudget ? args::get(gpuBudget) : 0) << 20};
         returnCode = app.run();
       }};
 
@@ -107,4 +155,22 @@ std::vector<std::string> split(const std::string &str, const std::string &delim)
     prev = pos + delim.length();
   } while (pos < str.length() && prev < str.length());
   return tokens;
-}
\ No newline at end of file
+}
+fs::path getUserCacheDirectory()
+{
+  const auto getPath = [](const char *name) {
+    const auto value = std::getenv(name);
+    return value && *value ? fs::path{value} : fs::path{};
+  };
+#ifdef _WIN32
+  const auto localAppData = getPath("LOCALAPPDATA");
+  return localAppData.empty() ? localAppData : localAppData / "gltf-viewer";
+#else
+  const auto xdgCacheHome = getPath("XDG_CACHE_HOME");
+  if (xdgCacheHome.is_absolute()) {
+    return xdgCacheHome / "gltf-viewer";
+  }
+  const auto home = getPath("HOME");
+  return home.empty() ? home : home / ".cache" / "gltf-viewer";
+#endif
+}
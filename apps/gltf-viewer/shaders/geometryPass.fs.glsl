@@ -1,17 +1,24 @@
-#version 330
+#version 430
+
+// Material features, defined or not for each variant of the program:
+// BASE_COLOR_TEXTURE, METALLIC_ROUGHNESS_TEXTURE, EMISSIVE_TEXTURE,
+// OCCLUSION_TEXTURE, OCCLUSION_IN_METALLIC_ROUGHNESS (the occlusion is the
+// red channel of the metallic roughness texture) and ALPHA_MASK
 
 in vec3 vViewSpaceNormal;
 in vec3 vViewSpacePosition;
 in vec2 vTexCoords;
 
-uniform vec4 uBaseColorFactor;
-uniform sampler2D uBaseColorTexture;
-uniform float uMetallicFactor;
-uniform float uRoughnessFactor;
-uniform sampler2D uMetallicRoughnessTexture;
-uniform sampler2D uEmissiveTexture;
-uniform vec3 uEmissiveFactor;
-uniform sampler2D uOcclusionTexture;
+// Explicit locations, the same in every variant of the program
+layout(location = 3) uniform vec4 uBaseColorFactor;
+layout(location = 4) uniform sampler2D uBaseColorTexture;
+layout(location = 5) uniform float uMetallicFactor;
+layout(location = 6) uniform float uRoughnessFactor;
+layout(location = 7) uniform sampler2D uMetallicRoughnessTexture;
+layout(location = 8) uniform sampler2D uEmissiveTexture;
+layout(location = 9) uniform vec3 uEmissiveFactor;
+layout(location = 10) uniform sampler2D uOcclusionTexture;
+layout(location = 11) uniform float uAlphaCutoff;
 
 layout(location = 0) out vec3 fPosition;
 layout(location = 1) out vec3 fNormal;
@@ -19,40 +26,55 @@ layout(location = 2) out vec3 fDiffuse;
 layout(location = 3) out vec3 fMetalRoughness;
 layout(location = 4) out vec3 fEmissive;
 
+#include "srgb.glsl"
+
 // Constants
-const float GAMMA = 2.2;
-const float INV_GAMMA = 1. / GAMMA;
-const float M_PI = 3.141592653589793;
-const float M_1_PI = 1.0 / M_PI;
 const vec3 black = vec3(0, 0, 0);
-const vec3 dielectricSpecular = vec3(0.04f, 0.04f, 0.04f);
-
-// sRGB to linear approximation
-// see http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
-vec4 SRGBtoLINEAR(vec4 srgbIn)
-{
-  return vec4(pow(srgbIn.xyz, vec3(GAMMA)), srgbIn.w);
-}
 
 void main()
 {
 
-  // Normal
-  vec3 N = normalize(vViewSpaceNormal);
-
   // Diffuse
+#ifdef BASE_COLOR_TEXTURE
   vec4 baseColorFromTexture = SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
   vec4 baseColor = baseColorFromTexture * uBaseColorFactor;
+#else
+  vec4 baseColor = uBaseColorFactor;
+#endif
+#ifdef ALPHA_MASK
+  if (baseColor.a < uAlphaCutoff) {
+    discard;
+  }
+#endif
+
+  // Normal
+  vec3 N = normalize(vViewSpaceNormal);
 
   // Metallic / Roughness
-  float metallic = texture(uMetallicRoughnessTexture, vTexCoords).b * uMetallicFactor;
-  float roughness = texture(uMetallicRoughnessTexture, vTexCoords).g * uRoughnessFactor;
+#ifdef METALLIC_ROUGHNESS_TEXTURE
+  vec4 metallicRoughness = texture(uMetallicRoughnessTexture, vTexCoords);
+  float metallic = metallicRoughness.b * uMetallicFactor;
+  float roughness = metallicRoughness.g * uRoughnessFactor;
+#else
+  float metallic = uMetallicFactor;
+  float roughness = uRoughnessFactor;
+#endif
 
-  // Emissive
+  // Emissive, none without texture
+#ifdef EMISSIVE_TEXTURE
   vec3 emissive = SRGBtoLINEAR(texture(uEmissiveTexture, vTexCoords)).rgb * uEmissiveFactor;
+#else
+  vec3 emissive = black;
+#endif
 
   // Occlusion
+#if defined(OCCLUSION_IN_METALLIC_ROUGHNESS)
+  float occlusion = metallicRoughness.r;
+#elif defined(OCCLUSION_TEXTURE)
   float occlusion = texture(uOcclusionTexture, vTexCoords).r;
+#else
+  float occlusion = 1.;
+#endif
 
   // Deferred shading
   fPosition = vViewSpacePosition;
@@ -60,4 +82,4 @@ void main()
   fDiffuse = baseColor.rgb;
   fMetalRoughness = vec3(occlusion, roughness, metallic);
   fEmissive = emissive;
-}
\ No newline at end of file
+}
@@ -20,32 +20,14 @@ uniform float uBloomThreshold;
 layout (location = 0) out vec3 fColor;
 layout (location = 1) out vec3 BrightColor;  
 
+#include "srgb.glsl"
+
 // Constants
-const float GAMMA = 2.2;
-const float INV_GAMMA = 1. / GAMMA;
 const float M_PI = 3.141592653589793;
 const float M_1_PI = 1.0 / M_PI;
 const vec3 black = vec3(0);
 const vec3 dielectricSpecular = vec3(0.04f);
 
-// We need some simple tone mapping functions
-// Basic gamma = 2.2 implementation
-// Stolen here: https://github.com/KhronosGroup/glTF-Sample-Viewer/blob/master/src/shaders/tonemapping.glsl
-
-// linear to sRGB approximation
-// see http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
-vec3 LINEARtoSRGB(vec3 color)
-{
-  return pow(color, vec3(INV_GAMMA));
-}
-
-// sRGB to linear approximation
-// see http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
-vec4 SRGBtoLINEAR(vec4 srgbIn)
-{
-  return vec4(pow(srgbIn.xyz, vec3(GAMMA)), srgbIn.w);
-}
-
 void main()
 {
   vec3 position = vec3(texelFetch(uGPosition, ivec2(gl_FragCoord.xy), 0));
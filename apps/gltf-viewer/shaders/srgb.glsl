@@ -0,0 +1,17 @@
+// Basic gamma = 2.2 transfer functions, included where needed
+const float GAMMA = 2.2;
+const float INV_GAMMA = 1. / GAMMA;
+
+// linear to sRGB approximation
+// see http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
+vec3 LINEARtoSRGB(vec3 color)
+{
+  return pow(color, vec3(INV_GAMMA));
+}
+
+// sRGB to linear approximation
+// see http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
+vec4 SRGBtoLINEAR(vec4 srgbIn)
+{
+  return vec4(pow(srgbIn.xyz, vec3(GAMMA)), srgbIn.w);
+}
@@ -0,0 +1,1136 @@
+#include "asset_cache.hpp"
+#include "hash.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <json.hpp>
+#include <random>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+namespace
+{
+const uint32_t CACHE_MAGIC = 0x31435647; // "GVC1"
+// Increment when the layout below changes, old files are then ignored
+const uint32_t CACHE_VERSION = 9;
+const size_t BLOB_ALIGNMENT = 16;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Next to file, different for each writer (threads or concurrent viewers)
+fs::path getTemporaryPath(const fs::path &file)
+{
+  std::random_device device;
+  const auto suffix = (uint64_t(device()) << 32) ^ device() ^
+                      uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+  return fs::path(file.string() + "." + hashToHex(suffix) + ".tmp");
+}
+
+// Append-only little endian serialization of the model metadata
+class Writer
+{
+public:
+  template <typename T> void pod(const T &value)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    const auto bytes = reinterpret_cast<const unsigned char *>(&value);
+    m_data.insert(end(m_data), bytes, bytes + sizeof(T));
+  }
+
+  template <typename T> void podVector(const std::vector<T> &values)
+  {
+    pod(uint64_t(values.size()));
+    for (const auto &value : values) {
+      pod(value);
+    }
+  }
+
+  void string(const std::string &str)
+  {
+    pod(uint64_t(str.size()));
+    m_data.insert(end(m_data), begin(str), end(str));
+  }
+
+  const std::vector<unsigned char> &data() const { return m_data; }
+
+private:
+  std::vector<unsigned char> m_data;
+};
+
+// Reader matching Writer. Any out of bounds read sets the failed state and
+// returns zeros, so that callers only check ok() at the end.
+class Reader
+{
+public:
+  Reader(const unsigned char *begin, const unsigned char *end) :
+      m_cur(begin), m_end(end)
+  {
+  }
+
+  template <typename T> T pod()
+  {
+    T value{};
+    if (size_t(m_end - m_cur) < sizeof(T)) {
+      m_ok = false;
+      return value;
+    }
+    std::memcpy(&value, m_cur, sizeof(T));
+    m_cur += sizeof(T);
+    return value;
+  }
+
+  template <typename T> std::vector<T> podVector()
+  {
+    const auto count = size();
+    std::vector<T> values(m_ok ? count : 0);
+    for (auto &value : values) {
+      value = pod<T>();
+    }
+    return values;
+  }
+
+  std::string string()
+  {
+    const auto count = size();
+    if (!m_ok) {
+      return std::string();
+    }
+    std::string str(reinterpret_cast<const char *>(m_cur), count);
+    m_cur += count;
+    return str;
+  }
+
+  bool ok() const { return m_ok; }
+
+  void fail() { m_ok = false; }
+
+  bool atEnd() const { return m_cur == m_end; }
+
+private:
+  // Element count, checked against the remaining bytes to reject garbage
+  size_t size()
+  {
+    const auto count = pod<uint64_t>();
+    if (count > uint64_t(m_end - m_cur)) {
+      m_ok = false;
+      return 0;
+    }
+    return size_t(count);
+  }
+
+  const unsigned char *m_cur;
+  const unsigned char *m_end;
+  bool m_ok = true;
+};
+
+// JSON values of extras and extensions, as a type then its content
+void writeValue(Writer &w, const tinygltf::Value &value)
+{
+  w.pod(uint8_t(value.Type()));
+  if (value.IsBool()) {
+    w.pod(uint8_t(value.Get<bool>()));
+  } else if (value.IsInt()) {
+    w.pod(int32_t(value.Get<int>()));
+  } else if (value.IsReal()) {
+    w.pod(value.Get<double>());
+  } else if (value.IsString()) {
+    w.string(value.Get<std::string>());
+  } else if (value.IsBinary()) {
+    w.podVector(value.Get<std::vector<unsigned char>>());
+  } else if (value.IsArray()) {
+    const auto &array = value.Get<tinygltf::Value::Array>();
+    w.pod(uint64_t(array.size()));
+    for (const auto &element : array) {
+      writeValue(w, element);
+    }
+  } else if (value.IsObject()) {
+    const auto &object = value.Get<tinygltf::Value::Object>();
+    w.pod(uint64_t(object.size()));
+    for (const auto &member : object) {
+      w.string(member.first);
+      writeValue(w, member.second);
+    }
+  }
+}
+
+// Extensions (those the loader did not consume, like MSFT_lod) and extras of
+// any glTF object
+void writeProperties(Writer &w, const tinygltf::ExtensionMap &extensions,
+    const tinygltf::Value &extras)
+{
+  w.pod(uint64_t(extensions.size()));
+  for (const auto &extension : extensions) {
+    w.string(extension.first);
+    writeValue(w, extension.second);
+  }
+  writeValue(w, extras);
+}
+
+template <typename TextureInfo>
+void writeTextureInfo(Writer &w, const TextureInfo &info)
+{
+  w.pod(int32_t(info.index));
+  w.pod(int32_t(info.texCoord));
+  writeProperties(w, info.extensions, info.extras);
+}
+
+void writeModel(Writer &w, const tinygltf::Model &model)
+{
+  w.pod(int32_t(model.defaultScene));
+  w.pod(uint64_t(model.extensionsUsed.size()));
+  for (const auto &extension : model.extensionsUsed) {
+    w.string(extension);
+  }
+  w.pod(uint64_t(model.extensionsRequired.size()));
+  for (const auto &extension : model.extensionsRequired) {
+    w.string(extension);
+  }
+  // Holds KHR_lights_punctual, model.lights is parsed from it
+  writeProperties(w, model.extensions, model.extras);
+
+  w.pod(uint64_t(model.scenes.size()));
+  for (const auto &scene : model.scenes) {
+    w.string(scene.name);
+    w.podVector(scene.nodes);
+    writeProperties(w, scene.extensions, scene.extras);
+  }
+
+  w.pod(uint64_t(model.nodes.size()));
+  for (const auto &node : model.nodes) {
+    w.string(node.name);
+    w.pod(int32_t(node.mesh));
+    w.pod(int32_t(node.camera));
+    w.pod(int32_t(node.skin));
+    w.podVector(node.children);
+    w.podVector(node.matrix);
+    w.podVector(node.translation);
+    w.podVector(node.rotation);
+    w.podVector(node.scale);
+    w.podVector(node.weights);
+    writeProperties(w, node.extensions, node.extras);
+  }
+
+  w.pod(uint64_t(model.meshes.size()));
+  for (const auto &mesh : model.meshes) {
+    w.string(mesh.name);
+    w.pod(uint64_t(mesh.primitives.size()));
+    for (const auto &primitive : mesh.primitives) {
+      w.pod(uint64_t(primitive.attributes.size()));
+      for (const auto &attribute : primitive.attributes) {
+        w.string(attribute.first);
+        w.pod(int32_t(attribute.second));
+      }
+      w.pod(int32_t(primitive.indices));
+      w.pod(int32_t(primitive.material));
+      w.pod(int32_t(primitive.mode));
+      w.pod(uint64_t(primitive.targets.size()));
+      for (const auto &target : primitive.targets) {
+        w.pod(uint64_t(target.size()));
+        for (const auto &attribute : target) {
+          w.string(attribute.first);
+          w.pod(int32_t(attribute.second));
+        }
+      }
+      writeProperties(w, primitive.extensions, primitive.extras);
+    }
+    w.podVector(mesh.weights);
+    writeProperties(w, mesh.extensions, mesh.extras);
+  }
+
+  w.pod(uint64_t(model.accessors.size()));
+  for (const auto &accessor : model.accessors) {
+    w.string(accessor.name);
+    w.pod(int32_t(accessor.bufferView));
+    w.pod(uint64_t(accessor.byteOffset));
+    w.pod(uint8_t(accessor.normalized));
+    w.pod(int32_t(accessor.componentType));
+    w.pod(uint64_t(accessor.count));
+    w.pod(int32_t(accessor.type));
+    w.podVector(accessor.minValues);
+    w.podVector(accessor.maxValues);
+    w.pod(accessor.sparse);
+    writeProperties(w, accessor.extensions, accessor.extras);
+  }
+
+  w.pod(uint64_t(model.bufferViews.size()));
+  for (const auto &bufferView : model.bufferViews) {
+    w.string(bufferView.name);
+    w.pod(int32_t(bufferView.buffer));
+    w.pod(uint64_t(bufferView.byteOffset));
+    w.pod(uint64_t(bufferView.byteLength));
+    w.pod(uint64_t(bufferView.byteStride));
+    w.pod(int32_t(bufferView.target));
+    writeProperties(w, bufferView.extensions, bufferView.extras);
+  }
+
+  w.pod(uint64_t(model.materials.size()));
+  for (const auto &material : model.materials) {
+    const auto &pbr = material.pbrMetallicRoughness;
+    w.string(material.name);
+    w.podVector(pbr.baseColorFactor);
+    writeTextureInfo(w, pbr.baseColorTexture);
+    w.pod(pbr.metallicFactor);
+    w.pod(pbr.roughnessFactor);
+    writeTextureInfo(w, pbr.metallicRoughnessTexture);
+    writeProperties(w, pbr.extensions, pbr.extras);
+    writeTextureInfo(w, material.normalTexture);
+    w.pod(material.normalTexture.scale);
+    writeTextureInfo(w, material.occlusionTexture);
+    w.pod(material.occlusionTexture.strength);
+    writeTextureInfo(w, material.emissiveTexture);
+    w.podVector(material.emissiveFactor);
+    w.string(material.alphaMode);
+    w.pod(material.alphaCutoff);
+    w.pod(uint8_t(material.doubleSided));
+    writeProperties(w, material.extensions, material.extras);
+  }
+
+  w.pod(uint64_t(model.textures.size()));
+  for (const auto &texture : model.textures) {
+    w.string(texture.name);
+    w.pod(int32_t(texture.source));
+    w.pod(int32_t(texture.sampler));
+    writeProperties(w, texture.extensions, texture.extras);
+  }
+
+  w.pod(uint64_t(model.samplers.size()));
+  for (const auto &sampler : model.samplers) {
+    w.string(sampler.name);
+    w.pod(int32_t(sampler.minFilter));
+    w.pod(int32_t(sampler.magFilter));
+    w.pod(int32_t(sampler.wrapS));
+    w.pod(int32_t(sampler.wrapT));
+    w.pod(int32_t(sampler.wrapR));
+    writeProperties(w, sampler.extensions, sampler.extras);
+  }
+
+  w.pod(uint64_t(model.images.size()));
+  for (const auto &image : model.images) {
+    w.string(image.name);
+    w.string(image.uri);
+    w.string(image.mimeType);
+    w.pod(int32_t(image.width));
+    w.pod(int32_t(image.height));
+    w.pod(int32_t(image.component));
+    w.pod(int32_t(image.bits));
+    w.pod(int32_t(image.pixel_type));
+    writeProperties(w, image.extensions, image.extras);
+  }
+
+  w.pod(uint64_t(model.buffers.size()));
+  for (const auto &buffer : model.buffers) {
+    w.string(buffer.name);
+    w.string(buffer.uri);
+    writeProperties(w, buffer.extensions, buffer.extras);
+  }
+
+  w.pod(uint64_t(model.animations.size()));
+  for (const auto &animation : model.animations) {
+    w.string(animation.name);
+    w.pod(uint64_t(animation.channels.size()));
+    for (const auto &channel : animation.channels) {
+      w.pod(int32_t(channel.sampler));
+      w.pod(int32_t(channel.target_node));
+      w.string(channel.target_path);
+      writeProperties(w, channel.extensions, channel.extras);
+    }
+    w.pod(uint64_t(animation.samplers.size()));
+    for (const auto &sampler : animation.samplers) {
+      w.pod(int32_t(sampler.input));
+      w.pod(int32_t(sampler.output));
+      w.string(sampler.interpolation);
+      writeProperties(w, sampler.extensions, sampler.extras);
+    }
+    writeProperties(w, animation.extensions, animation.extras);
+  }
+
+  w.pod(uint64_t(model.skins.size()));
+  for (const auto &skin : model.skins) {
+    w.string(skin.name);
+    w.pod(int32_t(skin.inverseBindMatrices));
+    w.pod(int32_t(skin.skeleton));
+    w.podVector(skin.joints);
+    writeProperties(w, skin.extensions, skin.extras);
+  }
+
+  w.pod(uint64_t(model.cameras.size()));
+  for (const auto &camera : model.cameras) {
+    const auto &perspective = camera.perspective;
+    const auto &orthographic = camera.orthographic;
+    w.string(camera.name);
+    w.string(camera.type);
+    w.pod(perspective.aspectRatio);
+    w.pod(perspective.yfov);
+    w.pod(perspective.zfar);
+    w.pod(perspective.znear);
+    writeProperties(w, perspective.extensions, perspective.extras);
+    w.pod(orthographic.xmag);
+    w.pod(orthographic.ymag);
+    w.pod(orthographic.zfar);
+    w.pod(orthographic.znear);
+    writeProperties(w, orthographic.extensions, orthographic.extras);
+    writeProperties(w, camera.extensions, camera.extras);
+  }
+}
+
+template <typename Function> void readArray(Reader &r, Function &&readElement)
+{
+  const auto count = r.pod<uint64_t>();
+  for (uint64_t i = 0; i < count && r.ok(); ++i) {
+    readElement();
+  }
+}
+
+std::vector<std::string> readStrings(Reader &r)
+{
+  std::vector<std::string> strings;
+  readArray(r, [&]() { strings.push_back(r.string()); });
+  return strings;
+}
+
+// Nesting is bounded so that a corrupted file cannot overflow the stack
+tinygltf::Value readValue(Reader &r, int depth = 0)
+{
+  const auto type = r.pod<uint8_t>();
+  switch (type) {
+  case tinygltf::BOOL_TYPE:
+    return tinygltf::Value(r.pod<uint8_t>() != 0);
+  case tinygltf::INT_TYPE:
+    return tinygltf::Value(int(r.pod<int32_t>()));
+  case tinygltf::REAL_TYPE:
+    return tinygltf::Value(r.pod<double>());
+  case tinygltf::STRING_TYPE:
+    return tinygltf::Value(r.string());
+  case tinygltf::BINARY_TYPE:
+    return tinygltf::Value(r.podVector<unsigned char>());
+  case tinygltf::ARRAY_TYPE:
+  case tinygltf::OBJECT_TYPE: {
+    if (depth >= 64) {
+      r.fail();
+      return tinygltf::Value();
+    }
+    tinygltf::Value::Array array;
+    tinygltf::Value::Object object;
+    readArray(r, [&]() {
+      if (type == tinygltf::ARRAY_TYPE) {
+        array.push_back(readValue(r, depth + 1));
+      } else {
+        auto name = r.string();
+        object[name] = readValue(r, depth + 1);
+      }
+    });
+    return type == tinygltf::ARRAY_TYPE ? tinygltf::Value(std::move(array))
+                                        : tinygltf::Value(std::move(object));
+  }
+  default:
+    if (type != tinygltf::NULL_TYPE) {
+      r.fail();
+    }
+    return tinygltf::Value();
+  }
+}
+
+void readProperties(
+    Reader &r, tinygltf::ExtensionMap &extensions, tinygltf::Value &extras)
+{
+  readArray(r, [&]() {
+    auto name = r.string();
+    extensions[name] = readValue(r);
+  });
+  extras = readValue(r);
+}
+
+template <typename TextureInfo>
+void readTextureInfo(Reader &r, TextureInfo &info)
+{
+  info.index = r.pod<int32_t>();
+  info.texCoord = r.pod<int32_t>();
+  readProperties(r, info.extensions, info.extras);
+}
+
+void readModel(Reader &r, tinygltf::Model &model)
+{
+  model.defaultScene = r.pod<int32_t>();
+  model.extensionsUsed = readStrings(r);
+  model.extensionsRequired = readStrings(r);
+  readProperties(r, model.extensions, model.extras);
+
+  readArray(r, [&]() {
+    model.scenes.emplace_back();
+    auto &scene = model.scenes.back();
+    scene.name = r.string();
+    scene.nodes = r.podVector<int>();
+    readProperties(r, scene.extensions, scene.extras);
+  });
+
+  readArray(r, [&]() {
+    model.nodes.emplace_back();
+    auto &node = model.nodes.back();
+    node.name = r.string();
+    node.mesh = r.pod<int32_t>();
+    node.camera = r.pod<int32_t>();
+    node.skin = r.pod<int32_t>();
+    node.children = r.podVector<int>();
+    node.matrix = r.podVector<double>();
+    node.translation = r.podVector<double>();
+    node.rotation = r.podVector<double>();
+    node.scale = r.podVector<double>();
+    node.weights = r.podVector<double>();
+    readProperties(r, node.extensions, node.extras);
+  });
+
+  readArray(r, [&]() {
+    model.meshes.emplace_back();
+    auto &mesh = model.meshes.back();
+    mesh.name = r.string();
+    readArray(r, [&]() {
+      mesh.primitives.emplace_back();
+      auto &primitive = mesh.primitives.back();
+      readArray(r, [&]() {
+        auto name = r.string();
+        primitive.attributes[name] = r.pod<int32_t>();
+      });
+      primitive.indices = r.pod<int32_t>();
+      primitive.material = r.pod<int32_t>();
+      primitive.mode = r.pod<int32_t>();
+      readArray(r, [&]() {
+        primitive.targets.emplace_back();
+        auto &target = primitive.targets.back();
+        readArray(r, [&]() {
+          auto name = r.string();
+          target[name] = r.pod<int32_t>();
+        });
+      });
+      readProperties(r, primitive.extensions, primitive.extras);
+    });
+    mesh.weights = r.podVector<double>();
+    readProperties(r, mesh.extensions, mesh.extras);
+  });
+
+  readArray(r, [&]() {
+    model.accessors.emplace_back();
+    auto &accessor = model.accessors.back();
+    accessor.name = r.string();
+    accessor.bufferView = r.pod<int32_t>();
+    accessor.byteOffset = size_t(r.pod<uint64_t>());
+    accessor.normalized = r.pod<uint8_t>() != 0;
+    accessor.componentType = r.pod<int32_t>();
+    accessor.count = size_t(r.pod<uint64_t>());
+    accessor.type = r.pod<int32_t>();
+    accessor.minValues = r.podVector<double>();
+    accessor.maxValues = r.podVector<double>();
+    accessor.sparse = r.pod<decltype(accessor.sparse)>();
+    readProperties(r, accessor.extensions, accessor.extras);
+  });
+
+  readArray(r, [&]() {
+    model.bufferViews.emplace_back();
+    auto &bufferView = model.bufferViews.back();
+    bufferView.name = r.string();
+    bufferView.buffer = r.pod<int32_t>();
+    bufferView.byteOffset = size_t(r.pod<uint64_t>());
+    bufferView.byteLength = size_t(r.pod<uint64_t>());
+    bufferView.byteStride = size_t(r.pod<uint64_t>());
+    bufferView.target = r.pod<int32_t>();
+    readProperties(r, bufferView.extensions, bufferView.extras);
+  });
+
+  readArray(r, [&]() {
+    model.materials.emplace_back();
+    auto &material = model.materials.back();
+    auto &pbr = material.pbrMetallicRoughness;
+    material.name = r.string();
+    pbr.baseColorFactor = r.podVector<double>();
+    readTextureInfo(r, pbr.baseColorTexture);
+    pbr.metallicFactor = r.pod<double>();
+    pbr.roughnessFactor = r.pod<double>();
+    readTextureInfo(r, pbr.metallicRoughnessTexture);
+    readProperties(r, pbr.extensions, pbr.extras);
+    readTextureInfo(r, material.normalTexture);
+    material.normalTexture.scale = r.pod<double>();
+    readTextureInfo(r, material.occlusionTexture);
+    material.occlusionTexture.strength = r.pod<double>();
+    readTextureInfo(r, material.emissiveTexture);
+    material.emissiveFactor = r.podVector<double>();
+    material.alphaMode = r.string();
+    material.alphaCutoff = r.pod<double>();
+    material.doubleSided = r.pod<uint8_t>() != 0;
+    readProperties(r, material.extensions, material.extras);
+  });
+
+  readArray(r, [&]() {
+    model.textures.emplace_back();
+    auto &texture = model.textures.back();
+    texture.name = r.string();
+    texture.source = r.pod<int32_t>();
+    texture.sampler = r.pod<int32_t>();
+    readProperties(r, texture.extensions, texture.extras);
+  });
+
+  readArray(r, [&]() {
+    model.samplers.emplace_back();
+    auto &sampler = model.samplers.back();
+    sampler.name = r.string();
+    sampler.minFilter = r.pod<int32_t>();
+    sampler.magFilter = r.pod<int32_t>();
+    sampler.wrapS = r.pod<int32_t>();
+    sampler.wrapT = r.pod<int32_t>();
+    sampler.wrapR = r.pod<int32_t>();
+    readProperties(r, sampler.extensions, sampler.extras);
+  });
+
+  readArray(r, [&]() {
+    model.images.emplace_back();
+    auto &image = model.images.back();
+    image.name = r.string();
+    image.uri = r.string();
+    image.mimeType = r.string();
+    image.width = r.pod<int32_t>();
+    image.height = r.pod<int32_t>();
+    image.component = r.pod<int32_t>();
+    image.bits = r.pod<int32_t>();
+    image.pixel_type = r.pod<int32_t>();
+    readProperties(r, image.extensions, image.extras);
+  });
+
+  readArray(r, [&]() {
+    model.buffers.emplace_back();
+    auto &buffer = model.buffers.back();
+    buffer.name = r.string();
+    buffer.uri = r.string();
+    readProperties(r, buffer.extensions, buffer.extras);
+  });
+
+  readArray(r, [&]() {
+    model.animations.emplace_back();
+    auto &animation = model.animations.back();
+    animation.name = r.string();
+    readArray(r, [&]() {
+      animation.channels.emplace_back();
+      auto &channel = animation.channels.back();
+      channel.sampler = r.pod<int32_t>();
+      channel.target_node = r.pod<int32_t>();
+      channel.target_path = r.string();
+      readProperties(r, channel.extensions, channel.extras);
+    });
+    readArray(r, [&]() {
+      animation.samplers.emplace_back();
+      auto &sampler = animation.samplers.back();
+      sampler.input = r.pod<int32_t>();
+      sampler.output = r.pod<int32_t>();
+      sampler.interpolation = r.string();
+      readProperties(r, sampler.extensions, sampler.extras);
+    });
+    readProperties(r, animation.extensions, animation.extras);
+  });
+
+  readArray(r, [&]() {
+    model.skins.emplace_back();
+    auto &skin = model.skins.back();
+    skin.name = r.string();
+    skin.inverseBindMatrices = r.pod<int32_t>();
+    skin.skeleton = r.pod<int32_t>();
+    skin.joints = r.podVector<int>();
+    readProperties(r, skin.extensions, skin.extras);
+  });
+
+  readArray(r, [&]() {
+    model.cameras.emplace_back();
+    auto &camera = model.cameras.back();
+    auto &perspective = camera.perspective;
+    auto &orthographic = camera.orthographic;
+    camera.name = r.string();
+    camera.type = r.string();
+    perspective.aspectRatio = r.pod<double>();
+    perspective.yfov = r.pod<double>();
+    perspective.zfar = r.pod<double>();
+    perspective.znear = r.pod<double>();
+    readProperties(r, perspective.extensions, perspective.extras);
+    orthographic.xmag = r.pod<double>();
+    orthographic.ymag = r.pod<double>();
+    orthographic.zfar = r.pod<double>();
+    orthographic.znear = r.pod<double>();
+    readProperties(r, orthographic.extensions, orthographic.extras);
+    readProperties(r, camera.extensions, camera.extras);
+  });
+}
+
+void writeGeometry(Writer &w, const SceneGeometry &geometry)
+{
+  const auto &vertices = geometry.quantizedVertices;
+  w.pod(int32_t(vertices.buffer));
+  for (const auto &quantizedPrimitives : vertices.primitives) {
+    w.podVector(quantizedPrimitives);
+  }
+
+  w.podVector(geometry.meshlets.meshlets);
+  for (const auto &meshletRanges : geometry.meshlets.primitives) {
+    w.podVector(meshletRanges);
+  }
+  for (const auto &lodRanges : geometry.primitiveLodRanges) {
+    w.podVector(lodRanges);
+  }
+  w.podVector(geometry.nodeLodRanges);
+  w.podVector(geometry.hlodProxyIndices);
+  w.podVector(geometry.meshBounds);
+
+  w.pod(uint64_t(geometry.primitiveLayouts.size()));
+  for (const auto &layout : geometry.primitiveLayouts) {
+    w.pod(uint64_t(layout.byteSize));
+    w.pod(uint64_t(layout.indexOffset));
+    w.podVector(layout.sources);
+    w.podVector(layout.lodOffsets);
+  }
+
+  // Runtime state (dirty flags, proxy validity) is not stored
+  const auto &table = geometry.nodeTable;
+  w.podVector(table.nodes);
+  w.podVector(table.nextEntries);
+  w.podVector(table.firstEntries);
+  w.podVector(table.meshes);
+  w.podVector(table.parents);
+  w.podVector(table.lodOwners);
+  w.podVector(table.childrenEnds);
+  w.podVector(table.subtreeEnds);
+  w.podVector(table.translations);
+  w.podVector(table.rotations);
+  w.podVector(table.scales);
+  w.podVector(table.worldMatrices);
+  w.podVector(table.normalMatrices);
+  w.podVector(table.worldScales);
+  w.podVector(table.localBounds);
+  w.podVector(table.worldBounds);
+}
+
+// Per mesh vectors have as many elements as the model has meshes
+void readGeometry(Reader &r, const tinygltf::Model &model, SceneGeometry &geometry)
+{
+  auto &vertices = geometry.quantizedVertices;
+  vertices.buffer = r.pod<int32_t>();
+  vertices.primitives.resize(model.meshes.size());
+  for (auto &quantizedPrimitives : vertices.primitives) {
+    quantizedPrimitives = r.podVector<QuantizedPrimitive>();
+  }
+
+  geometry.meshlets.meshlets = r.podVector<Meshlet>();
+  geometry.meshlets.primitives.resize(model.meshes.size());
+  for (auto &meshletRanges : geometry.meshlets.primitives) {
+    meshletRanges = r.podVector<MeshletRange>();
+  }
+  geometry.primitiveLodRanges.resize(model.meshes.size());
+  for (auto &lodRanges : geometry.primitiveLodRanges) {
+    lodRanges = r.podVector<LodRange>();
+  }
+  geometry.nodeLodRanges = r.podVector<LodRange>();
+  geometry.hlodProxyIndices = r.podVector<int>();
+  geometry.meshBounds = r.podVector<glm::vec4>();
+
+  readArray(r, [&]() {
+    geometry.primitiveLayouts.emplace_back();
+    auto &layout = geometry.primitiveLayouts.back();
+    layout.byteSize = size_t(r.pod<uint64_t>());
+    layout.indexOffset = size_t(r.pod<uint64_t>());
+    layout.sources = r.podVector<PrimitiveLayout::Source>();
+    layout.lodOffsets = r.podVector<size_t>();
+  });
+
+  auto &table = geometry.nodeTable;
+  table.nodes = r.podVector<int>();
+  table.nextEntries = r.podVector<int>();
+  table.firstEntries = r.podVector<int>();
+  table.meshes = r.podVector<int>();
+  table.parents = r.podVector<int>();
+  table.lodOwners = r.podVector<int>();
+  table.childrenEnds = r.podVector<uint32_t>();
+  table.subtreeEnds = r.podVector<uint32_t>();
+  table.translations = r.podVector<glm::vec3>();
+  table.rotations = r.podVector<glm::quat>();
+  table.scales = r.podVector<glm::vec3>();
+  table.worldMatrices = r.podVector<glm::mat4>();
+  table.normalMatrices = r.podVector<glm::mat4>();
+  table.worldScales = r.podVector<float>();
+  table.localBounds = r.podVector<glm::vec4>();
+  table.worldBounds = r.podVector<glm::vec4>();
+  table.dirty.assign(table.size(), 0);
+  table.proxyValid.assign(table.size(), 1);
+}
+
+bool isInRange(int index, size_t size)
+{
+  return index >= -1 && index < int64_t(size);
+}
+
+bool isInRange(const LodRange &range, size_t size)
+{
+  return range.begin <= size && range.count <= size - range.begin;
+}
+
+// Whatever the frame loop indexes with the geometry stays in bounds: vertices
+// and layout sources inside their buffer (buffers come first in blobs),
+// ranges inside their vectors, entries of the node table inside it
+bool checkGeometry(const tinygltf::Model &model, const MeshLods &lods,
+    const std::vector<BufferSpan> &blobs, const SceneGeometry &geometry)
+{
+  const auto &vertices = geometry.quantizedVertices;
+  size_t primitiveCount = 0;
+  for (const auto &mesh : model.meshes) {
+    primitiveCount += mesh.primitives.size();
+  }
+  if (!isInRange(vertices.buffer, model.buffers.size()) ||
+      geometry.primitiveLayouts.size() != primitiveCount ||
+      geometry.nodeLodRanges.size() != model.nodes.size() ||
+      geometry.hlodProxyIndices.size() != model.nodes.size() ||
+      geometry.meshBounds.size() != model.meshes.size()) {
+    return false;
+  }
+  auto layout = begin(geometry.primitiveLayouts);
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto count = model.meshes[meshIdx].primitives.size();
+    const auto &quantizedPrimitives = vertices.primitives[meshIdx];
+    if (quantizedPrimitives.size() != count ||
+        geometry.meshlets.primitives[meshIdx].size() != count ||
+        geometry.primitiveLodRanges[meshIdx].size() != count) {
+      return false;
+    }
+    for (const auto &quantized : quantizedPrimitives) {
+      if (!quantized.vertexCount) {
+        continue;
+      }
+      const auto size = vertices.buffer >= 0 ? blobs[vertices.buffer].size : 0;
+      if (quantized.byteOffset > size ||
+          quantized.vertexCount > (size - quantized.byteOffset) / sizeof(QuantizedVertex)) {
+        return false;
+      }
+    }
+    for (size_t primIdx = 0; primIdx < count; ++primIdx) {
+      const auto &meshletRange = geometry.meshlets.primitives[meshIdx][primIdx];
+      if (!isInRange(LodRange{meshletRange.begin, meshletRange.count},
+              geometry.meshlets.meshlets.size()) ||
+          !isInRange(geometry.primitiveLodRanges[meshIdx][primIdx], lods.primitives.size())) {
+        return false;
+      }
+      if (layout->lodOffsets.size() > geometry.primitiveLodRanges[meshIdx][primIdx].count ||
+          layout->indexOffset > layout->byteSize) {
+        return false;
+      }
+      for (const auto &source : layout->sources) {
+        if (source.buffer < 0 || source.buffer >= int64_t(model.buffers.size()) ||
+            source.byteOffset > blobs[source.buffer].size ||
+            source.byteSize > blobs[source.buffer].size - source.byteOffset ||
+            source.offset > layout->byteSize ||
+            source.byteSize > layout->byteSize - source.offset) {
+          return false;
+        }
+      }
+      ++layout;
+    }
+  }
+  for (size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx) {
+    if (!isInRange(geometry.nodeLodRanges[nodeIdx], lods.nodes.size()) ||
+        !isInRange(geometry.hlodProxyIndices[nodeIdx], lods.proxies.size())) {
+      return false;
+    }
+  }
+
+  const auto &table = geometry.nodeTable;
+  const auto n = table.size();
+  if (table.nextEntries.size() != n || table.meshes.size() != n ||
+      table.parents.size() != n || table.lodOwners.size() != n ||
+      table.childrenEnds.size() != n || table.subtreeEnds.size() != n ||
+      table.translations.size() != n || table.rotations.size() != n ||
+      table.scales.size() != n || table.worldMatrices.size() != n ||
+      table.normalMatrices.size() != n || table.worldScales.size() != n ||
+      table.localBounds.size() != n || table.worldBounds.size() != n ||
+      table.firstEntries.size() != model.nodes.size()) {
+    return false;
+  }
+  for (const auto entry : table.firstEntries) {
+    if (!isInRange(entry, n)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (table.nodes[i] < 0 || !isInRange(table.nodes[i], model.nodes.size()) ||
+        !isInRange(table.nextEntries[i], n) ||
+        !isInRange(table.meshes[i], model.meshes.size()) ||
+        !isInRange(table.parents[i], n) || !isInRange(table.lodOwners[i], n) ||
+        table.childrenEnds[i] > n || table.subtreeEnds[i] > n) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Uris of the external files referenced by a glTF JSON document
+std::vector<std::string> getExternalUris(const nlohmann::json &json)
+{
+  std::vector<std::string> uris;
+  for (const auto *key : {"buffers", "images"}) {
+    if (!json.count(key)) {
+      continue;
+    }
+    for (const auto &element : json[key]) {
+      const auto uri = element.value("uri", std::string());
+      if (!uri.empty() && uri.compare(0, 5, "data:") != 0) {
+        uris.push_back(uri);
+      }
+    }
+  }
+  return uris;
+}
+
+// JSON is the whole file, or the first chunk of a .glb
+nlohmann::json parseGltfJson(const MappedFile &file, const fs::path &gltfFile)
+{
+  const unsigned char *jsonBegin = file.data();
+  const unsigned char *jsonEnd = file.data() + file.size();
+  if (gltfFile.extension() == ".glb") {
+    if (file.size() < 20) {
+      return nlohmann::json::value_t::discarded;
+    }
+    uint32_t jsonLength;
+    std::memcpy(&jsonLength, file.data() + 12, sizeof(jsonLength));
+    jsonBegin = file.data() + 20;
+    jsonEnd = jsonBegin + std::min<size_t>(jsonLength, file.size() - 20);
+  }
+  return nlohmann::json::parse(jsonBegin, jsonEnd, nullptr, false);
+}
+} // namespace
+
+uint64_t computeAssetContentKey(const fs::path &gltfFile)
+{
+  MappedFile file;
+  if (!file.open(gltfFile)) {
+    return 0;
+  }
+  auto key = hashBytes(file.data(), file.size(), CACHE_VERSION);
+
+  const auto json = parseGltfJson(file, gltfFile);
+  if (json.is_discarded()) {
+    return 0;
+  }
+
+  for (const auto &uri : getExternalUris(json)) {
+    MappedFile external;
+    key = hashString(uri, key);
+    if (external.open(gltfFile.parent_path() / uri)) {
+      key = hashBytes(external.data(), external.size(), key);
+    }
+  }
+  return key;
+}
+
+uint64_t computeAssetCacheKey(const fs::path &cacheDirectory, const fs::path &gltfFile)
+{
+  // Stamp of the files: absolute path, size and modification time
+  auto stamp = uint64_t(CACHE_VERSION);
+  for (const auto &file : getAssetDependencies(gltfFile)) {
+    std::error_code error;
+    const auto path = fs::absolute(file, error);
+    const auto size = uint64_t(fs::file_size(file, error));
+    const auto writeTime = int64_t(fs::last_write_time(file, error).time_since_epoch().count());
+    stamp = hashString(path.string(), stamp);
+    stamp = hashBytes(&size, sizeof(size), stamp);
+    stamp = hashBytes(&writeTime, sizeof(writeTime), stamp);
+  }
+
+  // Known stamp, its key was computed by a previous run
+  const auto stampFile = cacheDirectory / (hashToHex(stamp) + ".gvstamp");
+  uint64_t key = 0;
+  {
+    std::ifstream in(stampFile.string(), std::ios::binary);
+    if (in.read(reinterpret_cast<char *>(&key), sizeof(key)) && key) {
+      return key;
+    }
+  }
+
+  // New, touched or moved files: hash their content, a cache file may
+  // already exist for it
+  key = computeAssetContentKey(gltfFile);
+  if (!key) {
+    return 0;
+  }
+  const auto tmpFile = getTemporaryPath(stampFile);
+  std::error_code error;
+  fs::create_directories(cacheDirectory, error);
+  bool ok = false;
+  {
+    std::ofstream out(tmpFile.string(), std::ios::binary);
+    ok = bool(out.write(reinterpret_cast<const char *>(&key), sizeof(key)));
+  }
+  if (ok) {
+    fs::rename(tmpFile, stampFile, error);
+  }
+  if (!ok || error) {
+    fs::remove(tmpFile, error);
+  }
+  return key;
+}
+
+std::vector<fs::path> getAssetDependencies(const fs::path &gltfFile)
+{
+  std::vector<fs::path> files{gltfFile};
+  MappedFile file;
+  if (!file.open(gltfFile)) {
+    return files;
+  }
+  const auto json = parseGltfJson(file, gltfFile);
+  if (!json.is_discarded()) {
+    for (const auto &uri : getExternalUris(json)) {
+      files.push_back(gltfFile.parent_path() / uri);
+    }
+  }
+  return files;
+}
+
+fs::path getAssetCachePath(const fs::path &cacheDirectory, uint64_t key)
+{
+  return cacheDirectory / (hashToHex(key) + ".gvcache");
+}
+
+bool writeAssetCache(const fs::path &cacheFile, uint64_t key,
+    const tinygltf::Model &model, const std::vector<BufferSpan> &bufferSpans,
+    const std::vector<BufferSpan> &imageSpans,
+    const std::vector<ImageEncoding> &imageEncodings, const MeshLods &lods,
+    const SceneGeometry &geometry)
+{
+  Writer meta;
+  writeModel(meta, model);
+  meta.podVector(imageEncodings);
+  meta.podVector(lods.primitives);
+  meta.podVector(lods.nodes);
+  meta.podVector(lods.proxies);
+  writeGeometry(meta, geometry);
+
+  // Blob table: offset (from the start of the file) and size of each blob
+  std::vector<BufferSpan> blobs(begin(bufferSpans), end(bufferSpans));
+  blobs.insert(end(blobs), begin(imageSpans), end(imageSpans));
+
+  const auto headerSize = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+  auto offset = alignUp(headerSize + meta.data().size() +
+                            sizeof(uint64_t) * (1 + 2 * blobs.size()),
+      BLOB_ALIGNMENT);
+  Writer table;
+  table.pod(uint64_t(blobs.size()));
+  for (const auto &blob : blobs) {
+    table.pod(uint64_t(offset));
+    table.pod(uint64_t(blob.size));
+    offset = alignUp(offset + blob.size, BLOB_ALIGNMENT);
+  }
+
+  // Write in a temporary file then rename, so that a crash or a concurrent
+  // viewer never sees a partial cache file
+  const auto tmpFile = getTemporaryPath(cacheFile);
+  try {
+    fs::create_directories(cacheFile.parent_path());
+  } catch (const std::exception &) {
+    return false;
+  }
+  auto ok = false;
+  {
+    std::ofstream out(tmpFile.string(), std::ios::binary);
+    if (!out) {
+      return false;
+    }
+    const char padding[BLOB_ALIGNMENT] = {};
+    size_t written = 0;
+    const auto write = [&](const void *data, size_t size) {
+      out.write(static_cast<const char *>(data), std::streamsize(size));
+      written += size;
+    };
+    const auto pad = [&]() {
+      write(padding, alignUp(written, BLOB_ALIGNMENT) - written);
+    };
+
+    const uint64_t metaSize = meta.data().size();
+    write(&CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    write(&CACHE_VERSION, sizeof(CACHE_VERSION));
+    write(&key, sizeof(key));
+    write(&metaSize, sizeof(metaSize));
+    write(meta.data().data(), meta.data().size());
+    write(table.data().data(), table.data().size());
+    for (const auto &blob : blobs) {
+      pad();
+      write(blob.data, blob.size);
+    }
+    ok = bool(out);
+  }
+  std::error_code error;
+  if (ok) {
+    fs::rename(tmpFile, cacheFile, error);
+  }
+  if (!ok || error) {
+    fs::remove(tmpFile, error);
+    return false;
+  }
+  return true;
+}
+
+bool readAssetCache(const fs::path &cacheFile, uint64_t key, MappedFile &file,
+    tinygltf::Model &model, std::vector<BufferSpan> &bufferSpans,
+    std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, MeshLods &lods,
+    SceneGeometry &geometry)
+{
+  if (!file.open(cacheFile)) {
+    return false;
+  }
+
+  Reader r(file.data(), file.data() + file.size());
+  if (r.pod<uint32_t>() != CACHE_MAGIC || r.pod<uint32_t>() != CACHE_VERSION ||
+      r.pod<uint64_t>() != key) {
+    file.close();
+    return false;
+  }
+  const auto headerSize = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+  const auto metaSize = r.pod<uint64_t>();
+  if (!r.ok() || metaSize > file.size() - headerSize) {
+    file.close();
+    return false;
+  }
+
+  // Model, LODs and geometry must end where the blob table starts
+  const auto metaBegin = file.data() + headerSize;
+  const auto metaEnd = metaBegin + metaSize;
+  Reader meta(metaBegin, metaEnd);
+  readModel(meta, model);
+  imageEncodings = meta.podVector<ImageEncoding>();
+  lods.primitives = meta.podVector<PrimitiveLod>();
+  lods.nodes = meta.podVector<NodeLod>();
+  lods.proxies = meta.podVector<HlodProxy>();
+  readGeometry(meta, model, geometry);
+
+  r = Reader(metaEnd, file.data() + file.size());
+  const auto blobCount = r.pod<uint64_t>();
+  if (!meta.ok() || !meta.atEnd() || !r.ok() ||
+      blobCount != model.buffers.size() + model.images.size() ||
+      imageEncodings.size() != model.images.size()) {
+    model = tinygltf::Model();
+    file.close();
+    return false;
+  }
+  std::vector<BufferSpan> blobs(static_cast<size_t>(blobCount));
+  for (auto &blob : blobs) {
+    const auto offset = r.pod<uint64_t>();
+    const auto size = r.pod<uint64_t>();
+    if (offset > file.size() || size > file.size() - offset) {
+      model = tinygltf::Model();
+      file.close();
+      return false;
+    }
+    blob = {file.data() + offset, size_t(size)};
+  }
+  if (!r.ok() || !checkGeometry(model, lods, blobs, geometry)) {
+    model = tinygltf::Model();
+    file.close();
+    return false;
+  }
+
+  bufferSpans.assign(begin(blobs), begin(blobs) + model.buffers.size());
+  imageSpans.assign(begin(blobs) + model.buffers.size(), end(blobs));
+  return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gltf.hpp"
+#include "mapped_file.hpp"
+#include "mesh_lod.hpp"
+#include "scene_geometry.hpp"
+#include "texture_compression.hpp"
+
+#include <cstdint>
+#include <tiny_gltf.h>
+#include <vector>
+
+// On-disk cache of loaded glTF assets.
+// A cache file holds the parts of the tinygltf::Model used by the viewer
+// (scenes, nodes, meshes, accessors, materials, textures..., animations,
+// skins and cameras, with their extensions and extras) and its levels
+// of detail and scene geometry (quantized vertices, meshlets, buffer layouts,
+// node table), followed by the bytes of every buffer
+// and the decoded (or compressed) pixels of every image, ready to be uploaded. It is memory
+// mapped when read, so a cache hit neither parses JSON nor decodes images nor
+// copies buffers.
+
+// Hash of the content of the glTF file and of every external file it
+// references
+uint64_t computeAssetContentKey(const fs::path &gltfFile);
+
+// Content key of gltfFile, looked up by the path, size and modification time
+// of its files in a stamp file of cacheDirectory. Contents are only hashed
+// when the stamp is new, the stamp file is written then.
+uint64_t computeAssetCacheKey(const fs::path &cacheDirectory, const fs::path &gltfFile);
+
+// The glTF file and the external files it references (buffers and images),
+// those that change the key
+std::vector<fs::path> getAssetDependencies(const fs::path &gltfFile);
+
+fs::path getAssetCachePath(const fs::path &cacheDirectory, uint64_t key);
+
+// Write model, whose bytes are in bufferSpans and imageSpans, to cacheFile.
+// lods and geometry are stored as is, their accessors and buffers must be in
+// model.
+bool writeAssetCache(const fs::path &cacheFile, uint64_t key,
+    const tinygltf::Model &model, const std::vector<BufferSpan> &bufferSpans,
+    const std::vector<BufferSpan> &imageSpans,
+    const std::vector<ImageEncoding> &imageEncodings, const MeshLods &lods,
+    const SceneGeometry &geometry);
+
+// Map cacheFile in file and rebuild model from it. Buffers and images of model
+// are left empty: their bytes are in bufferSpans and imageSpans, pointing in
+// the mapping. Returns false if the file is missing, invalid or for another
+// key.
+bool readAssetCache(const fs::path &cacheFile, uint64_t key, MappedFile &file,
+    tinygltf::Model &model, std::vector<BufferSpan> &bufferSpans,
+    std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, MeshLods &lods,
+    SceneGeometry &geometry);
@@ -0,0 +1,528 @@
+#include "bcn_encoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BCN_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define BCN_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+// Interpolation weights of BC7 4 bits indices, out of 64
+const int BC7_WEIGHTS[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Pixels of a block, channel by channel
+struct Block
+{
+  alignas(16) float c[4][16];
+};
+
+void loadBlock(const unsigned char *rgba, Block &block)
+{
+  for (int i = 0; i < 16; ++i) {
+    for (int k = 0; k < 4; ++k) {
+      block.c[k][i] = rgba[4 * i + k];
+    }
+  }
+}
+
+float clamp255(float value) { return std::min(std::max(value, 0.f), 255.f); }
+
+// out[i] = dot(pixel i - origin, axis) on the first channelCount channels.
+// This is the inner loop of every encoder.
+void projectBlock(const Block &block, int channelCount, const float *origin,
+    const float *axis, float out[16])
+{
+#if BCN_SSE2
+  for (int i = 0; i < 16; i += 4) {
+    auto sum = _mm_setzero_ps();
+    for (int k = 0; k < channelCount; ++k) {
+      const auto d = _mm_sub_ps(_mm_load_ps(block.c[k] + i), _mm_set1_ps(origin[k]));
+      sum = _mm_add_ps(sum, _mm_mul_ps(d, _mm_set1_ps(axis[k])));
+    }
+    _mm_storeu_ps(out + i, sum);
+  }
+#elif BCN_NEON
+  for (int i = 0; i < 16; i += 4) {
+    auto sum = vdupq_n_f32(0.f);
+    for (int k = 0; k < channelCount; ++k) {
+      const auto d = vsubq_f32(vld1q_f32(block.c[k] + i), vdupq_n_f32(origin[k]));
+      sum = vmlaq_n_f32(sum, d, axis[k]);
+    }
+    vst1q_f32(out + i, sum);
+  }
+#else
+  for (int i = 0; i < 16; ++i) {
+    float sum = 0.f;
+    for (int k = 0; k < channelCount; ++k) {
+      sum += (block.c[k][i] - origin[k]) * axis[k];
+    }
+    out[i] = sum;
+  }
+#endif
+}
+
+// Mean and principal axis (unit length, zero for flat blocks) of the first
+// channelCount channels
+void computePrincipalAxis(
+    const Block &block, int channelCount, float mean[4], float axis[4])
+{
+  for (int k = 0; k < 4; ++k) {
+    mean[k] = 0.f;
+    axis[k] = 0.f;
+    for (int i = 0; k < channelCount && i < 16; ++i) {
+      mean[k] += block.c[k][i] / 16.f;
+    }
+  }
+
+  float covariance[4][4] = {};
+  for (int a = 0; a < channelCount; ++a) {
+    for (int b = a; b < channelCount; ++b) {
+      for (int i = 0; i < 16; ++i) {
+        covariance[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+      }
+      covariance[b][a] = covariance[a][b];
+    }
+  }
+
+  // Power iteration, starting from the row of the channel varying the most
+  int start = 0;
+  for (int k = 1; k < channelCount; ++k) {
+    if (covariance[k][k] > covariance[start][start]) {
+      start = k;
+    }
+  }
+  if (covariance[start][start] < 1e-3f) {
+    return;
+  }
+  float v[4];
+  std::copy(covariance[start], covariance[start] + 4, v);
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    float w[4] = {};
+    float maxAbs = 0.f;
+    for (int a = 0; a < channelCount; ++a) {
+      for (int b = 0; b < channelCount; ++b) {
+        w[a] += covariance[a][b] * v[b];
+      }
+      maxAbs = std::max(maxAbs, std::abs(w[a]));
+    }
+    if (maxAbs == 0.f) {
+      return;
+    }
+    for (int k = 0; k < 4; ++k) {
+      v[k] = w[k] / maxAbs;
+    }
+  }
+  float length = 0.f;
+  for (int k = 0; k < channelCount; ++k) {
+    length += v[k] * v[k];
+  }
+  length = std::sqrt(length);
+  for (int k = 0; k < channelCount; ++k) {
+    axis[k] = v[k] / length;
+  }
+}
+
+// Extreme pixels of the block along the principal axis
+void computeEndpoints(
+    const Block &block, int channelCount, float e0[4], float e1[4])
+{
+  float mean[4], axis[4], t[16];
+  computePrincipalAxis(block, channelCount, mean, axis);
+  projectBlock(block, channelCount, mean, axis, t);
+  const auto minMax = std::minmax_element(t, t + 16);
+  for (int k = 0; k < 4; ++k) {
+    e0[k] = clamp255(mean[k] + *minMax.first * axis[k]);
+    e1[k] = clamp255(mean[k] + *minMax.second * axis[k]);
+  }
+}
+
+// Least squares endpoints for the given interpolation weights (of e1).
+// Returns false if the weights can't determine both endpoints.
+bool fitEndpoints(const Block &block, int channelCount,
+    const float weights[16], float e0[4], float e1[4])
+{
+  float aa = 0.f, ab = 0.f, bb = 0.f;
+  float ax[4] = {}, bx[4] = {};
+  for (int i = 0; i < 16; ++i) {
+    const auto b = weights[i];
+    const auto a = 1.f - b;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int k = 0; k < channelCount; ++k) {
+      ax[k] += a * block.c[k][i];
+      bx[k] += b * block.c[k][i];
+    }
+  }
+  const auto det = aa * bb - ab * ab;
+  if (std::abs(det) < 1e-4f) {
+    return false;
+  }
+  for (int k = 0; k < channelCount; ++k) {
+    e0[k] = clamp255((ax[k] * bb - bx[k] * ab) / det);
+    e1[k] = clamp255((bx[k] * aa - ax[k] * ab) / det);
+  }
+  return true;
+}
+
+// BC1
+
+uint16_t packRgb565(const float color[4])
+{
+  const auto r = unsigned(std::lround(color[0] * 31.f / 255.f));
+  const auto g = unsigned(std::lround(color[1] * 63.f / 255.f));
+  const auto b = unsigned(std::lround(color[2] * 31.f / 255.f));
+  return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(uint16_t value, float color[4])
+{
+  const unsigned r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+  color[0] = float((r << 3) | (r >> 2));
+  color[1] = float((g << 2) | (g >> 4));
+  color[2] = float((b << 3) | (b >> 2));
+  color[3] = 255.f;
+}
+
+// Endpoints of 5 or 6 bits whose 2/3, 1/3 interpolation is closest to each
+// 8 bits value, for blocks of a single color
+struct SingleColorTable
+{
+  uint8_t endpoints[256][2];
+
+  explicit SingleColorTable(int bits)
+  {
+    const int size = 1 << bits;
+    for (int value = 0; value < 256; ++value) {
+      int bestError = 256;
+      for (int a = 0; a < size; ++a) {
+        for (int b = 0; b < size; ++b) {
+          const auto expandedA = (a << (8 - bits)) | (a >> (2 * bits - 8));
+          const auto expandedB = (b << (8 - bits)) | (b >> (2 * bits - 8));
+          const auto error = std::abs((2 * expandedA + expandedB) / 3 - value);
+          if (error < bestError) {
+            bestError = error;
+            endpoints[value][0] = uint8_t(a);
+            endpoints[value][1] = uint8_t(b);
+          }
+        }
+      }
+    }
+  }
+};
+
+bool isSingleColor(const Block &block, int channelCount)
+{
+  for (int k = 0; k < channelCount; ++k) {
+    for (int i = 1; i < 16; ++i) {
+      if (block.c[k][i] != block.c[k][0]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Levels (0 is c0, 3 is c1) of the pixels in the 4 colors palette, returns
+// the squared error
+float selectBC1Levels(const Block &block, uint16_t c0, uint16_t c1, int levels[16])
+{
+  float palette[4][4];
+  unpackRgb565(c0, palette[0]);
+  unpackRgb565(c1, palette[3]);
+  float axis[4] = {}, length2 = 0.f;
+  for (int k = 0; k < 3; ++k) {
+    palette[1][k] = (2.f * palette[0][k] + palette[3][k]) / 3.f;
+    palette[2][k] = (palette[0][k] + 2.f * palette[3][k]) / 3.f;
+    axis[k] = palette[3][k] - palette[0][k];
+    length2 += axis[k] * axis[k];
+  }
+
+  float t[16] = {};
+  if (length2 > 0.f) {
+    for (int k = 0; k < 3; ++k) {
+      axis[k] *= 3.f / length2;
+    }
+    projectBlock(block, 3, palette[0], axis, t);
+  }
+
+  float error = 0.f;
+  for (int i = 0; i < 16; ++i) {
+    levels[i] = std::min(std::max(int(std::lround(t[i])), 0), 3);
+    for (int k = 0; k < 3; ++k) {
+      const auto d = block.c[k][i] - palette[levels[i]][k];
+      error += d * d;
+    }
+  }
+  return error;
+}
+
+// Always in 4 colors mode, as required by BC3
+void encodeBC1Color(const Block &block, unsigned char *out)
+{
+  if (isSingleColor(block, 3)) {
+    // Every pixel at level 1 of the palette, between two 565 colors
+    static const SingleColorTable table5(5), table6(6);
+    const auto r = int(block.c[0][0]), g = int(block.c[1][0]), b = int(block.c[2][0]);
+    auto c0 = uint16_t((table5.endpoints[r][0] << 11) |
+                       (table6.endpoints[g][0] << 5) | table5.endpoints[b][0]);
+    auto c1 = uint16_t((table5.endpoints[r][1] << 11) |
+                       (table6.endpoints[g][1] << 5) | table5.endpoints[b][1]);
+    uint32_t bits = 0xaaaaaaaa; // Code 2 for every pixel
+    if (c0 < c1) {
+      std::swap(c0, c1);
+      bits = 0xffffffff; // Level 1 is code 3 once swapped
+    } else if (c0 == c1) {
+      bits = 0;
+    }
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &bits, 4);
+    return;
+  }
+
+  float e0[4], e1[4];
+  computeEndpoints(block, 3, e0, e1);
+  auto c0 = packRgb565(e0), c1 = packRgb565(e1);
+  int levels[16];
+  auto error = selectBC1Levels(block, c0, c1, levels);
+
+  float weights[16];
+  for (int i = 0; i < 16; ++i) {
+    weights[i] = levels[i] / 3.f;
+  }
+  if (error > 0.f && fitEndpoints(block, 3, weights, e0, e1)) {
+    const auto fitted0 = packRgb565(e0), fitted1 = packRgb565(e1);
+    int fittedLevels[16];
+    const auto fittedError = selectBC1Levels(block, fitted0, fitted1, fittedLevels);
+    if (fittedError < error) {
+      c0 = fitted0;
+      c1 = fitted1;
+      std::copy(fittedLevels, fittedLevels + 16, levels);
+    }
+  }
+
+  // 4 colors mode needs c0 > c1, c0 == c1 decodes the same in both modes
+  if (c0 < c1) {
+    std::swap(c0, c1);
+    for (auto &level : levels) {
+      level = 3 - level;
+    }
+  }
+  static const uint32_t levelCodes[4] = {0, 2, 3, 1};
+  uint32_t bits = 0;
+  for (int i = 0; c0 != c1 && i < 16; ++i) {
+    bits |= levelCodes[levels[i]] << (2 * i);
+  }
+  std::memcpy(out, &c0, 2); // Little endian
+  std::memcpy(out + 2, &c1, 2);
+  std::memcpy(out + 4, &bits, 4);
+}
+
+// BC4
+
+void encodeBC4Channel(const Block &block, int channel, unsigned char *out)
+{
+  const auto minMax = std::minmax_element(block.c[channel], block.c[channel] + 16);
+  const auto min = *minMax.first, max = *minMax.second;
+  // r0 > r1 selects the 8 values palette
+  out[0] = (unsigned char)max;
+  out[1] = (unsigned char)min;
+
+  uint64_t bits = 0;
+  if (max > min) {
+    float origin[4] = {}, axis[4] = {}, t[16];
+    origin[channel] = min;
+    axis[channel] = 7.f / (max - min);
+    projectBlock(block, channel + 1, origin, axis, t);
+    for (int i = 0; i < 16; ++i) {
+      // Level 0 is r1 and 7 is r0, codes 2 to 7 go from r0 to r1
+      const auto level = std::min(std::max(int(std::lround(t[i])), 0), 7);
+      const uint64_t code = level == 7 ? 0 : level == 0 ? 1 : 8 - level;
+      bits |= code << (3 * i);
+    }
+  }
+  for (int i = 0; i < 6; ++i) {
+    out[2 + i] = (unsigned char)(bits >> (8 * i));
+  }
+}
+
+// BC7
+
+struct BC7Endpoints
+{
+  int values[2][4]; // 7 bits
+  int pBits[2];
+};
+
+// Quantized endpoints for e0 and e1, with the indices and squared error
+float quantizeBC7(const Block &block, const float e0[4], const float e1[4],
+    BC7Endpoints &endpoints, int indices[16])
+{
+  // Each p-bit is the one quantizing its endpoint best. Trying the 4
+  // combinations is barely better and twice slower.
+  for (int e = 0; e < 2; ++e) {
+    const auto color = e == 0 ? e0 : e1;
+    float errors[2] = {};
+    int values[2][4];
+    for (int p = 0; p < 2; ++p) {
+      for (int k = 0; k < 4; ++k) {
+        values[p][k] = std::min(std::max(int(std::lround((color[k] - p) / 2.f)), 0), 127);
+        const auto d = color[k] - float((values[p][k] << 1) | p);
+        errors[p] += d * d;
+      }
+    }
+    endpoints.pBits[e] = errors[1] < errors[0];
+    std::copy(values[endpoints.pBits[e]], values[endpoints.pBits[e]] + 4, endpoints.values[e]);
+  }
+
+  float palette[16][4];
+  float v0[4], axis[4], length2 = 0.f;
+  for (int k = 0; k < 4; ++k) {
+    const int a = (endpoints.values[0][k] << 1) | endpoints.pBits[0];
+    const int b = (endpoints.values[1][k] << 1) | endpoints.pBits[1];
+    for (int w = 0; w < 16; ++w) {
+      palette[w][k] = float(((64 - BC7_WEIGHTS[w]) * a + BC7_WEIGHTS[w] * b + 32) >> 6);
+    }
+    v0[k] = float(a);
+    axis[k] = float(b - a);
+    length2 += axis[k] * axis[k];
+  }
+
+  float t[16] = {};
+  if (length2 > 0.f) {
+    for (auto &value : axis) {
+      value *= 15.f / length2;
+    }
+    projectBlock(block, 4, v0, axis, t);
+  }
+
+  // Weights are not evenly spaced, check the neighbors of the projection
+  float error = 0.f;
+  for (int i = 0; i < 16; ++i) {
+    const auto guess = std::min(std::max(int(std::lround(t[i])), 0), 15);
+    float pixelError = INFINITY;
+    for (int index = std::max(guess - 1, 0); index <= std::min(guess + 1, 15); ++index) {
+      float e = 0.f;
+      for (int k = 0; k < 4; ++k) {
+        const auto d = block.c[k][i] - palette[index][k];
+        e += d * d;
+      }
+      if (e < pixelError) {
+        pixelError = e;
+        indices[i] = index;
+      }
+    }
+    error += pixelError;
+  }
+  return error;
+}
+
+class BitWriter
+{
+public:
+  void write(uint64_t value, int count)
+  {
+    const auto word = m_offset / 64, shift = m_offset % 64;
+    m_bits[word] |= value << shift;
+    if (shift + count > 64) {
+      m_bits[word + 1] |= value >> (64 - shift);
+    }
+    m_offset += count;
+  }
+
+  void store(unsigned char *out) const { std::memcpy(out, m_bits, 16); }
+
+private:
+  uint64_t m_bits[2] = {};
+  int m_offset = 0;
+};
+
+} // namespace
+
+void encodeBC1Block(const unsigned char *rgba, unsigned char *out)
+{
+  Block block;
+  loadBlock(rgba, block);
+  encodeBC1Color(block, out);
+}
+
+void encodeBC3Block(const unsigned char *rgba, unsigned char *out)
+{
+  Block block;
+  loadBlock(rgba, block);
+  encodeBC4Channel(block, 3, out);
+  encodeBC1Color(block, out + 8);
+}
+
+void encodeBC4Block(const unsigned char *rgba, int channel, unsigned char *out)
+{
+  Block block;
+  loadBlock(rgba, block);
+  encodeBC4Channel(block, channel, out);
+}
+
+void encodeBC5Block(const unsigned char *rgba, unsigned char *out)
+{
+  Block block;
+  loadBlock(rgba, block);
+  encodeBC4Channel(block, 0, out);
+  encodeBC4Channel(block, 1, out + 8);
+}
+
+void encodeBC7Block(const unsigned char *rgba, unsigned char *out)
+{
+  Block block;
+  loadBlock(rgba, block);
+
+  float e0[4], e1[4];
+  computeEndpoints(block, 4, e0, e1);
+  BC7Endpoints endpoints;
+  int indices[16];
+  const auto error = quantizeBC7(block, e0, e1, endpoints, indices);
+
+  float weights[16];
+  for (int i = 0; i < 16; ++i) {
+    weights[i] = BC7_WEIGHTS[indices[i]] / 64.f;
+  }
+  if (error > 0.f && fitEndpoints(block, 4, weights, e0, e1)) {
+    BC7Endpoints fitted;
+    int fittedIndices[16];
+    if (quantizeBC7(block, e0, e1, fitted, fittedIndices) < error) {
+      endpoints = fitted;
+      std::copy(fittedIndices, fittedIndices + 16, indices);
+    }
+  }
+
+  // The highest bit of the first index is implicitly 0
+  if (indices[0] & 8) {
+    std::swap(endpoints.values[0], endpoints.values[1]);
+    std::swap(endpoints.pBits[0], endpoints.pBits[1]);
+    for (auto &index : indices) {
+      index = 15 - index;
+    }
+  }
+
+  BitWriter bits;
+  bits.write(1 << 6, 7); // Mode 6
+  for (int k = 0; k < 4; ++k) {
+    bits.write(endpoints.values[0][k], 7);
+    bits.write(endpoints.values[1][k], 7);
+  }
+  bits.write(endpoints.pBits[0], 1);
+  bits.write(endpoints.pBits[1], 1);
+  bits.write(indices[0], 3);
+  for (int i = 1; i < 16; ++i) {
+    bits.write(indices[i], 4);
+  }
+  bits.store(out);
+}
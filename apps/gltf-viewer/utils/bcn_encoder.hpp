@@ -0,0 +1,29 @@
+#pragma once
+
+// Block encoders of the BCn texture formats (S3TC, RGTC and BPTC).
+// A block is 4x4 RGBA8 pixels, row by row, 64 bytes. Encoders favor speed over
+// quality: endpoints come from the principal axis of the block, refined once
+// by least squares, and indices from the projection on the endpoints segment.
+
+// Bytes written by each encoder
+const int BC1_BLOCK_SIZE = 8;
+const int BC3_BLOCK_SIZE = 16;
+const int BC4_BLOCK_SIZE = 8;
+const int BC5_BLOCK_SIZE = 16;
+const int BC7_BLOCK_SIZE = 16;
+
+// RGB, alpha is ignored
+void encodeBC1Block(const unsigned char *rgba, unsigned char *out);
+
+// RGB as BC1 and alpha as BC4
+void encodeBC3Block(const unsigned char *rgba, unsigned char *out);
+
+// One channel (0 to 3) of rgba
+void encodeBC4Block(const unsigned char *rgba, int channel, unsigned char *out);
+
+// Red and green
+void encodeBC5Block(const unsigned char *rgba, unsigned char *out);
+
+// RGBA with mode 6 only (one subset, 7 bits endpoints with p-bits, 4 bits
+// indices)
+void encodeBC7Block(const unsigned char *rgba, unsigned char *out);
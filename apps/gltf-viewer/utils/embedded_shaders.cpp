@@ -0,0 +1,46 @@
+#include "embedded_shaders.hpp"
+
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+bool embeddedShadersEnabled = true;
+
+// By name, built on first use
+const std::unordered_map<std::string, const EmbeddedShader *> &getEmbeddedShaderIndex()
+{
+  static const auto index = [] {
+    std::unordered_map<std::string, const EmbeddedShader *> index;
+    for (size_t i = 0; i < EMBEDDED_SHADER_COUNT; ++i) {
+      index.emplace(EMBEDDED_SHADERS[i].name, &EMBEDDED_SHADERS[i]);
+    }
+    return index;
+  }();
+  return index;
+}
+} // namespace
+
+const EmbeddedShader *findEmbeddedShader(const fs::path &filepath)
+{
+  if (!embeddedShadersEnabled) {
+    return nullptr;
+  }
+  // Shortest end of the path first: the file name, then with its directory...
+  const auto &index = getEmbeddedShaderIndex();
+  std::string name;
+  for (auto it = filepath.end(); it != filepath.begin();) {
+    --it;
+    name = name.empty() ? it->string() : it->string() + "/" + name;
+    const auto found = index.find(name);
+    if (found != end(index)) {
+      return found->second;
+    }
+  }
+  return nullptr;
+}
+
+void setEmbeddedShadersEnabled(bool enabled)
+{
+  embeddedShadersEnabled = enabled;
+}
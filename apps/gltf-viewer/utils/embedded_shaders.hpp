@@ -0,0 +1,28 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// GLSL sources compiled into the executable by c2ba_embed_shader_directory
+// (cmake/c2ba-glsl-shaders.cmake), loading shaders does not touch the disk
+struct EmbeddedShader
+{
+  const char *name; // Relative to the shader directory
+  const char *source;
+  size_t size;
+  uint64_t hash; // Of the file and those it includes, computed at build time
+};
+
+// Defined by the generated source file
+extern const EmbeddedShader EMBEDDED_SHADERS[];
+extern const size_t EMBEDDED_SHADER_COUNT;
+
+// The embedded copy of a shader of the shader directory, by the end of its
+// path. nullptr if there is none or if shaders are read from disk.
+const EmbeddedShader *findEmbeddedShader(const fs::path &filepath);
+
+// For development: read shaders from disk instead, to edit them without
+// building again
+void setEmbeddedShadersEnabled(bool enabled);
@@ -0,0 +1,102 @@
+#include "file_watcher.hpp"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <system_error>
+#endif
+
+#ifdef __linux__
+
+FileWatcher::~FileWatcher()
+{
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+void FileWatcher::watch(const std::vector<fs::path> &files)
+{
+  // Closing drops the previous watches
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+  m_files.clear();
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0) {
+    return;
+  }
+  for (const auto &path : files) {
+    // The same directory gets the same watch descriptor. Writes are seen
+    // from the first one (IN_MODIFY, also sent by O_TRUNC and truncate) so
+    // that mapped files are no longer read while they change. IN_OPEN is
+    // left out, our own reads would trigger it.
+    const auto directory = path.has_parent_path() ? path.parent_path() : fs::path(".");
+    const auto wd = inotify_add_watch(m_fd, directory.string().c_str(),
+        IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd >= 0) {
+      m_files.push_back({path, wd});
+    }
+  }
+}
+
+std::vector<fs::path> FileWatcher::poll()
+{
+  std::vector<fs::path> changed;
+  if (m_fd < 0) {
+    return changed;
+  }
+  alignas(inotify_event) char buffer[4096];
+  for (;;) {
+    const auto length = ::read(m_fd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break; // EAGAIN, nothing left
+    }
+    for (ssize_t offset = 0; offset < length;) {
+      const auto event = reinterpret_cast<const inotify_event *>(buffer + offset);
+      offset += sizeof(inotify_event) + event->len;
+      if (!event->len) {
+        continue;
+      }
+      for (const auto &file : m_files) {
+        if (file.directory == event->wd && file.path.filename() == event->name &&
+            std::find(begin(changed), end(changed), file.path) == end(changed)) {
+          changed.push_back(file.path);
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+#else
+
+FileWatcher::~FileWatcher() = default;
+
+void FileWatcher::watch(const std::vector<fs::path> &files)
+{
+  m_files.clear();
+  for (const auto &path : files) {
+    std::error_code error;
+    m_files.push_back({path, fs::last_write_time(path, error)});
+  }
+}
+
+std::vector<fs::path> FileWatcher::poll()
+{
+  std::vector<fs::path> changed;
+  for (auto &file : m_files) {
+    std::error_code error;
+    const auto writeTime = fs::last_write_time(file.path, error);
+    if (!error && writeTime != file.writeTime) {
+      file.writeTime = writeTime;
+      changed.push_back(file.path);
+    }
+  }
+  return changed;
+}
+
+#endif
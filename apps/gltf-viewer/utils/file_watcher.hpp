@@ -0,0 +1,45 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <vector>
+
+// Tells which of a set of files were written since the last poll. A file
+// is reported from its first write on (not only once closed), so that
+// callers stop reading it while it changes.
+// On Linux, inotify watches their directories, so that files replaced by a
+// rename (as most editors and exporters save) are seen too. Elsewhere, their
+// modification times are compared at each poll.
+class FileWatcher
+{
+public:
+  FileWatcher() = default;
+
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher &) = delete;
+
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  // Replace the watched files
+  void watch(const std::vector<fs::path> &files);
+
+  // Files written since the last call, as given to watch(). Never blocks.
+  std::vector<fs::path> poll();
+
+private:
+  struct File
+  {
+    fs::path path;
+#ifdef __linux__
+    int directory; // Watch descriptor of its directory
+#else
+    decltype(fs::last_write_time(fs::path())) writeTime;
+#endif
+  };
+
+  std::vector<File> m_files;
+#ifdef __linux__
+  int m_fd = -1;
+#endif
+};
@@ -0,0 +1,183 @@
+#include "glb.hpp"
+
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+// https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#glb-file-format-specification
+const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942; // "BIN\0"
+const size_t GLB_HEADER_SIZE = 12;
+const size_t GLB_CHUNK_HEADER_SIZE = 8;
+
+uint32_t readU32(const unsigned char *bytes)
+{
+  uint32_t value;
+  std::memcpy(&value, bytes, sizeof(value)); // glb is little endian, like us
+  return value;
+}
+
+void writeU32(std::vector<unsigned char> &out, uint32_t value)
+{
+  const auto bytes = reinterpret_cast<const unsigned char *>(&value);
+  out.insert(end(out), bytes, bytes + sizeof(value));
+}
+
+} // namespace
+
+bool loadGlbFile(tinygltf::TinyGLTF &loader, tinygltf::Model &model,
+    std::string &err, std::string &warn, const fs::path &path,
+    MappedFile &file, std::vector<BufferSpan> &bufferSpans,
+    const GltfJsonPatch &patch)
+{
+  if (!file.open(path)) {
+    err = "Unable to map file " + path.string();
+    return false;
+  }
+
+  const auto bytes = file.data();
+  const auto size = file.size();
+  if (size < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE ||
+      readU32(bytes) != GLB_MAGIC || readU32(bytes + 4) != 2 ||
+      readU32(bytes + 8) > size) {
+    err = "Invalid glTF binary header.";
+    return false;
+  }
+  const size_t length = readU32(bytes + 8);
+
+  // Locate the JSON and BIN chunks
+  BufferSpan jsonChunk, binChunk;
+  for (size_t offset = GLB_HEADER_SIZE;
+       offset + GLB_CHUNK_HEADER_SIZE <= length;) {
+    const size_t chunkLength = readU32(bytes + offset);
+    const auto chunkType = readU32(bytes + offset + 4);
+    const auto chunkData = bytes + offset + GLB_CHUNK_HEADER_SIZE;
+    if (offset + GLB_CHUNK_HEADER_SIZE + chunkLength > length) {
+      err = "Invalid glTF binary chunk length.";
+      return false;
+    }
+    if (chunkType == GLB_CHUNK_JSON && !jsonChunk.data) {
+      jsonChunk = {chunkData, chunkLength};
+    } else if (chunkType == GLB_CHUNK_BIN && !binChunk.data) {
+      binChunk = {chunkData, chunkLength};
+    }
+    offset += GLB_CHUNK_HEADER_SIZE + chunkLength;
+  }
+  if (!jsonChunk.data) {
+    err = "Missing JSON chunk in glTF binary.";
+    return false;
+  }
+
+  auto json = nlohmann::json::parse(jsonChunk.data,
+      jsonChunk.data + jsonChunk.size, nullptr, false);
+  if (json.is_discarded()) {
+    err = "Unable to parse JSON chunk of glTF binary.";
+    return false;
+  }
+
+  // The buffer stored in the BIN chunk is the first one, without uri. We shrink
+  // it to a single byte so that tinygltf does not copy it, and keep the real
+  // bytes in the mapped file.
+  const int binBufferIdx =
+      binChunk.data && json.count("buffers") && !json["buffers"].empty() &&
+              !json["buffers"][0].count("uri")
+          ? 0
+          : -1;
+  size_t binBufferLength = 0;
+  std::vector<std::pair<int, nlohmann::json>> binImages;
+  VirtualFileSystem vfs;
+  const auto baseDir = path.parent_path().string();
+
+  if (patch) {
+    patch(json, vfs, baseDir);
+  }
+
+  if (binBufferIdx >= 0) {
+    binBufferLength = json["buffers"][0].value("byteLength", size_t(0));
+    if (binBufferLength > binChunk.size) {
+      err = "Invalid byteLength for the buffer stored in the BIN chunk.";
+      return false;
+    }
+    json["buffers"][0]["byteLength"] = 1;
+
+    // Images stored in the BIN chunk are turned into virtual external files,
+    // read from the mapping when tinygltf asks for them.
+    if (json.count("images")) {
+      auto &images = json["images"];
+      for (size_t i = 0; i < images.size(); ++i) {
+        auto &image = images[i];
+        if (!image.count("bufferView")) {
+          continue;
+        }
+        const auto &bufferView = json["bufferViews"][image["bufferView"].get<size_t>()];
+        if (bufferView.value("buffer", -1) != binBufferIdx) {
+          continue;
+        }
+        const auto byteOffset = bufferView.value("byteOffset", size_t(0));
+        const auto byteLength = bufferView.value("byteLength", size_t(0));
+        if (byteOffset + byteLength > binBufferLength) {
+          err = "Image bufferView out of the BIN chunk.";
+          return false;
+        }
+        const auto name = "__glb_bin_image_" + std::to_string(i);
+        vfs.addFile(VirtualFileSystem::joinPath(baseDir, name),
+            {binChunk.data + byteOffset, byteLength});
+        binImages.emplace_back(int(i), image);
+        image.erase("bufferView");
+        image["uri"] = name;
+      }
+    }
+  }
+
+  // Small in-memory glb with the patched JSON and a one byte BIN chunk
+  auto patchedJson = json.dump();
+  patchedJson.resize((patchedJson.size() + 3) & ~size_t(3), ' ');
+  const uint32_t binStubLength = binBufferIdx >= 0 ? 4 : 0;
+  std::vector<unsigned char> glbStub;
+  glbStub.reserve(GLB_HEADER_SIZE + 2 * GLB_CHUNK_HEADER_SIZE +
+                  patchedJson.size() + binStubLength);
+  writeU32(glbStub, GLB_MAGIC);
+  writeU32(glbStub, 2);
+  writeU32(glbStub, uint32_t(GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE +
+                             patchedJson.size() +
+                             (binStubLength ? GLB_CHUNK_HEADER_SIZE : 0) +
+                             binStubLength));
+  writeU32(glbStub, uint32_t(patchedJson.size()));
+  writeU32(glbStub, GLB_CHUNK_JSON);
+  glbStub.insert(end(glbStub), begin(patchedJson), end(patchedJson));
+  if (binStubLength) {
+    writeU32(glbStub, binStubLength);
+    writeU32(glbStub, GLB_CHUNK_BIN);
+    glbStub.resize(glbStub.size() + binStubLength, 0);
+  }
+
+  vfs.install(loader);
+  const bool ret = loader.LoadBinaryFromMemory(&model, &err, &warn,
+      glbStub.data(), unsigned(glbStub.size()), baseDir);
+  VirtualFileSystem::uninstall(loader);
+  if (!ret) {
+    return false;
+  }
+
+  // Put back what we changed, except for the bytes of the BIN buffer
+  for (const auto &binImage : binImages) {
+    auto &image = model.images[binImage.first];
+    image.uri.clear();
+    image.bufferView = binImage.second["bufferView"].get<int>();
+    image.mimeType = binImage.second.value("mimeType", std::string());
+  }
+
+  bufferSpans = getBufferSpans(model);
+  if (binBufferIdx >= 0) {
+    model.buffers[binBufferIdx].data.clear();
+    model.buffers[binBufferIdx].data.shrink_to_fit();
+    bufferSpans[binBufferIdx] = {binChunk.data, binBufferLength};
+  }
+
+  std::clog << "Mapped " << binBufferLength << " bytes of glb binary chunk"
+            << std::endl;
+
+  return true;
+}
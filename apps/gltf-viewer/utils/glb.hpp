@@ -0,0 +1,21 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gltf.hpp"
+#include "gltf_json.hpp"
+#include "mapped_file.hpp"
+
+#include <string>
+#include <tiny_gltf.h>
+#include <vector>
+
+// Load a binary glTF (.glb) file without copying its BIN chunk.
+// The file is memory mapped in `file` and the buffer stored in the BIN chunk is
+// left empty in `model`: its bytes are only reachable through
+// `bufferSpans[i]`, which points in the mapping. `file` must outlive any use
+// of the spans. Images embedded in the BIN chunk are decoded as usual.
+// patch, if any, is applied on the JSON chunk before parsing.
+bool loadGlbFile(tinygltf::TinyGLTF &loader, tinygltf::Model &model,
+    std::string &err, std::string &warn, const fs::path &path,
+    MappedFile &file, std::vector<BufferSpan> &bufferSpans,
+    const GltfJsonPatch &patch = nullptr);
@@ -3,8 +3,94 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <cstring>
 #include <iostream>
 
+std::vector<BufferSpan> getBufferSpans(const tinygltf::Model &model)
+{
+  std::vector<BufferSpan> spans(model.buffers.size());
+  for (size_t i = 0; i < model.buffers.size(); ++i) {
+    spans[i].data = model.buffers[i].data.data();
+    spans[i].size = model.buffers[i].data.size();
+  }
+  return spans;
+}
+
+std::vector<BufferSpan> getImageSpans(const tinygltf::Model &model)
+{
+  std::vector<BufferSpan> spans(model.images.size());
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    spans[i].data = model.images[i].image.data();
+    spans[i].size = model.images[i].image.size();
+  }
+  return spans;
+}
+
+std::vector<uint32_t> readIndices(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, const tinygltf::Accessor &accessor)
+{
+  if (accessor.bufferView < 0 ||
+      size_t(accessor.bufferView) >= model.bufferViews.size()) {
+    return {};
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  if (bufferView.buffer < 0 || size_t(bufferView.buffer) >= buffers.size()) {
+    return {};
+  }
+  const auto &buffer = buffers[bufferView.buffer];
+  const auto componentSize =
+      size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType));
+  const auto offset = bufferView.byteOffset + accessor.byteOffset;
+  if (componentSize != 1 && componentSize != 2 && componentSize != 4) {
+    return {};
+  }
+  if (offset + accessor.count * componentSize > buffer.size ||
+      accessor.byteOffset + accessor.count * componentSize > bufferView.byteLength) {
+    return {};
+  }
+
+  std::vector<uint32_t> indices(accessor.count);
+  const auto data = buffer.data + offset;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (componentSize == 1) {
+      indices[i] = data[i];
+    } else if (componentSize == 2) {
+      uint16_t index;
+      std::memcpy(&index, data + 2 * i, 2);
+      indices[i] = index;
+    } else {
+      std::memcpy(&indices[i], data + 4 * i, 4);
+    }
+  }
+  return indices;
+}
+
+tinygltf::Accessor appendIndices(std::vector<unsigned char> &data,
+    const std::vector<uint32_t> &indices, size_t vertexCount)
+{
+  tinygltf::Accessor accessor;
+  accessor.type = TINYGLTF_TYPE_SCALAR;
+  accessor.count = indices.size();
+  accessor.byteOffset = data.size();
+  if (vertexCount <= 0x10000) {
+    accessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+    data.resize(data.size() + indices.size() * sizeof(uint16_t));
+    auto out = data.data() + accessor.byteOffset;
+    for (const auto index : indices) {
+      const auto narrow = uint16_t(index);
+      std::memcpy(out, &narrow, sizeof(narrow));
+      out += sizeof(narrow);
+    }
+  } else {
+    accessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+    data.resize(data.size() + indices.size() * sizeof(uint32_t));
+    std::memcpy(data.data() + accessor.byteOffset, indices.data(),
+        indices.size() * sizeof(uint32_t));
+  }
+  data.resize((data.size() + 3) & ~size_t(3)); // Keep the next one aligned
+  return accessor;
+}
+
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix)
 {
@@ -35,8 +121,9 @@ glm::mat4 getLocalToWorldMatrix(
                                                  node.scale[1], node.scale[2]));
 };
 
-void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+void computeSceneBounds(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax)
 {
   // Compute scene bounding box
   // todo refactor with scene drawing
@@ -69,8 +156,7 @@ void computeSceneBounds(
                   model.bufferViews[positionAccessor.bufferView];
               const auto byteOffset =
                   positionAccessor.byteOffset + positionBufferView.byteOffset;
-              const auto &positionBuffer =
-                  model.buffers[positionBufferView.buffer];
+              const auto &positionBuffer = buffers[positionBufferView.buffer];
               const auto positionByteStride =
                   positionBufferView.byteStride ? positionBufferView.byteStride
                                                 : 3 * sizeof(float);
@@ -81,7 +167,7 @@ void computeSceneBounds(
                     model.bufferViews[indexAccessor.bufferView];
                 const auto indexByteOffset =
                     indexAccessor.byteOffset + indexBufferView.byteOffset;
-                const auto &indexBuffer = model.buffers[indexBufferView.buffer];
+                const auto &indexBuffer = buffers[indexBufferView.buffer];
                 auto indexByteStride = indexBufferView.byteStride;
 
                 switch (indexAccessor.componentType) {
@@ -3,8 +3,37 @@
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 
+#include <cstdint>
+#include <vector>
+
+// Read-only view on the bytes of a tinygltf::Buffer. For .glb files the binary
+// chunk is not copied in Buffer::data, the span points in the mapped file.
+struct BufferSpan
+{
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+};
+
+// One span per model.buffers[i], pointing to model.buffers[i].data
+std::vector<BufferSpan> getBufferSpans(const tinygltf::Model &model);
+
+// One span per model.images[i], pointing to the decoded pixels
+// model.images[i].image
+std::vector<BufferSpan> getImageSpans(const tinygltf::Model &model);
+
+// Values of an index accessor, empty if they are not in the buffers
+std::vector<uint32_t> readIndices(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, const tinygltf::Accessor &accessor);
+
+// Append indices to data, narrowed to 16 bits when vertexCount allows it,
+// and return their accessor (byteOffset in data, no bufferView yet). data is
+// padded so that the next indices stay aligned.
+tinygltf::Accessor appendIndices(std::vector<unsigned char> &data,
+    const std::vector<uint32_t> &indices, size_t vertexCount);
+
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix);
 
-void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
\ No newline at end of file
+void computeSceneBounds(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax);
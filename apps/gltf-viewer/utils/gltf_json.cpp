@@ -0,0 +1,38 @@
+#include "gltf_json.hpp"
+
+#include "mapped_file.hpp"
+
+bool loadGltfTextFile(tinygltf::TinyGLTF &loader, tinygltf::Model &model,
+    std::string &err, std::string &warn, const fs::path &path,
+    const GltfJsonPatch &patch)
+{
+  if (!patch) {
+    return loader.LoadASCIIFromFile(&model, &err, &warn, path.string());
+  }
+
+  nlohmann::json json;
+  {
+    MappedFile file;
+    if (!file.open(path)) {
+      err = "Unable to map file " + path.string();
+      return false;
+    }
+    json = nlohmann::json::parse(
+        file.data(), file.data() + file.size(), nullptr, false);
+  }
+  if (json.is_discarded()) {
+    err = "Unable to parse JSON of " + path.string();
+    return false;
+  }
+
+  VirtualFileSystem vfs;
+  const auto baseDir = path.parent_path().string();
+  patch(json, vfs, baseDir);
+
+  const auto patchedJson = json.dump();
+  vfs.install(loader);
+  const bool ret = loader.LoadASCIIFromString(&model, &err, &warn,
+      patchedJson.data(), unsigned(patchedJson.size()), baseDir);
+  VirtualFileSystem::uninstall(loader);
+  return ret;
+}
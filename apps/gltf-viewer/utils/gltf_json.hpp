@@ -0,0 +1,20 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "virtual_fs.hpp"
+
+#include <functional>
+#include <json.hpp>
+#include <string>
+#include <tiny_gltf.h>
+
+// Hook on the JSON document of a glTF file, called before tinygltf parses it.
+// It may edit the document and serve files from memory with vfs; baseDir is
+// the directory tinygltf resolves uris against.
+using GltfJsonPatch = std::function<void(
+    nlohmann::json &gltf, VirtualFileSystem &vfs, const std::string &baseDir)>;
+
+// Same as loader.LoadASCIIFromFile, with patch applied on the JSON first
+bool loadGltfTextFile(tinygltf::TinyGLTF &loader, tinygltf::Model &model,
+    std::string &err, std::string &warn, const fs::path &path,
+    const GltfJsonPatch &patch = nullptr);
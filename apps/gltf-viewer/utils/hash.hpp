@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Fast non cryptographic 64-bit hash, consuming 8 bytes per step.
+// Good enough to key caches on file contents, not for anything security
+// related.
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0)
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ull;
+  const int r = 47;
+  const auto bytes = static_cast<const unsigned char *>(data);
+
+  uint64_t h = seed ^ (size * m);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t k;
+    std::memcpy(&k, bytes + i, 8);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  if (i < size) {
+    uint64_t k = 0;
+    std::memcpy(&k, bytes + i, size - i);
+    h ^= k;
+    h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+inline uint64_t hashString(const std::string &str, uint64_t seed = 0)
+{
+  return hashBytes(str.data(), str.size(), seed);
+}
+
+inline std::string hashToHex(uint64_t hash)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(16, '0');
+  for (int i = 15; i >= 0; --i, hash >>= 4) {
+    hex[i] = digits[hash & 0xf];
+  }
+  return hex;
+}
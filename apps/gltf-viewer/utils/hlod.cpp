@@ -0,0 +1,713 @@
+#include "hlod.hpp"
+#include "mesh_lod.hpp"
+#include "mipmaps.hpp"
+#include "vertex_quantizer.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <string>
+
+namespace
+{
+// Proxies are simplified down to that many triangles, unless their error
+// gets over HLOD_MAX_ERROR (relative to the radius of the subtree). Their
+// error decides from how far they are drawn, so it can be large.
+const size_t HLOD_TARGET_TRIANGLES = 1024;
+const float HLOD_MAX_ERROR = 0.05f;
+// Proxies with more than that part of the triangles of their subtree would
+// not save enough to be worth their memory, they are dropped
+const float HLOD_MAX_TRIANGLE_RATIO = 0.25f;
+// Meshes smaller than that, relative to the subtree, are left out
+const float HLOD_MIN_SIZE = 0.005f;
+// Texels of the side of a material tile in the atlas, smaller if the atlas
+// would get bigger than MAX_ATLAS_SIZE
+const int MAX_TILE_SIZE = 64;
+const int MAX_ATLAS_SIZE = 4096;
+
+struct Box
+{
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+  bool empty() const { return min.x > max.x; }
+
+  void add(const glm::vec3 &p)
+  {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  Box transformed(const glm::mat4 &matrix) const
+  {
+    Box box;
+    for (int corner = 0; corner < 8; ++corner) {
+      const glm::vec3 p(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y,
+          corner & 4 ? max.z : min.z);
+      box.add(glm::vec3(matrix * glm::vec4(p, 1)));
+    }
+    return box;
+  }
+
+  float radius() const { return 0.5f * glm::length(max - min); }
+};
+
+// Mesh node of a subtree, with its matrix relative to the root of the subtree
+struct Instance
+{
+  int mesh;
+  glm::mat4 matrix;
+};
+
+// Proxy of a subtree below the node of another one, with its matrix relative
+// to that node
+struct ChildProxy
+{
+  size_t subtree;
+  glm::mat4 matrix;
+};
+
+// Proxies are built from the proxies of the subtrees below, and the mesh
+// nodes that are not under one
+struct Subtree
+{
+  int node;
+  std::vector<Instance> instances;
+  std::vector<ChildProxy> children;
+  Box box; // In the space of the node
+  size_t level = 0; // 1 + the highest level of its children, 0 without
+  float droppedError = 0.f; // Of the meshes left out
+};
+
+struct ProxyMesh
+{
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> texCoords;
+  std::vector<uint32_t> indices;
+  float error = 0.f;
+  float radius = 0.f; // Of the box of its vertices before simplification
+  size_t sourceTriangleCount = 0; // Of the meshes of its subtree
+  // Material factors, weighted by triangle count
+  double metallic = 0., roughness = 0., weight = 0.;
+  bool doubleSided = false;
+};
+
+bool isOpaque(const tinygltf::Model &model, int materialIdx)
+{
+  return materialIdx < 0 || size_t(materialIdx) >= model.materials.size() ||
+         model.materials[materialIdx].alphaMode.empty() ||
+         model.materials[materialIdx].alphaMode == "OPAQUE";
+}
+
+// Image sampled for the base color of a material, -1 if it can't be read
+// here (compressed, missing)
+int getBaseColorImage(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &imageSpans,
+    const std::vector<ImageEncoding> &imageEncodings, int materialIdx)
+{
+  if (materialIdx < 0) {
+    return -1;
+  }
+  const auto textureIdx = model.materials[materialIdx].pbrMetallicRoughness.baseColorTexture.index;
+  if (textureIdx < 0 || size_t(textureIdx) >= model.textures.size()) {
+    return -1;
+  }
+  const auto imageIdx = model.textures[textureIdx].source;
+  if (imageIdx < 0 || size_t(imageIdx) >= model.images.size()) {
+    return -1;
+  }
+  const auto &image = model.images[imageIdx];
+  if (imageEncodings[imageIdx].format != TextureFormat::Raw ||
+      (image.bits != 8 && image.bits != 16) || image.component < 1 ||
+      image.width <= 0 || image.height <= 0 ||
+      imageSpans[imageIdx].size < size_t(image.width) * image.height *
+                                      image.component * (image.bits / 8)) {
+    return -1;
+  }
+  return imageIdx;
+}
+
+// Average the base color of a material, texture times factor, in a tile of
+// tileSize x tileSize RGB texels
+void bakeTile(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &imageSpans,
+    const std::vector<ImageEncoding> &imageEncodings, int materialIdx,
+    unsigned char *tile, size_t rowPitch, int tileSize)
+{
+  static const auto toLinear = []() {
+    std::array<float, 256> table;
+    for (size_t i = 0; i < table.size(); ++i) {
+      table[i] = srgbToLinear(i / 255.f);
+    }
+    return table;
+  }();
+
+  glm::vec3 factor(1.f);
+  if (materialIdx >= 0) {
+    const auto &baseColorFactor = model.materials[materialIdx].pbrMetallicRoughness.baseColorFactor;
+    for (size_t c = 0; c < 3 && c < baseColorFactor.size(); ++c) {
+      factor[c] = float(baseColorFactor[c]);
+    }
+  }
+  const auto store = [&](int x, int y, const glm::vec3 &color) {
+    for (int c = 0; c < 3; ++c) {
+      tile[y * rowPitch + 3 * x + c] = uint8_t(std::round(
+          255.f * linearToSrgb(glm::clamp(color[c] * factor[c], 0.f, 1.f))));
+    }
+  };
+
+  const auto imageIdx = getBaseColorImage(model, imageSpans, imageEncodings, materialIdx);
+  if (imageIdx < 0) {
+    for (int y = 0; y < tileSize; ++y) {
+      for (int x = 0; x < tileSize; ++x) {
+        store(x, y, glm::vec3(1.f));
+      }
+    }
+    return;
+  }
+
+  const auto &image = model.images[imageIdx];
+  const auto &swizzle = imageEncodings[imageIdx].swizzle;
+  const auto pixels = imageSpans[imageIdx].data;
+  const auto readLinear = [&](size_t texel, int channel) {
+    const auto stored = swizzle[channel];
+    if (stored == SWIZZLE_ZERO || stored == SWIZZLE_ONE) {
+      return stored == SWIZZLE_ONE ? 1.f : 0.f;
+    }
+    const auto offset = texel * image.component + stored;
+    if (image.bits == 16) {
+      uint16_t value;
+      std::memcpy(&value, pixels + 2 * offset, sizeof(value));
+      return srgbToLinear(value / 65535.f);
+    }
+    return toLinear[pixels[offset]];
+  };
+
+  // Box filter over the texels covered by each tile texel
+  for (int y = 0; y < tileSize; ++y) {
+    const auto y0 = size_t(y) * image.height / tileSize;
+    const auto y1 = std::max(y0 + 1, size_t(y + 1) * image.height / tileSize);
+    for (int x = 0; x < tileSize; ++x) {
+      const auto x0 = size_t(x) * image.width / tileSize;
+      const auto x1 = std::max(x0 + 1, size_t(x + 1) * image.width / tileSize);
+      glm::vec3 sum(0.f);
+      for (auto sy = y0; sy < y1; ++sy) {
+        for (auto sx = x0; sx < x1; ++sx) {
+          const auto texel = sy * image.width + sx;
+          for (int c = 0; c < 3; ++c) {
+            sum[c] += readLinear(texel, c);
+          }
+        }
+      }
+      store(x, y, sum / float((x1 - x0) * (y1 - y0)));
+    }
+  }
+}
+
+// Merge the triangles of the proxies of the children of the subtree (already
+// built) and of its other meshes, with texture coordinates in the tiles of
+// their materials, and simplify them
+ProxyMesh buildProxyMesh(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &bufferSpans, const Subtree &subtree,
+    const std::vector<ProxyMesh> &proxyMeshes, const std::map<int, int> &tiles,
+    int tileSize, int atlasColumns, int atlasWidth, int atlasHeight)
+{
+  ProxyMesh proxy;
+  float childError = 0.f; // In the units of the node
+  for (const auto &child : subtree.children) {
+    const auto &childMesh = proxyMeshes[child.subtree];
+    const auto normalMatrix = glm::inverseTranspose(glm::mat3(child.matrix));
+    const auto mirrored = glm::determinant(glm::mat3(child.matrix)) < 0.f;
+    const auto base = uint32_t(proxy.positions.size());
+    for (size_t i = 0; i < childMesh.positions.size(); ++i) {
+      proxy.positions.push_back(glm::vec3(child.matrix * glm::vec4(childMesh.positions[i], 1)));
+      const auto n = normalMatrix * childMesh.normals[i];
+      const auto length = glm::length(n);
+      proxy.normals.push_back(length > 0.f ? n / length : glm::vec3(0.f));
+    }
+    // Already in the atlas
+    proxy.texCoords.insert(end(proxy.texCoords), begin(childMesh.texCoords), end(childMesh.texCoords));
+    for (size_t i = 0; i < childMesh.indices.size(); i += 3) {
+      proxy.indices.push_back(base + childMesh.indices[i]);
+      proxy.indices.push_back(base + childMesh.indices[mirrored ? i + 2 : i + 1]);
+      proxy.indices.push_back(base + childMesh.indices[mirrored ? i + 1 : i + 2]);
+    }
+    const auto scale = std::max({glm::length(glm::vec3(child.matrix[0])),
+        glm::length(glm::vec3(child.matrix[1])), glm::length(glm::vec3(child.matrix[2]))});
+    childError = std::max(childError, childMesh.error * childMesh.radius * scale);
+    proxy.sourceTriangleCount += childMesh.sourceTriangleCount;
+    proxy.metallic += childMesh.metallic;
+    proxy.roughness += childMesh.roughness;
+    proxy.weight += childMesh.weight;
+    proxy.doubleSided |= childMesh.doubleSided;
+  }
+  for (const auto &instance : subtree.instances) {
+    const auto normalMatrix = glm::inverseTranspose(glm::mat3(instance.matrix));
+    const auto mirrored = glm::determinant(glm::mat3(instance.matrix)) < 0.f;
+    for (const auto &primitive : model.meshes[instance.mesh].primitives) {
+      if (primitive.mode != TINYGLTF_MODE_TRIANGLES) {
+        continue; // Points and lines don't show at a distance
+      }
+      const auto positions = readPositions(model, bufferSpans, primitive);
+      if (positions.empty()) {
+        continue;
+      }
+      std::vector<uint32_t> indices;
+      if (primitive.indices >= 0 && size_t(primitive.indices) < model.accessors.size()) {
+        indices = readIndices(model, bufferSpans, model.accessors[primitive.indices]);
+      } else {
+        indices.resize(positions.size());
+        std::iota(begin(indices), end(indices), 0);
+      }
+      indices.resize(indices.size() / 3 * 3);
+      if (indices.empty() ||
+          *std::max_element(begin(indices), end(indices)) >= positions.size()) {
+        continue;
+      }
+
+      const auto normals = readAttribute(model, bufferSpans, primitive, "NORMAL");
+      auto texCoordSet = 0;
+      if (primitive.material >= 0 && size_t(primitive.material) < model.materials.size()) {
+        const auto &material = model.materials[primitive.material];
+        texCoordSet = material.pbrMetallicRoughness.baseColorTexture.texCoord;
+        proxy.metallic += indices.size() / 3 * material.pbrMetallicRoughness.metallicFactor;
+        proxy.roughness += indices.size() / 3 * material.pbrMetallicRoughness.roughnessFactor;
+        proxy.doubleSided |= material.doubleSided;
+      } else {
+        proxy.metallic += indices.size() / 3;
+        proxy.roughness += indices.size() / 3;
+      }
+      proxy.weight += indices.size() / 3;
+      proxy.sourceTriangleCount += indices.size() / 3;
+      const auto texCoords = readAttribute(model, bufferSpans, primitive,
+          ("TEXCOORD_" + std::to_string(texCoordSet)).c_str());
+
+      // Half a texel inside the tile, so that bilinear filtering stays in it
+      const auto tile = tiles.at(primitive.material);
+      const glm::vec2 tileOrigin((tile % atlasColumns) * tileSize + 0.5f,
+          (tile / atlasColumns) * tileSize + 0.5f);
+      const glm::vec2 atlasSize(atlasWidth, atlasHeight);
+
+      const auto base = uint32_t(proxy.positions.size());
+      for (size_t i = 0; i < positions.size(); ++i) {
+        proxy.positions.push_back(glm::vec3(instance.matrix * glm::vec4(positions[i], 1)));
+        const auto n = i < normals.size() ? normalMatrix * normals[i] : glm::vec3(0.f);
+        const auto length = glm::length(n);
+        proxy.normals.push_back(length > 0.f ? n / length : glm::vec3(0.f));
+        // Repeating textures are clamped, the tile is an average anyway
+        const auto uv = i < texCoords.size() ? glm::clamp(glm::vec2(texCoords[i]), 0.f, 1.f)
+                                             : glm::vec2(0.5f);
+        proxy.texCoords.push_back((tileOrigin + uv * float(tileSize - 1)) / atlasSize);
+      }
+      for (size_t i = 0; i < indices.size(); i += 3) {
+        // Mirrored instances have their triangles turned over
+        proxy.indices.push_back(base + indices[i]);
+        proxy.indices.push_back(base + indices[mirrored ? i + 2 : i + 1]);
+        proxy.indices.push_back(base + indices[mirrored ? i + 1 : i + 2]);
+      }
+    }
+  }
+  if (proxy.indices.empty()) {
+    return proxy;
+  }
+
+  // Vertices without normal get the ones of their triangles
+  for (size_t i = 0; i < proxy.indices.size(); i += 3) {
+    const auto &p0 = proxy.positions[proxy.indices[i]];
+    const auto faceNormal = glm::cross(proxy.positions[proxy.indices[i + 1]] - p0,
+        proxy.positions[proxy.indices[i + 2]] - p0);
+    for (size_t k = 0; k < 3; ++k) {
+      auto &n = proxy.normals[proxy.indices[i + k]];
+      if (glm::dot(n, n) < 0.5f) {
+        n += faceNormal * 1e-6f; // Stays under 0.5 while accumulating
+      }
+    }
+  }
+  for (auto &n : proxy.normals) {
+    const auto length = glm::length(n);
+    if (length > 0.f && length < 0.5f) {
+      n /= length;
+    }
+  }
+
+  // Simplify in the unit sphere of the subtree, errors are relative to it
+  Box box;
+  for (const auto &p : proxy.positions) {
+    box.add(p);
+  }
+  const auto center = 0.5f * (box.min + box.max);
+  const auto radius = box.radius();
+  proxy.radius = radius;
+  float simplifyError = 0.f;
+  if (radius > 0.f) {
+    std::vector<glm::vec3> normalized(proxy.positions.size());
+    for (size_t i = 0; i < normalized.size(); ++i) {
+      normalized[i] = (proxy.positions[i] - center) / radius;
+    }
+    proxy.indices = simplifyIndices(proxy.indices, normalized,
+        HLOD_TARGET_TRIANGLES * 3, HLOD_MAX_ERROR, simplifyError);
+  }
+  // Errors of the children add up with the one of this simplification
+  const auto relativeChildError = radius > 0.f ? childError / radius : 0.f;
+  proxy.error = std::max(simplifyError + relativeChildError, subtree.droppedError);
+
+  // Only keep the vertices still used
+  std::vector<uint32_t> remap(proxy.positions.size(), uint32_t(-1));
+  uint32_t vertexCount = 0;
+  for (auto &index : proxy.indices) {
+    if (remap[index] == uint32_t(-1)) {
+      remap[index] = vertexCount;
+      proxy.positions[vertexCount] = proxy.positions[index];
+      proxy.normals[vertexCount] = proxy.normals[index];
+      proxy.texCoords[vertexCount] = proxy.texCoords[index];
+      ++vertexCount;
+    }
+    index = remap[index];
+  }
+  proxy.positions.resize(vertexCount);
+  proxy.normals.resize(vertexCount);
+  proxy.texCoords.resize(vertexCount);
+  return proxy;
+}
+
+// Append values to data and return their accessor (byteOffset in data, no
+// bufferView yet)
+template <typename T>
+tinygltf::Accessor appendAttribute(std::vector<unsigned char> &data,
+    const std::vector<T> &values, int type)
+{
+  tinygltf::Accessor accessor;
+  accessor.type = type;
+  accessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+  accessor.count = values.size();
+  accessor.byteOffset = data.size();
+  data.resize(data.size() + values.size() * sizeof(T));
+  std::memcpy(data.data() + accessor.byteOffset, values.data(), values.size() * sizeof(T));
+  return accessor;
+}
+
+} // namespace
+
+std::vector<HlodProxy> buildHlodProxies(tinygltf::Model &model,
+    std::vector<BufferSpan> &bufferSpans, std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool,
+    size_t minMeshNodes)
+{
+  std::vector<HlodProxy> proxies;
+  if (model.defaultScene < 0 || size_t(model.defaultScene) >= model.scenes.size()) {
+    return proxies;
+  }
+
+  // Boxes of the meshes, and whether a proxy can replace them
+  std::vector<Box> meshBoxes(model.meshes.size());
+  std::vector<bool> mergeableMeshes(model.meshes.size(), true);
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    for (const auto &primitive : model.meshes[meshIdx].primitives) {
+      for (const auto &p : readPositions(model, bufferSpans, primitive)) {
+        meshBoxes[meshIdx].add(p);
+      }
+      if (!primitive.targets.empty() || !isOpaque(model, primitive.material)) {
+        mergeableMeshes[meshIdx] = false;
+      }
+    }
+  }
+
+  // Mesh nodes in the subtree of each node of the scene
+  const auto nodeCount = model.nodes.size();
+  std::vector<size_t> meshNodeCounts(nodeCount, 0);
+  std::vector<bool> mergeableNodes(nodeCount, true);
+  std::vector<bool> visited(nodeCount, false);
+  std::vector<int> sceneNodes; // Parents before children
+  const std::function<void(int)> countMeshNodes = [&](int nodeIdx) {
+    if (nodeIdx < 0 || size_t(nodeIdx) >= nodeCount || visited[nodeIdx]) {
+      return;
+    }
+    visited[nodeIdx] = true;
+    sceneNodes.push_back(nodeIdx);
+    const auto &node = model.nodes[nodeIdx];
+    if (node.mesh >= 0 && size_t(node.mesh) < model.meshes.size()) {
+      ++meshNodeCounts[nodeIdx];
+      mergeableNodes[nodeIdx] = mergeableMeshes[node.mesh] && node.skin < 0;
+    }
+    for (const auto child : node.children) {
+      countMeshNodes(child);
+      if (child >= 0 && size_t(child) < nodeCount) {
+        meshNodeCounts[nodeIdx] += meshNodeCounts[child];
+        mergeableNodes[nodeIdx] = mergeableNodes[nodeIdx] && mergeableNodes[child];
+      }
+    }
+  };
+  for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
+    countMeshNodes(nodeIdx);
+  }
+
+  // Subtrees that get a proxy, children first so that their parents are
+  // built from their proxies instead of merging again all their meshes. A
+  // node without mesh and a single child would get the same proxy as the
+  // child.
+  std::vector<Subtree> subtrees;
+  std::vector<int> nodeSubtrees(nodeCount, -1);
+  for (auto it = sceneNodes.rbegin(); it != sceneNodes.rend(); ++it) {
+    const auto nodeIdx = *it;
+    const auto &node = model.nodes[nodeIdx];
+    if (meshNodeCounts[nodeIdx] < minMeshNodes || !mergeableNodes[nodeIdx] ||
+        (node.mesh < 0 && node.children.size() == 1)) {
+      continue;
+    }
+    Subtree subtree;
+    subtree.node = nodeIdx;
+    std::vector<bool> inSubtree(nodeCount, false);
+    const std::function<void(int, const glm::mat4 &)> collect =
+        [&](int childIdx, const glm::mat4 &matrix) {
+          if (childIdx < 0 || size_t(childIdx) >= nodeCount || inSubtree[childIdx]) {
+            return;
+          }
+          inSubtree[childIdx] = true;
+          if (childIdx != nodeIdx && nodeSubtrees[childIdx] >= 0) {
+            subtree.children.push_back({size_t(nodeSubtrees[childIdx]), matrix});
+            return;
+          }
+          const auto &child = model.nodes[childIdx];
+          if (child.mesh >= 0 && size_t(child.mesh) < model.meshes.size() &&
+              !meshBoxes[child.mesh].empty()) {
+            subtree.instances.push_back({child.mesh, matrix});
+          }
+          for (const auto grandChild : child.children) {
+            if (grandChild >= 0 && size_t(grandChild) < nodeCount) {
+              collect(grandChild, getLocalToWorldMatrix(model.nodes[grandChild], matrix));
+            }
+          }
+        };
+    collect(nodeIdx, glm::mat4(1));
+
+    auto &box = subtree.box;
+    const auto addBox = [&](const Box &childBox, const glm::mat4 &matrix) {
+      const auto transformed = childBox.transformed(matrix);
+      box.add(transformed.min);
+      box.add(transformed.max);
+    };
+    for (const auto &instance : subtree.instances) {
+      addBox(meshBoxes[instance.mesh], instance.matrix);
+    }
+    for (const auto &child : subtree.children) {
+      addBox(subtrees[child.subtree].box, child.matrix);
+    }
+    const auto radius = box.radius();
+    if (!(radius > 0.f)) {
+      continue;
+    }
+    const auto isTooSmall = [&](const Box &childBox, const glm::mat4 &matrix) {
+      const auto relativeSize = childBox.transformed(matrix).radius() / radius;
+      if (relativeSize >= HLOD_MIN_SIZE) {
+        return false;
+      }
+      subtree.droppedError = std::max(subtree.droppedError, relativeSize);
+      return true;
+    };
+    auto &instances = subtree.instances;
+    instances.erase(std::remove_if(begin(instances), end(instances),
+                        [&](const Instance &instance) {
+                          return isTooSmall(meshBoxes[instance.mesh], instance.matrix);
+                        }),
+        end(instances));
+    auto &children = subtree.children;
+    children.erase(std::remove_if(begin(children), end(children),
+                       [&](const ChildProxy &child) {
+                         return isTooSmall(subtrees[child.subtree].box, child.matrix);
+                       }),
+        end(children));
+    for (const auto &child : children) {
+      subtree.level = std::max(subtree.level, subtrees[child.subtree].level + 1);
+    }
+    if (!instances.empty() || !children.empty()) {
+      nodeSubtrees[nodeIdx] = int(subtrees.size());
+      subtrees.push_back(std::move(subtree));
+    }
+  }
+  if (subtrees.empty()) {
+    return proxies;
+  }
+
+  // One tile per material in the atlas (-1 for primitives without one)
+  std::map<int, int> tiles;
+  std::vector<int> tileMaterials;
+  for (const auto &subtree : subtrees) {
+    for (const auto &instance : subtree.instances) {
+      for (const auto &primitive : model.meshes[instance.mesh].primitives) {
+        const auto materialIdx =
+            primitive.material >= 0 && size_t(primitive.material) < model.materials.size()
+                ? primitive.material
+                : -1;
+        if (tiles.emplace(materialIdx, int(tileMaterials.size())).second) {
+          tileMaterials.push_back(materialIdx);
+        }
+      }
+    }
+  }
+  // Primitives with an invalid material index use the tile of -1
+  for (const auto &subtree : subtrees) {
+    for (const auto &instance : subtree.instances) {
+      for (const auto &primitive : model.meshes[instance.mesh].primitives) {
+        if (!tiles.count(primitive.material)) {
+          tiles[primitive.material] = tiles.at(-1);
+        }
+      }
+    }
+  }
+  const auto atlasColumns = int(std::ceil(std::sqrt(double(tileMaterials.size()))));
+  const auto atlasRows = (int(tileMaterials.size()) + atlasColumns - 1) / atlasColumns;
+  auto tileSize = MAX_TILE_SIZE;
+  while (tileSize > 1 && std::max(atlasColumns, atlasRows) * tileSize > MAX_ATLAS_SIZE) {
+    tileSize /= 2;
+  }
+
+  tinygltf::Image atlas;
+  atlas.name = "HLOD atlas";
+  atlas.width = atlasColumns * tileSize;
+  atlas.height = atlasRows * tileSize;
+  atlas.component = 3;
+  atlas.bits = 8;
+  atlas.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+  atlas.image.resize(size_t(atlas.width) * atlas.height * 3, 255);
+  const auto rowPitch = size_t(atlas.width) * 3;
+  pool.parallelFor(tileMaterials.size(), [&](size_t tile) {
+    const auto x = int(tile) % atlasColumns * tileSize;
+    const auto y = int(tile) / atlasColumns * tileSize;
+    bakeTile(model, imageSpans, imageEncodings, tileMaterials[tile],
+        atlas.image.data() + y * rowPitch + 3 * x, rowPitch, tileSize);
+  });
+
+  // Level by level, the proxies of a level only read those of the levels
+  // below
+  std::vector<std::vector<size_t>> levels;
+  for (size_t i = 0; i < subtrees.size(); ++i) {
+    levels.resize(std::max(levels.size(), subtrees[i].level + 1));
+    levels[subtrees[i].level].push_back(i);
+  }
+  std::vector<ProxyMesh> proxyMeshes(subtrees.size());
+  for (const auto &level : levels) {
+    pool.parallelFor(level.size(), [&](size_t i) {
+      proxyMeshes[level[i]] = buildProxyMesh(model, bufferSpans, subtrees[level[i]],
+          proxyMeshes, tiles, tileSize, atlasColumns, atlas.width, atlas.height);
+    });
+  }
+
+  // Atlas texture, filtered with mip levels and clamped to keep tiles apart
+  tinygltf::Sampler sampler;
+  sampler.minFilter = TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR;
+  sampler.magFilter = TINYGLTF_TEXTURE_FILTER_LINEAR;
+  sampler.wrapS = TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE;
+  sampler.wrapT = TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE;
+  tinygltf::Texture texture;
+  texture.source = int(model.images.size());
+  texture.sampler = int(model.samplers.size());
+  const auto atlasTexture = int(model.textures.size());
+  model.samplers.push_back(sampler);
+  model.textures.push_back(texture);
+  // Images are moved (not copied) on reallocation, other spans stay valid
+  model.images.push_back(std::move(atlas));
+  imageSpans.push_back({model.images.back().image.data(), model.images.back().image.size()});
+  ImageEncoding encoding;
+  encoding.swizzle[3] = SWIZZLE_ONE;
+  imageEncodings.resize(model.images.size() - 1);
+  imageEncodings.push_back(encoding);
+
+  // Vertices then indices of all the proxies in a new buffer
+  tinygltf::Buffer buffer;
+  std::vector<unsigned char> indexData;
+  const auto bufferIdx = int(model.buffers.size());
+  const auto vertexViewIdx = int(model.bufferViews.size());
+  const auto indexViewIdx = vertexViewIdx + 1;
+  for (size_t i = 0; i < proxyMeshes.size(); ++i) {
+    // Still used by their parents above, even when they are not kept
+    const auto &proxyMesh = proxyMeshes[i];
+    if (proxyMesh.indices.empty() ||
+        proxyMesh.indices.size() / 3 >= HLOD_MAX_TRIANGLE_RATIO * proxyMesh.sourceTriangleCount) {
+      continue;
+    }
+    const auto firstAccessor = int(model.accessors.size());
+
+    auto positions = appendAttribute(buffer.data, proxyMesh.positions, TINYGLTF_TYPE_VEC3);
+    Box box;
+    for (const auto &p : proxyMesh.positions) {
+      box.add(p);
+    }
+    positions.minValues = {box.min.x, box.min.y, box.min.z};
+    positions.maxValues = {box.max.x, box.max.y, box.max.z};
+    positions.bufferView = vertexViewIdx;
+    model.accessors.push_back(positions);
+    auto normals = appendAttribute(buffer.data, proxyMesh.normals, TINYGLTF_TYPE_VEC3);
+    normals.bufferView = vertexViewIdx;
+    model.accessors.push_back(normals);
+    auto texCoords = appendAttribute(buffer.data, proxyMesh.texCoords, TINYGLTF_TYPE_VEC2);
+    texCoords.bufferView = vertexViewIdx;
+    model.accessors.push_back(texCoords);
+    auto indices = appendIndices(indexData, proxyMesh.indices, proxyMesh.positions.size());
+    indices.bufferView = indexViewIdx;
+    model.accessors.push_back(indices);
+
+    const auto &node = model.nodes[subtrees[i].node];
+    tinygltf::Material material;
+    material.name = "HLOD proxy of " + node.name;
+    material.pbrMetallicRoughness.baseColorTexture.index = atlasTexture;
+    material.pbrMetallicRoughness.metallicFactor = proxyMesh.metallic / proxyMesh.weight;
+    material.pbrMetallicRoughness.roughnessFactor = proxyMesh.roughness / proxyMesh.weight;
+    material.doubleSided = proxyMesh.doubleSided;
+
+    tinygltf::Primitive primitive;
+    primitive.attributes["POSITION"] = firstAccessor;
+    primitive.attributes["NORMAL"] = firstAccessor + 1;
+    primitive.attributes["TEXCOORD_0"] = firstAccessor + 2;
+    primitive.indices = firstAccessor + 3;
+    primitive.material = int(model.materials.size());
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    tinygltf::Mesh mesh;
+    mesh.name = material.name;
+    mesh.primitives.push_back(primitive);
+
+    proxies.push_back({subtrees[i].node, int32_t(model.meshes.size()), proxyMesh.error});
+    model.materials.push_back(material);
+    model.meshes.push_back(mesh);
+  }
+
+  tinygltf::BufferView vertexView;
+  vertexView.buffer = bufferIdx;
+  vertexView.byteLength = buffer.data.size();
+  vertexView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+  tinygltf::BufferView indexView;
+  indexView.buffer = bufferIdx;
+  indexView.byteOffset = (buffer.data.size() + 3) & ~size_t(3);
+  indexView.byteLength = indexData.size();
+  indexView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+  buffer.data.resize(indexView.byteOffset);
+  buffer.data.insert(end(buffer.data), begin(indexData), end(indexData));
+  model.bufferViews.push_back(vertexView);
+  model.bufferViews.push_back(indexView);
+  // Buffers are moved (not copied) on reallocation, other spans stay valid
+  model.buffers.push_back(std::move(buffer));
+  bufferSpans.push_back({model.buffers.back().data.data(), model.buffers.back().data.size()});
+
+  return proxies;
+}
+
+std::vector<int> getHlodProxyIndices(
+    const tinygltf::Model &model, const std::vector<HlodProxy> &proxies)
+{
+  std::vector<int> indices(model.nodes.size(), -1);
+  for (size_t i = 0; i < proxies.size(); ++i) {
+    const auto &proxy = proxies[i];
+    if (proxy.node >= 0 && size_t(proxy.node) < indices.size() &&
+        proxy.mesh >= 0 && size_t(proxy.mesh) < model.meshes.size()) {
+      indices[proxy.node] = int(i);
+    }
+  }
+  return indices;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "mesh_lod.hpp"
+#include "texture_compression.hpp"
+#include "thread_pool.hpp"
+
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Build a proxy for each node of the default scene with at least
+// minMeshNodes mesh nodes in its subtree, bottom-up: the proxies of the
+// subtrees below and the other meshes are merged in the space of the node and
+// simplified, tiny meshes are dropped. Proxies that keep more than a quarter
+// of the triangles of their subtree are not returned. The base colors
+// of all the materials are baked in the tiles of a shared atlas, sampled by
+// one material per proxy. Subtrees with skins, morph targets or materials
+// that are not opaque get no proxy.
+// Meshes, materials, the atlas texture and image are appended to model, their
+// bytes to bufferSpans and imageSpans. Runs on decoded images, so before
+// generateMipmaps and compressImages (the atlas gets its levels from there).
+std::vector<HlodProxy> buildHlodProxies(tinygltf::Model &model,
+    std::vector<BufferSpan> &bufferSpans, std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool,
+    size_t minMeshNodes = 8);
+
+// Index in proxies of the proxy of each node, -1 without
+std::vector<int> getHlodProxyIndices(
+    const tinygltf::Model &model, const std::vector<HlodProxy> &proxies);
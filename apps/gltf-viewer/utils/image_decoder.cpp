@@ -0,0 +1,121 @@
+#include "image_decoder.hpp"
+
+#include <memory>
+#include <stb_image.h>
+
+bool decodeImage(tinygltf::Image &image, int imageIdx, std::string &err,
+    int reqWidth, int reqHeight, const unsigned char *bytes, int size)
+{
+  int width = 0, height = 0, component = 0, bits = 8;
+  unsigned char *data = nullptr;
+  if (stbi_is_16_bit_from_memory(bytes, size)) {
+    data = reinterpret_cast<unsigned char *>(
+        stbi_load_16_from_memory(bytes, size, &width, &height, &component, 0));
+    bits = 16;
+  }
+  if (!data) {
+    data = stbi_load_from_memory(bytes, size, &width, &height, &component, 0);
+    bits = 8;
+  }
+  const auto name = "image[" + std::to_string(imageIdx) + "] name = \"" + image.name + "\"";
+  if (!data) {
+    err += "Unknown image format. STB cannot decode image data for " + name + ".\n";
+    return false;
+  }
+  if (width < 1 || height < 1 || (reqWidth > 0 && reqWidth != width) ||
+      (reqHeight > 0 && reqHeight != height)) {
+    stbi_image_free(data);
+    err += "Invalid image size for " + name + "\n";
+    return false;
+  }
+
+  image.width = width;
+  image.height = height;
+  image.component = component;
+  image.bits = bits;
+  image.pixel_type = bits == 16 ? TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT
+                                : TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+  image.image.assign(data, data + size_t(width) * height * component * (bits / 8));
+  stbi_image_free(data);
+  return true;
+}
+
+void ParallelImageDecoder::install(tinygltf::TinyGLTF &loader)
+{
+  loader.SetImageLoader(&ParallelImageDecoder::loadImageData, this);
+}
+
+bool ParallelImageDecoder::isSkipped(int imageIdx) const
+{
+  for (const auto skipped : m_skippedImages) {
+    if (size_t(imageIdx) < skipped->size() && (*skipped)[imageIdx]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParallelImageDecoder::loadImageData(tinygltf::Image *image,
+    const int imageIdx, std::string *err, std::string * /* warn */,
+    int reqWidth, int reqHeight, const unsigned char *bytes, int size,
+    void *userData)
+{
+  auto &decoder = *static_cast<ParallelImageDecoder *>(userData);
+  if (decoder.isSkipped(imageIdx)) {
+    return true;
+  }
+
+  // Only the header is read here, an image stb does not know fails the load
+  // right away with its name, like tinygltf's own loader
+  int width = 0, height = 0, component = 0;
+  if (size <= 0 || !stbi_info_from_memory(bytes, size, &width, &height, &component)) {
+    if (err) {
+      *err += "Unknown image format. STB cannot decode image data for image[" +
+              std::to_string(imageIdx) + "] name = \"" + image->name + "\".\n";
+    }
+    return false;
+  }
+
+  // tinygltf releases the encoded bytes when we return, keep a copy for the
+  // worker. The Image is also a temporary that tinygltf moves after the call,
+  // so the worker decodes in its own and join() puts it in model.images.
+  const auto encoded =
+      std::make_shared<std::vector<unsigned char>>(bytes, bytes + size);
+  const auto name = image->name;
+
+  decoder.m_jobs.push_back({imageIdx,
+      decoder.m_pool.submit([encoded, name, imageIdx, reqWidth, reqHeight]() {
+        DecodedImage decoded;
+        decoded.image.name = name;
+        decoded.ok = decodeImage(decoded.image, imageIdx, decoded.err,
+            reqWidth, reqHeight, encoded->data(), int(encoded->size()));
+        return decoded;
+      })});
+
+  return true;
+}
+
+bool ParallelImageDecoder::join(tinygltf::Model &model, std::string &err)
+{
+  bool ok = true;
+  for (auto &job : m_jobs) {
+    auto decoded = job.result.get();
+    if (size_t(job.imageIdx) >= model.images.size()) {
+      continue; // Parsing failed before this image was added to the model
+    }
+    if (!decoded.ok) {
+      err += decoded.err;
+      ok = false;
+      continue;
+    }
+    auto &image = model.images[job.imageIdx];
+    image.width = decoded.image.width;
+    image.height = decoded.image.height;
+    image.component = decoded.image.component;
+    image.bits = decoded.image.bits;
+    image.pixel_type = decoded.image.pixel_type;
+    image.image = std::move(decoded.image.image);
+  }
+  m_jobs.clear();
+  return ok;
+}
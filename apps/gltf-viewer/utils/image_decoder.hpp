@@ -0,0 +1,64 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <future>
+#include <string>
+#include <tiny_gltf.h>
+#include <vector>
+
+// Same as tinygltf::LoadImageData, but keeps the channels of the file instead
+// of expanding them to RGBA: they are packed further by packImageChannels.
+// reqWidth and reqHeight are checked if positive.
+bool decodeImage(tinygltf::Image &image, int imageIdx, std::string &err,
+    int reqWidth, int reqHeight, const unsigned char *bytes, int size);
+
+// tinygltf image loader decoding images on a thread pool instead of inside
+// the JSON parsing loop.
+// Usage: install() on the loader, load the file, then join() before using
+// model.images. Unknown formats fail the load (err of tinygltf), decoding
+// errors are given by join().
+class ParallelImageDecoder
+{
+public:
+  explicit ParallelImageDecoder(ThreadPool &pool) : m_pool(pool) {}
+
+  void install(tinygltf::TinyGLTF &loader);
+
+  // Images i with (*skipped)[i] set are not decoded and stay empty.
+  // skipped must stay alive while the file is loaded.
+  void addSkippedImages(const std::vector<bool> *skipped)
+  {
+    m_skippedImages.push_back(skipped);
+  }
+
+  // Wait for all decodes and move the pixels in model.images.
+  // Returns false if an image could not be decoded (details in err).
+  bool join(tinygltf::Model &model, std::string &err);
+
+  size_t imageCount() const { return m_jobs.size(); }
+
+private:
+  struct DecodedImage
+  {
+    tinygltf::Image image;
+    bool ok = false;
+    std::string err;
+  };
+
+  struct Job
+  {
+    int imageIdx;
+    std::future<DecodedImage> result;
+  };
+
+  bool isSkipped(int imageIdx) const;
+
+  static bool loadImageData(tinygltf::Image *image, const int imageIdx,
+      std::string *err, std::string *warn, int reqWidth, int reqHeight,
+      const unsigned char *bytes, int size, void *userData);
+
+  ThreadPool &m_pool;
+  std::vector<Job> m_jobs;
+  std::vector<const std::vector<bool> *> m_skippedImages;
+};
@@ -0,0 +1,365 @@
+#include "index_optimizer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+const size_t CACHE_SIZE = 16;
+
+// FIFO cache with time stamps: v is in the cache if less than cacheSize
+// misses happened since it was added
+class FifoCache
+{
+public:
+  FifoCache(size_t vertexCount, size_t cacheSize) :
+      m_cacheTime(vertexCount, 0), m_cacheSize(cacheSize), m_time(cacheSize + 1)
+  {
+  }
+
+  // Returns true on a miss
+  bool access(uint32_t v)
+  {
+    if (m_time - m_cacheTime[v] > m_cacheSize) {
+      m_cacheTime[v] = m_time++;
+      return true;
+    }
+    return false;
+  }
+
+  // Forget everything
+  void reset() { m_time += m_cacheSize + 1; }
+
+private:
+  std::vector<size_t> m_cacheTime;
+  size_t m_cacheSize;
+  size_t m_time;
+};
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(
+    const std::vector<uint32_t> &indices, size_t vertexCount, size_t cacheSize)
+{
+  VertexCacheStats stats;
+  stats.triangleCount = indices.size() / 3;
+
+  FifoCache cache(vertexCount, cacheSize);
+  std::vector<bool> used(vertexCount, false);
+  for (const auto v : indices) {
+    stats.cacheMisses += cache.access(v);
+    if (!used[v]) {
+      used[v] = true;
+      ++stats.vertexCount;
+    }
+  }
+  return stats;
+}
+
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t> &indices,
+    size_t vertexCount, size_t cacheSize, std::vector<size_t> &clusters)
+{
+  const auto triangleCount = indices.size() / 3;
+
+  // Triangles around each vertex, and how many of them are not emitted yet
+  std::vector<uint32_t> liveCount(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    ++liveCount[indices[i]];
+  }
+  std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+  std::partial_sum(begin(liveCount), end(liveCount), begin(adjacencyOffsets) + 1);
+  std::vector<uint32_t> adjacency(adjacencyOffsets.back());
+  {
+    auto fill = adjacencyOffsets;
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+      adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+  }
+
+  std::vector<size_t> cacheTime(vertexCount, 0);
+  size_t time = cacheSize + 1;
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> deadEnds;
+  std::vector<uint32_t> candidates;
+  size_t cursor = 0; // Next vertex to try when out of dead ends
+
+  std::vector<uint32_t> out;
+  out.reserve(triangleCount * 3);
+  clusters.clear();
+  clusters.push_back(0);
+
+  int64_t fan = triangleCount ? indices[0] : -1;
+  while (fan >= 0) {
+    // Emit all the triangles around the fanning vertex
+    candidates.clear();
+    for (auto k = adjacencyOffsets[fan]; k < adjacencyOffsets[fan + 1]; ++k) {
+      const auto t = adjacency[k];
+      if (emitted[t]) {
+        continue;
+      }
+      emitted[t] = true;
+      for (size_t c = 0; c < 3; ++c) {
+        const auto v = indices[3 * t + c];
+        out.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        --liveCount[v];
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // Next fanning vertex: the oldest candidate that stays in the cache
+    // while its triangles are emitted
+    fan = -1;
+    int64_t bestPriority = -1;
+    for (const auto v : candidates) {
+      if (!liveCount[v]) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cacheTime[v] + 2 * liveCount[v] <= cacheSize) {
+        priority = int64_t(time - cacheTime[v]);
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fan = v;
+      }
+    }
+    if (fan >= 0) {
+      continue;
+    }
+
+    // Dead end: the cache content is lost, start a new cluster
+    while (!deadEnds.empty() && fan < 0) {
+      const auto v = deadEnds.back();
+      deadEnds.pop_back();
+      if (liveCount[v]) {
+        fan = v;
+      }
+    }
+    for (; cursor < vertexCount && fan < 0; ++cursor) {
+      if (liveCount[cursor]) {
+        fan = cursor;
+      }
+    }
+    if (fan >= 0 && clusters.back() != out.size() / 3) {
+      clusters.push_back(out.size() / 3);
+    }
+  }
+
+  return out;
+}
+
+std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t> &indices,
+    const std::vector<size_t> &clusters, const std::vector<glm::vec3> &positions,
+    size_t cacheSize, float threshold)
+{
+  const auto triangleCount = indices.size() / 3;
+  if (!triangleCount) {
+    return indices;
+  }
+
+  // Split clusters further where the cache is warm enough that restarting
+  // it costs little (soft boundaries of the paper)
+  const auto targetAcmr =
+      threshold * analyzeVertexCache(indices, positions.size(), cacheSize).acmr();
+  std::vector<size_t> splitClusters;
+  FifoCache cache(positions.size(), cacheSize);
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    const auto clusterEnd = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    auto start = clusters[c];
+    size_t misses = 0;
+    cache.reset();
+    splitClusters.push_back(start);
+    for (auto t = start; t < clusterEnd; ++t) {
+      for (size_t k = 0; k < 3; ++k) {
+        misses += cache.access(indices[3 * t + k]);
+      }
+      if (t + 1 < clusterEnd && float(misses) / (t + 1 - start) <= targetAcmr) {
+        start = t + 1;
+        misses = 0;
+        cache.reset();
+        splitClusters.push_back(start);
+      }
+    }
+  }
+
+  // View independent overdraw metric: clusters far from the center in the
+  // direction of their normal are likely to occlude the others
+  glm::vec3 meshCenter(0.f);
+  float meshArea = 0.f;
+  struct Cluster
+  {
+    size_t begin, end;
+    glm::vec3 center;
+    glm::vec3 normal;
+    float sortKey;
+  };
+  std::vector<Cluster> sorted(splitClusters.size());
+  for (size_t c = 0; c < splitClusters.size(); ++c) {
+    auto &cluster = sorted[c];
+    cluster.begin = splitClusters[c];
+    cluster.end = c + 1 < splitClusters.size() ? splitClusters[c + 1] : triangleCount;
+    cluster.center = glm::vec3(0.f);
+    cluster.normal = glm::vec3(0.f);
+    float clusterArea = 0.f;
+    for (auto t = cluster.begin; t < cluster.end; ++t) {
+      const auto &p0 = positions[indices[3 * t]];
+      const auto &p1 = positions[indices[3 * t + 1]];
+      const auto &p2 = positions[indices[3 * t + 2]];
+      const auto n = glm::cross(p1 - p0, p2 - p0); // Length is twice the area
+      const auto area = glm::length(n);
+      cluster.center += (p0 + p1 + p2) * (area / 3.f);
+      cluster.normal += n;
+      clusterArea += area;
+    }
+    meshCenter += cluster.center;
+    meshArea += clusterArea;
+    cluster.center /= clusterArea > 0.f ? clusterArea : 1.f;
+  }
+  meshCenter /= meshArea > 0.f ? meshArea : 1.f;
+  for (auto &cluster : sorted) {
+    const auto length = glm::length(cluster.normal);
+    cluster.sortKey = length > 0.f
+        ? glm::dot(cluster.center - meshCenter, cluster.normal / length)
+        : 0.f;
+  }
+  std::stable_sort(begin(sorted), end(sorted),
+      [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+  std::vector<uint32_t> out;
+  out.reserve(indices.size());
+  for (const auto &cluster : sorted) {
+    out.insert(end(out), begin(indices) + 3 * cluster.begin,
+        begin(indices) + 3 * cluster.end);
+  }
+  return out;
+}
+
+std::vector<uint32_t> optimizeVertexFetch(
+    std::vector<uint32_t> &indices, size_t vertexCount)
+{
+  const auto unused = uint32_t(-1);
+  std::vector<uint32_t> remap(vertexCount, unused);
+  uint32_t next = 0;
+  for (auto &index : indices) {
+    if (remap[index] == unused) {
+      remap[index] = next++;
+    }
+    index = remap[index];
+  }
+  for (auto &newIndex : remap) {
+    if (newIndex == unused) {
+      newIndex = next++;
+    }
+  }
+  return remap;
+}
+
+void optimizeIndices(tinygltf::Model &model, std::vector<BufferSpan> &bufferSpans,
+    QuantizedVertices &vertices, MeshLods &lods, VertexCacheStats &before,
+    VertexCacheStats &after)
+{
+  tinygltf::Buffer indexBuffer;
+  // Accessor index to replace, and its new accessor
+  std::vector<std::pair<int *, tinygltf::Accessor>> newAccessors;
+  const auto lodRanges = getPrimitiveLodRanges(model, lods);
+  // Vertices shared by several primitives keep their order, it can only
+  // suit one of them
+  std::unordered_map<size_t, size_t> vertexUsers;
+  for (const auto &quantizedPrimitives : vertices.primitives) {
+    for (const auto &quantized : quantizedPrimitives) {
+      if (quantized.vertexCount) {
+        ++vertexUsers[quantized.byteOffset];
+      }
+    }
+  }
+
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    auto &mesh = model.meshes[meshIdx];
+    for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
+      auto &primitive = mesh.primitives[primIdx];
+      const auto &quantized = vertices.primitives[meshIdx][primIdx];
+      const auto vertexCount = quantized.vertexCount;
+      if (primitive.mode != TINYGLTF_MODE_TRIANGLES || primitive.indices < 0 ||
+          size_t(primitive.indices) >= model.accessors.size() || !vertexCount) {
+        continue;
+      }
+      const auto &accessor = model.accessors[primitive.indices];
+      auto indices = readIndices(model, bufferSpans, accessor);
+      indices.resize(indices.size() / 3 * 3);
+      if (indices.empty() ||
+          *std::max_element(begin(indices), end(indices)) >= vertexCount) {
+        continue; // Leave broken primitives alone
+      }
+
+      const auto first = reinterpret_cast<QuantizedVertex *>(
+          model.buffers[vertices.buffer].data.data() + quantized.byteOffset);
+      std::vector<glm::vec3> positions(vertexCount);
+      for (size_t i = 0; i < vertexCount; ++i) {
+        positions[i] = quantized.dequantize(first[i]);
+      }
+
+      before.add(analyzeVertexCache(indices, vertexCount, CACHE_SIZE));
+      std::vector<size_t> clusters;
+      indices = optimizeVertexCache(indices, vertexCount, CACHE_SIZE, clusters);
+      indices = optimizeOverdraw(indices, clusters, positions, CACHE_SIZE);
+      after.add(analyzeVertexCache(indices, vertexCount, CACHE_SIZE));
+
+      std::vector<uint32_t> remap(vertexCount);
+      if (vertexUsers[quantized.byteOffset] == 1) {
+        remap = optimizeVertexFetch(indices, vertexCount);
+        std::vector<QuantizedVertex> reordered(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i) {
+          reordered[remap[i]] = first[i];
+        }
+        std::copy(begin(reordered), end(reordered), first);
+      } else {
+        std::iota(begin(remap), end(remap), 0u);
+      }
+
+      // Narrowed to 16 bits if all indices fit
+      newAccessors.emplace_back(&primitive.indices, appendIndices(indexBuffer.data, indices, vertexCount));
+
+      // Simplified levels share the vertices, they follow the new order
+      const auto &lodRange = lodRanges[meshIdx][primIdx];
+      for (size_t l = lodRange.begin; l < lodRange.begin + lodRange.count; ++l) {
+        auto &lod = lods.primitives[l];
+        auto lodIndices = readIndices(model, bufferSpans, model.accessors[lod.indices]);
+        if (lodIndices.empty() ||
+            *std::max_element(begin(lodIndices), end(lodIndices)) >= vertexCount) {
+          continue;
+        }
+        for (auto &index : lodIndices) {
+          index = remap[index];
+        }
+        lodIndices = optimizeVertexCache(lodIndices, vertexCount, CACHE_SIZE, clusters);
+        newAccessors.emplace_back(&lod.indices, appendIndices(indexBuffer.data, lodIndices, vertexCount));
+      }
+    }
+  }
+
+  if (newAccessors.empty()) {
+    return;
+  }
+
+  // All optimized indices are in a single buffer view of the new buffer
+  tinygltf::BufferView bufferView;
+  bufferView.buffer = int(model.buffers.size());
+  bufferView.byteLength = indexBuffer.data.size();
+  bufferView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+  // Buffers are moved (not copied) on reallocation, other spans stay valid
+  model.buffers.push_back(std::move(indexBuffer));
+  bufferSpans.push_back({model.buffers.back().data.data(), model.buffers.back().data.size()});
+
+  for (auto &newAccessor : newAccessors) {
+    newAccessor.second.bufferView = int(model.bufferViews.size());
+    *newAccessor.first = int(model.accessors.size());
+    model.accessors.push_back(newAccessor.second);
+  }
+  model.bufferViews.push_back(bufferView);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "mesh_lod.hpp"
+#include "vertex_quantizer.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Post-transform vertex cache efficiency of triangle lists, measured with a
+// FIFO cache simulation
+struct VertexCacheStats
+{
+  size_t triangleCount = 0;
+  size_t vertexCount = 0; // Distinct vertices referenced
+  size_t cacheMisses = 0;
+
+  // Average cache miss ratio, transformed vertices per triangle (0.5 is ideal)
+  float acmr() const { return triangleCount ? float(cacheMisses) / triangleCount : 0.f; }
+
+  // Average transform to vertex ratio (1 is ideal)
+  float atvr() const { return vertexCount ? float(cacheMisses) / vertexCount : 0.f; }
+
+  void add(const VertexCacheStats &other)
+  {
+    triangleCount += other.triangleCount;
+    vertexCount += other.vertexCount;
+    cacheMisses += other.cacheMisses;
+  }
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices,
+    size_t vertexCount, size_t cacheSize = 16);
+
+// Tipsify (Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality
+// and Reduced Overdraw"): reorder triangles for a cache of cacheSize entries.
+// clusters receives the first triangle of each group of triangles that can
+// be moved around without hurting cache locality.
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t> &indices,
+    size_t vertexCount, size_t cacheSize, std::vector<size_t> &clusters);
+
+// Sort the clusters of optimizeVertexCache so that the ones facing outwards
+// of the mesh are drawn first, which lets the depth test reject more
+// fragments for any point of view. threshold (>= 1) is how much cache
+// efficiency can be traded for smaller clusters.
+std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t> &indices,
+    const std::vector<size_t> &clusters, const std::vector<glm::vec3> &positions,
+    size_t cacheSize, float threshold = 1.05f);
+
+// Renumber vertices in order of first use, so that the vertex fetch reads
+// memory linearly. Indices are rewritten, the returned table gives the new
+// index of each old vertex (unused vertices are moved at the end).
+std::vector<uint32_t> optimizeVertexFetch(
+    std::vector<uint32_t> &indices, size_t vertexCount);
+
+// Run the three passes on every indexed triangle primitive. New index data,
+// narrowed to 16 bits when possible, goes in a buffer appended to
+// model.buffers (and bufferSpans) and the vertices of the primitives are
+// reordered in place in the buffer of quantizeVertices (before it is cached),
+// unless other primitives share them. The levels of detail of the primitives
+// in lods are renumbered and reordered for the vertex cache too.
+void optimizeIndices(tinygltf::Model &model, std::vector<BufferSpan> &bufferSpans,
+    QuantizedVertices &vertices, MeshLods &lods, VertexCacheStats &before,
+    VertexCacheStats &after);
@@ -0,0 +1,105 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const fs::path &path)
+{
+  close();
+
+#ifdef _WIN32
+  const auto file = CreateFileW(path.wstring().c_str(), GENERIC_READ,
+      FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+      nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+  const auto mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    CloseHandle(file);
+    return false;
+  }
+  const auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  m_fileHandle = file;
+  m_mappingHandle = mapping;
+  m_data = static_cast<const unsigned char *>(data);
+  m_size = size_t(fileSize.QuadPart);
+#else
+  const auto fd = ::open(path.string().c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  const auto data =
+      mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // The mapping keeps its own reference on the file
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  m_data = static_cast<const unsigned char *>(data);
+  m_size = size_t(st.st_size);
+#endif
+
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (!m_data) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(m_data);
+  CloseHandle(m_mappingHandle);
+  CloseHandle(m_fileHandle);
+  m_fileHandle = nullptr;
+  m_mappingHandle = nullptr;
+#else
+  munmap(const_cast<unsigned char *>(m_data), m_size);
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+
+void MappedFile::evict(const void *begin, size_t size) const
+{
+  const auto first = static_cast<const unsigned char *>(begin);
+  if (!m_data || first < m_data || first + size > m_data + m_size) {
+    return;
+  }
+#ifndef _WIN32
+  // madvise works on whole pages, only release the ones fully inside the range
+  const auto pageSize = size_t(sysconf(_SC_PAGESIZE));
+  const auto pageBegin = (size_t(first) + pageSize - 1) / pageSize * pageSize;
+  const auto pageEnd = (size_t(first) + size) / pageSize * pageSize;
+  if (pageEnd > pageBegin) {
+    madvise((void *)pageBegin, pageEnd - pageBegin, MADV_DONTNEED);
+  }
+#else
+  // Unlock is the closest equivalent, the working set trimmer does the rest
+  VirtualUnlock(const_cast<unsigned char *>(first), size);
+#endif
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+// Pages are loaded on demand by the OS, so mapping a multi-GB file costs
+// nothing until its bytes are actually read.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const fs::path &path);
+
+  void close();
+
+  const unsigned char *data() const { return m_data; }
+
+  size_t size() const { return m_size; }
+
+  bool isOpen() const { return m_data != nullptr; }
+
+  // Tell the OS we are done with [begin, begin + size) for now, so the pages
+  // can be dropped from the resident set. They are reloaded from the file if
+  // accessed again. No-op for ranges outside of the mapping.
+  void evict(const void *begin, size_t size) const;
+
+private:
+  const unsigned char *m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  void *m_fileHandle = nullptr;
+  void *m_mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,610 @@
+#include "mesh_lod.hpp"
+#include "vertex_quantizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+const uint32_t NONE = uint32_t(-1);
+// Open edges resist more than the surface, or borders shrink first
+const double EDGE_WEIGHT = 10.;
+
+// Only bother for primitives with more triangles than that
+const size_t MIN_TRIANGLES = 512;
+// Coarsest level we keep
+const size_t MIN_LOD_TRIANGLES = 128;
+// Stop when a level removes less than 15% of the triangles of the previous
+// one, or when it deviates by more than a quarter of the bounding radius
+const float MIN_REDUCTION = 0.85f;
+const float MAX_LOD_ERROR = 0.25f;
+
+// Sum of weighted squared distances to planes: p^T A p + 2 b.p + c, with A
+// symmetric
+struct Quadric
+{
+  double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+  double b0 = 0, b1 = 0, b2 = 0;
+  double c = 0;
+  double weight = 0;
+
+  // Plane dot(n, p) + d = 0, n normalized
+  static Quadric fromPlane(const glm::vec3 &n, float d, double weight)
+  {
+    Quadric q;
+    q.a00 = weight * n.x * n.x;
+    q.a11 = weight * n.y * n.y;
+    q.a22 = weight * n.z * n.z;
+    q.a01 = weight * n.x * n.y;
+    q.a02 = weight * n.x * n.z;
+    q.a12 = weight * n.y * n.z;
+    q.b0 = weight * n.x * d;
+    q.b1 = weight * n.y * d;
+    q.b2 = weight * n.z * d;
+    q.c = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &q)
+  {
+    a00 += q.a00;
+    a11 += q.a11;
+    a22 += q.a22;
+    a01 += q.a01;
+    a02 += q.a02;
+    a12 += q.a12;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+    weight += q.weight;
+    return *this;
+  }
+
+  // Weighted mean of the squared distances of p to the planes
+  double error(const glm::vec3 &p) const
+  {
+    const double x = p.x, y = p.y, z = p.z;
+    const auto e = a00 * x * x + a11 * y * y + a22 * z * z +
+                   2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                   2 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0 ? std::abs(e) / weight : 0;
+  }
+};
+
+enum class VertexKind : uint8_t
+{
+  Manifold, // Inside the surface, single attributes
+  Border, // On an open edge of the surface
+  Seam, // Two vertices with the same position on a closed surface
+  Locked // Anything else never moves
+};
+
+// Candidate collapse of vertex v0 onto vertex v1
+struct Collapse
+{
+  uint32_t v0;
+  uint32_t v1;
+  double error;
+};
+
+// remap[v] is the first vertex with the position of v, wedge[v] the next one
+// with that position (a cycle)
+void remapPositions(const std::vector<glm::vec3> &positions,
+    std::vector<uint32_t> &remap, std::vector<uint32_t> &wedge)
+{
+  // Bit patterns, so that NaNs don't break the sort
+  const auto bits = [&](uint32_t v) {
+    uint32_t b[3];
+    std::memcpy(b, &positions[v], sizeof(b));
+    return std::make_tuple(b[0], b[1], b[2]);
+  };
+  std::vector<uint32_t> order(positions.size());
+  std::iota(begin(order), end(order), 0);
+  std::sort(begin(order), end(order),
+      [&](uint32_t a, uint32_t b) { return bits(a) < bits(b) || (bits(a) == bits(b) && a < b); });
+
+  remap.resize(positions.size());
+  wedge.resize(positions.size());
+  for (size_t first = 0; first < order.size();) {
+    auto last = first + 1;
+    while (last < order.size() && bits(order[last]) == bits(order[first])) {
+      ++last;
+    }
+    for (auto i = first; i < last; ++i) {
+      remap[order[i]] = order[first];
+      wedge[order[i]] = order[i + 1 < last ? i + 1 : first];
+    }
+    first = last;
+  }
+}
+
+// openOut[v] is the vertex after v on the open edge leaving v (edge without
+// its opposite), openInc[v] the one before. NONE if there is none, v itself
+// if there are several.
+void findOpenEdges(const std::vector<uint32_t> &indices,
+    std::vector<uint32_t> &openInc, std::vector<uint32_t> &openOut)
+{
+  const auto key = [](uint32_t a, uint32_t b) { return uint64_t(a) << 32 | b; };
+  std::vector<uint64_t> edges;
+  edges.reserve(indices.size());
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    for (size_t e = 0; e < 3; ++e) {
+      edges.push_back(key(indices[i + e], indices[i + (e + 1) % 3]));
+    }
+  }
+  std::sort(begin(edges), end(edges));
+
+  const auto set = [](uint32_t &slot, uint32_t self, uint32_t other) {
+    slot = slot == NONE ? other : self;
+  };
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    for (size_t e = 0; e < 3; ++e) {
+      const auto a = indices[i + e];
+      const auto b = indices[i + (e + 1) % 3];
+      if (!std::binary_search(begin(edges), end(edges), key(b, a))) {
+        set(openOut[a], a, b);
+        set(openInc[b], b, a);
+      }
+    }
+  }
+}
+
+std::vector<VertexKind> classifyVertices(const std::vector<uint32_t> &remap,
+    const std::vector<uint32_t> &wedge, const std::vector<uint32_t> &openInc,
+    const std::vector<uint32_t> &openOut)
+{
+  const auto single = [](uint32_t link, uint32_t v) {
+    return link != NONE && link != v;
+  };
+  std::vector<VertexKind> kinds(remap.size(), VertexKind::Locked);
+  for (uint32_t v = 0; v < remap.size(); ++v) {
+    if (remap[v] != v) {
+      continue;
+    }
+    const auto w = wedge[v];
+    if (w == v) {
+      if (openInc[v] == NONE && openOut[v] == NONE) {
+        kinds[v] = VertexKind::Manifold;
+      } else if (single(openInc[v], v) && single(openOut[v], v)) {
+        kinds[v] = VertexKind::Border;
+      }
+    } else if (wedge[w] == v && single(openInc[v], v) &&
+               single(openOut[v], v) && single(openInc[w], w) &&
+               single(openOut[w], w) &&
+               remap[openOut[v]] == remap[openInc[w]] &&
+               remap[openInc[v]] == remap[openOut[w]]) {
+      // Both sides run along the same edges, in opposite directions
+      kinds[v] = VertexKind::Seam;
+    }
+  }
+  for (uint32_t v = 0; v < remap.size(); ++v) {
+    kinds[v] = kinds[remap[v]];
+  }
+  return kinds;
+}
+
+// Quadrics of the planes of the triangles around each vertex (by remap),
+// weighted by their area, and of planes perpendicular to the open edges
+std::vector<Quadric> computeQuadrics(const std::vector<uint32_t> &indices,
+    const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &remap,
+    const std::vector<uint32_t> &openOut)
+{
+  std::vector<Quadric> quadrics(positions.size());
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    const uint32_t v[3] = {indices[i], indices[i + 1], indices[i + 2]};
+    const auto &p0 = positions[v[0]];
+    auto normal = glm::cross(positions[v[1]] - p0, positions[v[2]] - p0);
+    const auto length = glm::length(normal);
+    if (length <= 0.f) {
+      continue;
+    }
+    normal /= length;
+    const auto q = Quadric::fromPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+    for (size_t k = 0; k < 3; ++k) {
+      quadrics[remap[v[k]]] += q;
+    }
+
+    for (size_t e = 0; e < 3; ++e) {
+      const auto a = v[e];
+      const auto b = v[(e + 1) % 3];
+      if (openOut[a] != b && openOut[a] != a) {
+        continue;
+      }
+      const auto edge = positions[b] - positions[a];
+      auto edgeNormal = glm::cross(edge, normal);
+      const auto edgeLength = glm::length(edgeNormal);
+      if (edgeLength <= 0.f) {
+        continue;
+      }
+      edgeNormal /= edgeLength;
+      const auto edgeQuadric = Quadric::fromPlane(edgeNormal,
+          -glm::dot(edgeNormal, positions[a]),
+          EDGE_WEIGHT * glm::dot(edge, edge));
+      quadrics[remap[a]] += edgeQuadric;
+      quadrics[remap[b]] += edgeQuadric;
+    }
+  }
+  return quadrics;
+}
+
+} // namespace
+
+std::vector<uint32_t> simplifyIndices(const std::vector<uint32_t> &indices,
+    const std::vector<glm::vec3> &positions, size_t targetIndexCount,
+    float maxError, float &error)
+{
+  error = 0.f;
+  auto result = indices;
+  result.resize(result.size() / 3 * 3);
+  const auto vertexCount = positions.size();
+  if (result.empty() ||
+      *std::max_element(begin(result), end(result)) >= vertexCount) {
+    return result;
+  }
+
+  std::vector<uint32_t> remap, wedge;
+  remapPositions(positions, remap, wedge);
+  std::vector<uint32_t> openInc(vertexCount, NONE), openOut(vertexCount, NONE);
+  findOpenEdges(result, openInc, openOut);
+  const auto kinds = classifyVertices(remap, wedge, openInc, openOut);
+  auto quadrics = computeQuadrics(result, positions, remap, openOut);
+
+  const auto canCollapse = [&](uint32_t v0, uint32_t v1) {
+    switch (kinds[v0]) {
+    case VertexKind::Manifold:
+      return true;
+    case VertexKind::Border:
+    case VertexKind::Seam:
+      return kinds[v1] == kinds[v0] && (openOut[v0] == v1 || openInc[v0] == v1);
+    default:
+      return false;
+    }
+  };
+
+  // Moving remap[v0] to the position of v1 turns a triangle around it over
+  std::vector<uint32_t> adjacencyOffsets, adjacency;
+  const auto hasFlips = [&](uint32_t r0, uint32_t v1) {
+    const auto r1 = remap[v1];
+    for (auto a = adjacencyOffsets[r0]; a < adjacencyOffsets[r0 + 1]; ++a) {
+      const auto t = adjacency[a];
+      uint32_t r[3] = {remap[result[t]], remap[result[t + 1]], remap[result[t + 2]]};
+      if (r[0] == r1 || r[1] == r1 || r[2] == r1) {
+        continue; // Removed by the collapse
+      }
+      glm::vec3 before[3], after[3];
+      for (size_t k = 0; k < 3; ++k) {
+        before[k] = positions[r[k]];
+        after[k] = r[k] == r0 ? positions[r1] : before[k];
+      }
+      const auto n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+      const auto n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+      if (glm::dot(n0, n1) <= 0.f) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // After v0 is gone, its open edge neighbours link to v1
+  const auto relinkOpenEdges = [&](uint32_t v0, uint32_t v1) {
+    if (openOut[v0] == v1) {
+      const auto prev = openInc[v0];
+      openInc[v1] = prev;
+      if (openOut[prev] == v0) {
+        openOut[prev] = v1;
+      }
+    } else if (openInc[v0] == v1) {
+      const auto next = openOut[v0];
+      openOut[v1] = next;
+      if (openInc[next] == v0) {
+        openInc[next] = v1;
+      }
+    }
+  };
+
+  const auto errorLimit = double(maxError) * maxError;
+  double resultError = 0;
+  std::vector<uint32_t> collapseRemap(vertexCount);
+  std::vector<bool> locked(vertexCount);
+  std::vector<Collapse> collapses;
+
+  while (result.size() > targetIndexCount) {
+    // Triangles around each vertex (by remap)
+    adjacencyOffsets.assign(vertexCount + 1, 0);
+    for (const auto v : result) {
+      ++adjacencyOffsets[remap[v] + 1];
+    }
+    std::partial_sum(begin(adjacencyOffsets), end(adjacencyOffsets), begin(adjacencyOffsets));
+    adjacency.resize(result.size());
+    {
+      auto next = adjacencyOffsets;
+      for (size_t i = 0; i < result.size(); ++i) {
+        adjacency[next[remap[result[i]]]++] = uint32_t(i / 3 * 3);
+      }
+    }
+
+    // Cheapest direction of each edge
+    collapses.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (size_t e = 0; e < 3; ++e) {
+        const auto a = result[i + e];
+        const auto b = result[i + (e + 1) % 3];
+        if (remap[a] == remap[b]) {
+          continue;
+        }
+        const auto errorAB = canCollapse(a, b) ? quadrics[remap[a]].error(positions[b])
+                                               : std::numeric_limits<double>::max();
+        const auto errorBA = canCollapse(b, a) ? quadrics[remap[b]].error(positions[a])
+                                               : std::numeric_limits<double>::max();
+        const auto best = errorAB <= errorBA ? Collapse{a, b, errorAB} : Collapse{b, a, errorBA};
+        if (best.error <= errorLimit) {
+          collapses.push_back(best);
+        }
+      }
+    }
+    if (collapses.empty()) {
+      break;
+    }
+    std::sort(begin(collapses), end(collapses),
+        [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+    // Each collapse removes two triangles (one on borders) and edges are
+    // listed twice: don't go much past what the goal needs, to keep
+    // the order of the errors across passes
+    const auto triangleGoal = (result.size() - targetIndexCount + 2) / 3;
+    const auto passLimit = 1.5 * collapses[std::min(triangleGoal, collapses.size()) - 1].error;
+
+    std::iota(begin(collapseRemap), end(collapseRemap), 0);
+    std::fill(begin(locked), end(locked), false);
+    size_t removed = 0;
+    size_t collapseCount = 0;
+    for (const auto &collapse : collapses) {
+      if (removed >= triangleGoal || (collapseCount && collapse.error > passLimit)) {
+        break;
+      }
+      const auto r0 = remap[collapse.v0];
+      const auto r1 = remap[collapse.v1];
+      if (locked[r0] || locked[r1] || hasFlips(r0, collapse.v1)) {
+        continue;
+      }
+
+      collapseRemap[collapse.v0] = collapse.v1;
+      relinkOpenEdges(collapse.v0, collapse.v1);
+      if (kinds[r0] == VertexKind::Seam) {
+        // The other side follows
+        const auto w0 = wedge[collapse.v0];
+        const auto w1 = wedge[collapse.v1];
+        collapseRemap[w0] = w1;
+        relinkOpenEdges(w0, w1);
+      }
+      quadrics[r1] += quadrics[r0];
+
+      // The triangles around r0 change, don't touch their vertices until
+      // the next pass
+      for (auto a = adjacencyOffsets[r0]; a < adjacencyOffsets[r0 + 1]; ++a) {
+        for (size_t k = 0; k < 3; ++k) {
+          locked[remap[result[adjacency[a] + k]]] = true;
+        }
+      }
+      locked[r1] = true;
+
+      removed += kinds[r0] == VertexKind::Border ? 1 : 2;
+      resultError = std::max(resultError, collapse.error);
+      ++collapseCount;
+    }
+    if (!collapseCount) {
+      break;
+    }
+
+    // Apply the collapses, drop the triangles that became degenerate
+    size_t count = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      const auto a = collapseRemap[result[i]];
+      const auto b = collapseRemap[result[i + 1]];
+      const auto c = collapseRemap[result[i + 2]];
+      if (remap[a] != remap[b] && remap[b] != remap[c] && remap[a] != remap[c]) {
+        result[count++] = a;
+        result[count++] = b;
+        result[count++] = c;
+      }
+    }
+    result.resize(count);
+  }
+
+  error = float(std::sqrt(resultError));
+  return result;
+}
+
+void generatePrimitiveLods(tinygltf::Model &model,
+    std::vector<BufferSpan> &bufferSpans, MeshLods &lods, ThreadPool &pool)
+{
+  struct Job
+  {
+    int32_t mesh;
+    int32_t primitive;
+    size_t vertexCount;
+    std::vector<std::vector<uint32_t>> levels;
+    std::vector<float> errors;
+  };
+  std::vector<Job> jobs;
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &mesh = model.meshes[meshIdx];
+    for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
+      const auto &primitive = mesh.primitives[primIdx];
+      // Morph targets move the vertices, the errors would not hold
+      if (primitive.mode == TINYGLTF_MODE_TRIANGLES && primitive.indices >= 0 &&
+          size_t(primitive.indices) < model.accessors.size() &&
+          model.accessors[primitive.indices].count / 3 >= MIN_TRIANGLES &&
+          primitive.targets.empty()) {
+        jobs.push_back({int32_t(meshIdx), int32_t(primIdx), 0, {}, {}});
+      }
+    }
+  }
+
+  pool.parallelFor(jobs.size(), [&](size_t jobIdx) {
+    auto &job = jobs[jobIdx];
+    const auto &primitive = model.meshes[job.mesh].primitives[job.primitive];
+    auto positions = readPositions(model, bufferSpans, primitive);
+    auto indices = readIndices(model, bufferSpans, model.accessors[primitive.indices]);
+    indices.resize(indices.size() / 3 * 3);
+    if (positions.empty() || indices.empty() ||
+        *std::max_element(begin(indices), end(indices)) >= positions.size()) {
+      return;
+    }
+    job.vertexCount = positions.size();
+
+    // Errors relative to the bounding radius, the same for all primitives
+    glm::vec3 bboxMin(std::numeric_limits<float>::max());
+    glm::vec3 bboxMax(std::numeric_limits<float>::lowest());
+    for (const auto &p : positions) {
+      bboxMin = glm::min(bboxMin, p);
+      bboxMax = glm::max(bboxMax, p);
+    }
+    const auto center = 0.5f * (bboxMin + bboxMax);
+    const auto radius = 0.5f * glm::length(bboxMax - bboxMin);
+    if (!(radius > 0.f)) {
+      return;
+    }
+    for (auto &p : positions) {
+      p = (p - center) / radius;
+    }
+
+    // Each level from the previous one, the errors add up
+    auto totalError = 0.f;
+    while (indices.size() / 3 > MIN_LOD_TRIANGLES) {
+      const auto target = std::max(indices.size() / 6, MIN_LOD_TRIANGLES) * 3;
+      float levelError = 0.f;
+      auto simplified = simplifyIndices(
+          indices, positions, target, MAX_LOD_ERROR - totalError, levelError);
+      if (simplified.size() > MIN_REDUCTION * indices.size()) {
+        break;
+      }
+      totalError += levelError;
+      job.levels.push_back(simplified);
+      job.errors.push_back(totalError);
+      indices = std::move(simplified);
+    }
+  });
+
+  tinygltf::Buffer lodBuffer;
+  std::vector<tinygltf::Accessor> accessors;
+  for (const auto &job : jobs) {
+    for (size_t level = 0; level < job.levels.size(); ++level) {
+      lods.primitives.push_back({job.mesh, job.primitive,
+          int32_t(model.accessors.size() + accessors.size()), job.errors[level]});
+      accessors.push_back(appendIndices(lodBuffer.data, job.levels[level], job.vertexCount));
+    }
+  }
+  if (accessors.empty()) {
+    return;
+  }
+
+  tinygltf::BufferView bufferView;
+  bufferView.buffer = int(model.buffers.size());
+  bufferView.byteLength = lodBuffer.data.size();
+  bufferView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+  // Buffers are moved (not copied) on reallocation, other spans stay valid
+  model.buffers.push_back(std::move(lodBuffer));
+  bufferSpans.push_back({model.buffers.back().data.data(), model.buffers.back().data.size()});
+  for (auto &accessor : accessors) {
+    accessor.bufferView = int(model.bufferViews.size());
+    model.accessors.push_back(accessor);
+  }
+  model.bufferViews.push_back(bufferView);
+}
+
+void readNodeLods(const tinygltf::Model &model, MeshLods &lods)
+{
+  const auto nodeCount = int(model.nodes.size());
+  const auto hasLods = [&](const tinygltf::Node &node) {
+    return node.extensions.count("MSFT_lod") != 0;
+  };
+  for (int nodeIdx = 0; nodeIdx < nodeCount; ++nodeIdx) {
+    const auto &node = model.nodes[nodeIdx];
+    if (!hasLods(node)) {
+      continue;
+    }
+    const auto &ids = node.extensions.at("MSFT_lod").Get("ids");
+    std::vector<int32_t> levels{nodeIdx};
+    for (size_t i = 0; ids.IsArray() && i < ids.ArrayLen(); ++i) {
+      const auto &id = ids.Get(int(i));
+      // Nested levels are not allowed by the spec
+      if (id.IsInt() && id.Get<int>() >= 0 && id.Get<int>() < nodeCount &&
+          !hasLods(model.nodes[id.Get<int>()])) {
+        levels.push_back(id.Get<int>());
+      }
+    }
+    if (levels.size() < 2) {
+      continue;
+    }
+
+    // Minimum coverage of each level, the last one culls. Without them
+    // halve the coverage at each level and never cull.
+    std::vector<float> coverages;
+    const auto &extras = node.extras.Get("MSFT_screencoverage");
+    for (size_t i = 0; extras.IsArray() && i < extras.ArrayLen(); ++i) {
+      const auto &value = extras.Get(int(i));
+      if (value.IsNumber()) {
+        coverages.push_back(float(value.GetNumberAsDouble()));
+      }
+    }
+    for (size_t level = 0; level < levels.size(); ++level) {
+      auto coverage = level + 1 < levels.size() ? 0.5f / float(1 << level) : 0.f;
+      if (level < coverages.size()) {
+        coverage = coverages[level];
+      }
+      lods.nodes.push_back({nodeIdx, levels[level], coverage});
+    }
+  }
+}
+
+std::vector<std::vector<LodRange>> getPrimitiveLodRanges(
+    const tinygltf::Model &model, const MeshLods &lods)
+{
+  std::vector<std::vector<LodRange>> ranges(model.meshes.size());
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    ranges[meshIdx].resize(model.meshes[meshIdx].primitives.size());
+  }
+  for (size_t i = 0; i < lods.primitives.size(); ++i) {
+    const auto &lod = lods.primitives[i];
+    if (lod.mesh < 0 || size_t(lod.mesh) >= ranges.size() || lod.primitive < 0 ||
+        size_t(lod.primitive) >= ranges[lod.mesh].size() || lod.indices < 0 ||
+        size_t(lod.indices) >= model.accessors.size()) {
+      continue;
+    }
+    auto &range = ranges[lod.mesh][lod.primitive];
+    if (!range.count) {
+      range.begin = i;
+    }
+    if (range.begin + range.count == i) {
+      ++range.count; // Only the first group if they are not contiguous
+    }
+  }
+  return ranges;
+}
+
+std::vector<LodRange> getNodeLodRanges(
+    const tinygltf::Model &model, const MeshLods &lods)
+{
+  std::vector<LodRange> ranges(model.nodes.size());
+  for (size_t i = 0; i < lods.nodes.size(); ++i) {
+    const auto &lod = lods.nodes[i];
+    if (lod.node < 0 || size_t(lod.node) >= ranges.size() || lod.lodNode < 0 ||
+        size_t(lod.lodNode) >= ranges.size()) {
+      continue;
+    }
+    auto &range = ranges[lod.node];
+    if (!range.count) {
+      range.begin = i;
+    }
+    if (range.begin + range.count == i) {
+      ++range.count;
+    }
+  }
+  return ranges;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Simplified index buffer of a primitive, drawn with the vertices of the full
+// resolution one
+struct PrimitiveLod
+{
+  int32_t mesh;
+  int32_t primitive;
+  int32_t indices; // Accessor
+  // Geometric error, relative to the bounding radius of the primitive
+  float error;
+};
+
+// Level of a node with MSFT_lod: lodNode is drawn instead of node when the
+// node covers at least screenCoverage of the screen (and no finer level
+// does)
+struct NodeLod
+{
+  int32_t node;
+  int32_t lodNode;
+  float screenCoverage;
+};
+
+// Hierarchical level of detail: a single mesh replacing a node and all its
+// descendants when they are small on screen
+struct HlodProxy
+{
+  int32_t node;
+  int32_t mesh; // Drawn with the matrix of node
+  // Geometric error, relative to the bounding radius of the mesh
+  float error;
+};
+
+struct MeshLods
+{
+  // Grouped by primitive, by increasing error
+  std::vector<PrimitiveLod> primitives;
+  // Grouped by node, finest level (the node itself) first
+  std::vector<NodeLod> nodes;
+  std::vector<HlodProxy> proxies;
+};
+
+struct LodRange
+{
+  size_t begin = 0; // In MeshLods::primitives or MeshLods::nodes
+  size_t count = 0;
+};
+
+// Quadric error simplification: collapse edges of the triangles of indices
+// onto one of their vertices, cheapest first, until targetIndexCount indices
+// are left or the next collapse would move the surface further than
+// maxError. Vertices with the same position but different attributes (UV
+// seams) move together, borders and seams only collapse along themselves.
+// error is set to the error of the result, in the units of positions.
+std::vector<uint32_t> simplifyIndices(const std::vector<uint32_t> &indices,
+    const std::vector<glm::vec3> &positions, size_t targetIndexCount,
+    float maxError, float &error);
+
+// Chain of simplified levels for the big indexed triangle primitives, each
+// with about half the triangles of the previous one, computed in parallel.
+// Index data goes in a buffer appended to model.buffers (and bufferSpans),
+// it is not bound for drawing: the levels are copied next to the indices of
+// their primitive, in the element buffer of its VAO.
+void generatePrimitiveLods(tinygltf::Model &model,
+    std::vector<BufferSpan> &bufferSpans, MeshLods &lods, ThreadPool &pool);
+
+// Read the MSFT_lod levels of the nodes, with the thresholds of their
+// MSFT_screencoverage extras
+void readNodeLods(const tinygltf::Model &model, MeshLods &lods);
+
+// [mesh][primitive]
+std::vector<std::vector<LodRange>> getPrimitiveLodRanges(
+    const tinygltf::Model &model, const MeshLods &lods);
+
+// [node]
+std::vector<LodRange> getNodeLodRanges(
+    const tinygltf::Model &model, const MeshLods &lods);
+
+// Coarsest level of range whose error stays under maxPixelError for a
+// primitive of radiusInPixels on screen, -1 for the full resolution
+inline int selectPrimitiveLod(const MeshLods &lods, const LodRange &range,
+    float radiusInPixels, float maxPixelError)
+{
+  int selected = -1;
+  for (size_t i = range.begin; i < range.begin + range.count; ++i) {
+    if (lods.primitives[i].error * radiusInPixels > maxPixelError) {
+      break;
+    }
+    selected = int(i);
+  }
+  return selected;
+}
+
+// Node to draw for a node covering coverage of the screen, -1 for none
+inline int selectNodeLod(
+    const MeshLods &lods, const LodRange &range, float coverage)
+{
+  for (size_t i = range.begin; i < range.begin + range.count; ++i) {
+    if (coverage >= lods.nodes[i].screenCoverage) {
+      return lods.nodes[i].lodNode;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,148 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+void computeBounds(Meshlet &meshlet, const std::vector<uint32_t> &indices,
+    const std::vector<glm::vec3> &positions)
+{
+  const auto first = meshlet.firstIndex;
+  const auto last = meshlet.firstIndex + meshlet.indexCount;
+
+  // Sphere around the center of the box, good enough for small clusters
+  glm::vec3 bboxMin(std::numeric_limits<float>::max());
+  glm::vec3 bboxMax(std::numeric_limits<float>::lowest());
+  for (auto i = first; i < last; ++i) {
+    bboxMin = glm::min(bboxMin, positions[indices[i]]);
+    bboxMax = glm::max(bboxMax, positions[indices[i]]);
+  }
+  meshlet.center = 0.5f * (bboxMin + bboxMax);
+  meshlet.radius = 0.f;
+  for (auto i = first; i < last; ++i) {
+    meshlet.radius =
+        std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+  }
+
+  // Cone around the average of the triangle normals
+  std::vector<glm::vec3> normals;
+  glm::vec3 axis(0.f);
+  for (auto i = first; i + 2 < last; i += 3) {
+    const auto &p0 = positions[indices[i]];
+    const auto &p1 = positions[indices[i + 1]];
+    const auto &p2 = positions[indices[i + 2]];
+    const auto n = glm::cross(p1 - p0, p2 - p0);
+    const auto length = glm::length(n);
+    if (length > 0.f) {
+      normals.push_back(n / length);
+      axis += n;
+    }
+  }
+  meshlet.coneAxis = glm::vec3(0.f);
+  meshlet.coneCutoff = 2.f; // Never back facing
+  const auto axisLength = glm::length(axis);
+  if (axisLength <= 0.f || normals.empty()) {
+    return;
+  }
+  axis /= axisLength;
+  auto minDot = 1.f;
+  for (const auto &n : normals) {
+    minDot = std::min(minDot, glm::dot(n, axis));
+  }
+  if (minDot <= 0.f) {
+    return; // Spread over more than a half sphere
+  }
+  meshlet.coneAxis = axis;
+  meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+}
+
+} // namespace
+
+Meshlets buildMeshlets(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, const QuantizedVertices &vertices,
+    size_t maxVertices, size_t maxTriangles, size_t minTriangles)
+{
+  Meshlets meshlets;
+  meshlets.primitives.resize(model.meshes.size());
+
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &mesh = model.meshes[meshIdx];
+    meshlets.primitives[meshIdx].resize(mesh.primitives.size());
+    for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
+      const auto &primitive = mesh.primitives[primIdx];
+      const auto &quantized = vertices.primitives[meshIdx][primIdx];
+      if (primitive.mode != TINYGLTF_MODE_TRIANGLES || primitive.indices < 0 ||
+          size_t(primitive.indices) >= model.accessors.size() ||
+          !quantized.vertexCount) {
+        continue;
+      }
+      auto indices = readIndices(model, buffers, model.accessors[primitive.indices]);
+      indices.resize(indices.size() / 3 * 3);
+      if (indices.size() / 3 <= minTriangles ||
+          *std::max_element(begin(indices), end(indices)) >= quantized.vertexCount) {
+        continue;
+      }
+
+      const auto first = vertices.getVertices(buffers, quantized);
+      std::vector<glm::vec3> positions(quantized.vertexCount);
+      for (size_t i = 0; i < positions.size(); ++i) {
+        positions[i] = quantized.dequantize(first[i]);
+      }
+
+      auto &range = meshlets.primitives[meshIdx][primIdx];
+      range.begin = meshlets.meshlets.size();
+
+      // Greedy: add triangles until one of the limits is reached
+      std::vector<uint32_t> meshletOf(quantized.vertexCount, uint32_t(-1));
+      Meshlet current{0, 0, {}, 0.f, {}, 0.f};
+      size_t vertexCount = 0;
+      const auto close = [&]() {
+        computeBounds(current, indices, positions);
+        meshlets.meshlets.push_back(current);
+      };
+      for (size_t i = 0; i < indices.size(); i += 3) {
+        size_t newVertices = 0;
+        for (size_t k = 0; k < 3; ++k) {
+          newVertices += meshletOf[indices[i + k]] != meshlets.meshlets.size();
+        }
+        if (vertexCount + newVertices > maxVertices ||
+            current.indexCount / 3 + 1 > maxTriangles) {
+          close();
+          current = Meshlet{uint32_t(i), 0, {}, 0.f, {}, 0.f};
+          vertexCount = 0;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+          auto &owner = meshletOf[indices[i + k]];
+          if (owner != meshlets.meshlets.size()) {
+            owner = uint32_t(meshlets.meshlets.size());
+            ++vertexCount;
+          }
+        }
+        current.indexCount += 3;
+      }
+      close();
+      range.count = meshlets.meshlets.size() - range.begin;
+    }
+  }
+
+  return meshlets;
+}
+
+Frustum Frustum::fromProjection(const glm::mat4 &projMatrix)
+{
+  // Gribb & Hartmann: planes are sums of the rows of the projection matrix
+  const auto row = [&](int i) {
+    return glm::vec4(projMatrix[0][i], projMatrix[1][i], projMatrix[2][i], projMatrix[3][i]);
+  };
+  Frustum frustum;
+  for (int i = 0; i < 3; ++i) {
+    frustum.planes[2 * i] = row(3) + row(i);
+    frustum.planes[2 * i + 1] = row(3) - row(i);
+  }
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "vertex_quantizer.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Run of consecutive triangles in the index buffer of a primitive, with the
+// bounds needed to cull it
+struct Meshlet
+{
+  uint32_t firstIndex; // In the index accessor of the primitive
+  uint32_t indexCount;
+  // Bounding sphere, in mesh space
+  glm::vec3 center;
+  float radius;
+  // Normal cone: every triangle faces away from a viewer in the cone of
+  // axis coneAxis and angle asin(coneCutoff) around it. coneCutoff > 1 if the
+  // normals are too spread for that.
+  glm::vec3 coneAxis;
+  float coneCutoff;
+};
+
+struct MeshletRange
+{
+  size_t begin = 0; // In Meshlets::meshlets
+  size_t count = 0; // 0 if the primitive is drawn in a single call
+};
+
+struct Meshlets
+{
+  std::vector<Meshlet> meshlets;
+  std::vector<std::vector<MeshletRange>> primitives; // [mesh][primitive]
+};
+
+// Cut the indexed triangle primitives of more than minTriangles triangles in
+// meshlets of at most maxVertices distinct vertices and maxTriangles
+// triangles, following the order of their index buffer (so better after
+// optimizeIndices).
+Meshlets buildMeshlets(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, const QuantizedVertices &vertices,
+    size_t maxVertices = 64, size_t maxTriangles = 124,
+    size_t minTriangles = 1024);
+
+// View frustum as 6 normalized planes in view space, inside is positive
+struct Frustum
+{
+  glm::vec4 planes[6];
+
+  static Frustum fromProjection(const glm::mat4 &projMatrix);
+
+  bool intersectsSphere(const glm::vec3 &center, float radius) const
+  {
+    for (const auto &plane : planes) {
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+// True if all triangles of meshlet face away from cameraPosition, given in
+// mesh space (back face culling is invariant by affine transforms)
+inline bool isMeshletBackFacing(
+    const Meshlet &meshlet, const glm::vec3 &cameraPosition)
+{
+  const auto toCenter = meshlet.center - cameraPosition;
+  return glm::dot(toCenter, meshlet.coneAxis) >=
+         meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
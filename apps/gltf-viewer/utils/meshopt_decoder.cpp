@@ -0,0 +1,629 @@
+#include "meshopt_decoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHOPT_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MESHOPT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+const unsigned char VERTEX_HEADER = 0xa0;
+const unsigned char INDEX_HEADER = 0xe0;
+const unsigned char SEQUENCE_HEADER = 0xd0;
+
+const size_t BYTE_GROUP_SIZE = 16;
+const size_t BYTE_GROUP_DECODE_LIMIT = 24; // Header bytes + 16 escaped values
+const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+const size_t TAIL_MAX_SIZE = 32;
+
+// Vertex codec
+
+size_t getVertexBlockSize(size_t vertexSize)
+{
+  // Whole block must fit in VERTEX_BLOCK_SIZE_BYTES, in full byte groups
+  const auto size = (VERTEX_BLOCK_SIZE_BYTES / vertexSize) & ~(BYTE_GROUP_SIZE - 1);
+  return std::min(size, VERTEX_BLOCK_MAX_SIZE);
+}
+
+// One group of 16 bytes packed on 0, 2, 4 or 8 bits. With 2 and 4 bits the
+// maximum value means that the byte is stored after the packed ones.
+const unsigned char *decodeBytesGroup(
+    const unsigned char *data, unsigned char *out, int bitsLog2)
+{
+  switch (bitsLog2) {
+  case 0:
+    std::memset(out, 0, BYTE_GROUP_SIZE);
+    return data;
+  case 1:
+  case 2: {
+    const int bits = 1 << bitsLog2;
+    const unsigned escape = (1u << bits) - 1;
+    const auto packedSize = BYTE_GROUP_SIZE * bits / 8;
+    const unsigned char *extra = data + packedSize;
+    for (size_t i = 0; i < BYTE_GROUP_SIZE; ++i) {
+      const unsigned byte = data[i * bits / 8];
+      const auto shift = 8 - bits - (i * bits) % 8; // Most significant first
+      const auto value = (byte >> shift) & escape;
+      out[i] = value == escape ? *extra++ : (unsigned char)value;
+    }
+    return extra;
+  }
+  default:
+    std::memcpy(out, data, BYTE_GROUP_SIZE);
+    return data + BYTE_GROUP_SIZE;
+  }
+}
+
+const unsigned char *decodeBytes(const unsigned char *data,
+    const unsigned char *dataEnd, unsigned char *out, size_t size)
+{
+  // 2 bits per group in the header for the group encoding
+  const auto header = data;
+  const auto headerSize = (size / BYTE_GROUP_SIZE + 3) / 4;
+  if (size_t(dataEnd - data) < headerSize) {
+    return nullptr;
+  }
+  data += headerSize;
+
+  for (size_t i = 0; i < size; i += BYTE_GROUP_SIZE) {
+    const auto group = i / BYTE_GROUP_SIZE;
+    const int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+    if (size_t(dataEnd - data) >= BYTE_GROUP_DECODE_LIMIT) {
+      data = decodeBytesGroup(data, out + i, bitsLog2);
+    } else {
+      // Near the end, decode from a padded copy to stay in bounds
+      unsigned char padded[BYTE_GROUP_DECODE_LIMIT] = {};
+      std::memcpy(padded, data, dataEnd - data);
+      const auto consumed = size_t(decodeBytesGroup(padded, out + i, bitsLog2) - padded);
+      if (consumed > size_t(dataEnd - data)) {
+        return nullptr;
+      }
+      data += consumed;
+    }
+  }
+  return data;
+}
+
+// Bytes are zigzag encoded deltas with the previous vertex: turn count of
+// them (a multiple of 16) into values, starting from previous
+void decodeDeltas(unsigned char *bytes, size_t count, unsigned char previous)
+{
+#if MESHOPT_SSE2
+  auto p = _mm_set1_epi8(char(previous));
+  for (size_t i = 0; i < count; i += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+    const auto sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi8(1)));
+    v = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7f)), sign);
+    // Prefix sum in log steps
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi8(v, p);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(bytes + i), v);
+    p = _mm_set1_epi8(char(bytes[i + 15]));
+  }
+#elif MESHOPT_NEON
+  auto p = vdupq_n_u8(previous);
+  const auto zero = vdupq_n_u8(0);
+  for (size_t i = 0; i < count; i += 16) {
+    auto v = vld1q_u8(bytes + i);
+    const auto sign = vsubq_u8(zero, vandq_u8(v, vdupq_n_u8(1)));
+    v = veorq_u8(vshrq_n_u8(v, 1), sign);
+    v = vaddq_u8(v, vextq_u8(zero, v, 15));
+    v = vaddq_u8(v, vextq_u8(zero, v, 14));
+    v = vaddq_u8(v, vextq_u8(zero, v, 12));
+    v = vaddq_u8(v, vextq_u8(zero, v, 8));
+    v = vaddq_u8(v, p);
+    vst1q_u8(bytes + i, v);
+    p = vdupq_n_u8(bytes[i + 15]);
+  }
+#else
+  for (size_t i = 0; i < count; ++i) {
+    const unsigned char v = bytes[i];
+    previous = (unsigned char)(previous + ((v >> 1) ^ (0 - (v & 1))));
+    bytes[i] = previous;
+  }
+#endif
+}
+
+// Vertices of a block are stored byte k of all vertices, then byte k + 1...
+const unsigned char *decodeVertexBlock(const unsigned char *data,
+    const unsigned char *dataEnd, unsigned char *out, size_t count,
+    size_t vertexSize, unsigned char *lastVertex)
+{
+  unsigned char bytes[VERTEX_BLOCK_MAX_SIZE];
+  const auto alignedCount = (count + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+
+  for (size_t k = 0; k < vertexSize; ++k) {
+    data = decodeBytes(data, dataEnd, bytes, alignedCount);
+    if (!data) {
+      return nullptr;
+    }
+    decodeDeltas(bytes, alignedCount, lastVertex[k]);
+    for (size_t i = 0; i < count; ++i) {
+      out[i * vertexSize + k] = bytes[i];
+    }
+    lastVertex[k] = bytes[count - 1];
+  }
+  return data;
+}
+
+// Index codecs
+
+unsigned decodeVByte(const unsigned char *&data)
+{
+  const unsigned char lead = *data++;
+  if (lead < 128) {
+    return lead;
+  }
+  unsigned result = lead & 127;
+  unsigned shift = 7;
+  for (int i = 0; i < 4; ++i) {
+    const unsigned char group = *data++;
+    result |= unsigned(group & 127) << shift;
+    shift += 7;
+    if (group < 128) {
+      break;
+    }
+  }
+  return result;
+}
+
+unsigned decodeIndex(const unsigned char *&data, unsigned last)
+{
+  const auto v = decodeVByte(data);
+  return last + ((v >> 1) ^ (0u - (v & 1)));
+}
+
+void writeIndex(unsigned char *destination, size_t i, size_t stride, unsigned index)
+{
+  if (stride == 2) {
+    const auto narrow = uint16_t(index);
+    std::memcpy(destination + 2 * i, &narrow, 2);
+  } else {
+    std::memcpy(destination + 4 * i, &index, 4);
+  }
+}
+
+// Triangle codec state: the last 16 edges and vertices
+struct IndexFifos
+{
+  unsigned edges[16][2];
+  unsigned vertices[16];
+  size_t edgeOffset = 0;
+  size_t vertexOffset = 0;
+
+  IndexFifos()
+  {
+    std::memset(edges, -1, sizeof(edges));
+    std::memset(vertices, -1, sizeof(vertices));
+  }
+
+  void pushEdge(unsigned a, unsigned b)
+  {
+    edges[edgeOffset][0] = a;
+    edges[edgeOffset][1] = b;
+    edgeOffset = (edgeOffset + 1) & 15;
+  }
+
+  void pushVertex(unsigned v, bool condition = true)
+  {
+    vertices[vertexOffset] = v;
+    vertexOffset = (vertexOffset + condition) & 15;
+  }
+};
+
+// Filters
+
+template <typename T> void decodeOctahedral(T *data, size_t count, size_t stride)
+{
+  const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+  const auto step = stride / sizeof(T);
+  for (size_t i = 0; i < count; ++i, data += step) {
+    // x and y are the octahedral coordinates, z holds the scale of 1
+    auto x = float(data[0]);
+    auto y = float(data[1]);
+    const auto z = float(data[2]) - std::abs(x) - std::abs(y);
+    const auto t = std::min(z, 0.f);
+    x += x >= 0.f ? t : -t;
+    y += y >= 0.f ? t : -t;
+    const auto s = max / std::sqrt(x * x + y * y + z * z);
+    data[0] = T(std::lround(x * s));
+    data[1] = T(std::lround(y * s));
+    data[2] = T(std::lround(z * s));
+  }
+}
+
+} // namespace
+
+bool decodeMeshoptVertexBuffer(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size)
+{
+  if (stride == 0 || stride > 256 || stride % 4 != 0) {
+    return false;
+  }
+  const auto dataEnd = data + size;
+  if (size < 1 + stride || (data[0] & 0xf0) != VERTEX_HEADER ||
+      (data[0] & 0x0f) > 0) {
+    return false;
+  }
+  ++data;
+
+  // Deltas of the first vertex are relative to the tail
+  unsigned char lastVertex[256];
+  std::memcpy(lastVertex, dataEnd - stride, stride);
+
+  const auto blockSize = getVertexBlockSize(stride);
+  for (size_t offset = 0; offset < count; offset += blockSize) {
+    const auto blockCount = std::min(blockSize, count - offset);
+    data = decodeVertexBlock(data, dataEnd, destination + offset * stride,
+        blockCount, stride, lastVertex);
+    if (!data) {
+      return false;
+    }
+  }
+
+  return size_t(dataEnd - data) == std::max(stride, TAIL_MAX_SIZE);
+}
+
+bool decodeMeshoptIndexBuffer(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size)
+{
+  if (count % 3 != 0 || (stride != 2 && stride != 4)) {
+    return false;
+  }
+  // Header, one code per triangle and a table of 16 codes at the end
+  if (size < 1 + count / 3 + 16 || (data[0] & 0xf0) != INDEX_HEADER) {
+    return false;
+  }
+  const int version = data[0] & 0x0f;
+  if (version > 1) {
+    return false;
+  }
+
+  IndexFifos fifos;
+  unsigned next = 0; // Next new vertex
+  unsigned last = 0; // Last free index, the next one is a delta from it
+  const unsigned fecMax = version >= 1 ? 13 : 15;
+
+  const unsigned char *code = data + 1;
+  const unsigned char *extra = code + count / 3;
+  const unsigned char *extraEnd = data + size - 16; // Each triangle reads at most 16 bytes
+  const unsigned char *codeAuxTable = extraEnd;
+
+  for (size_t i = 0; i < count; i += 3) {
+    if (extra > extraEnd) {
+      return false;
+    }
+    const unsigned char codeTri = *code++;
+    unsigned a, b, c;
+
+    if (codeTri < 0xf0) {
+      // Triangle on a recent edge, c is new, recent or free
+      const auto fe = codeTri >> 4;
+      a = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][0];
+      b = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][1];
+      const unsigned fec = codeTri & 15;
+      if (fec < fecMax) {
+        c = fec == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - 1 - fec) & 15];
+        fifos.pushVertex(c, fec == 0);
+      } else {
+        // 13 and 14 are -1 and +1 from the last free index
+        last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decodeIndex(extra, last);
+        fifos.pushVertex(c);
+      }
+      fifos.pushEdge(c, b);
+      fifos.pushEdge(a, c);
+    } else {
+      // Triangle without a recent edge
+      unsigned feb, fec;
+      if (codeTri < 0xfe) {
+        const unsigned char codeAux = codeAuxTable[codeTri & 15];
+        feb = codeAux >> 4;
+        fec = codeAux & 15;
+        a = next++;
+        b = feb == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - feb) & 15];
+        c = fec == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - fec) & 15];
+      } else {
+        const unsigned char codeAux = *extra++;
+        const unsigned fea = codeTri == 0xfe ? 0 : 15;
+        feb = codeAux >> 4;
+        fec = codeAux & 15;
+        if (codeAux == 0) {
+          next = 0; // Restart
+        }
+        a = fea == 0 ? next++ : 0;
+        b = feb == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - feb) & 15];
+        c = fec == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - fec) & 15];
+        if (fea == 15) {
+          last = a = decodeIndex(extra, last);
+        }
+        if (feb == 15) {
+          last = b = decodeIndex(extra, last);
+        }
+        if (fec == 15) {
+          last = c = decodeIndex(extra, last);
+        }
+      }
+      fifos.pushVertex(a);
+      fifos.pushVertex(b, feb == 0 || feb == 15);
+      fifos.pushVertex(c, fec == 0 || fec == 15);
+      fifos.pushEdge(b, a);
+      fifos.pushEdge(c, b);
+      fifos.pushEdge(a, c);
+    }
+
+    writeIndex(destination, i, stride, a);
+    writeIndex(destination, i + 1, stride, b);
+    writeIndex(destination, i + 2, stride, c);
+  }
+
+  return extra == extraEnd;
+}
+
+bool decodeMeshoptIndexSequence(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size)
+{
+  if (stride != 2 && stride != 4) {
+    return false;
+  }
+  // Header, at least one byte per index and a 4 byte tail
+  if (size < 1 + count + 4 || (data[0] & 0xf0) != SEQUENCE_HEADER ||
+      (data[0] & 0x0f) > 1) {
+    return false;
+  }
+  const unsigned char *extra = data + 1;
+  const unsigned char *extraEnd = data + size - 4;
+
+  // Each index is a delta from one of two baselines, chosen by the low bit
+  unsigned last[2] = {0, 0};
+  for (size_t i = 0; i < count; ++i) {
+    if (extra >= extraEnd) {
+      return false;
+    }
+    const auto v = decodeVByte(extra);
+    const auto delta = v >> 1;
+    auto &baseline = last[v & 1];
+    baseline += (delta >> 1) ^ (0u - (delta & 1));
+    writeIndex(destination, i, stride, baseline);
+  }
+
+  return extra == extraEnd;
+}
+
+void decodeMeshoptOctahedralFilter(unsigned char *data, size_t count, size_t stride)
+{
+  if (stride == 4) {
+    decodeOctahedral(reinterpret_cast<int8_t *>(data), count, stride);
+  } else if (stride == 8) {
+    decodeOctahedral(reinterpret_cast<int16_t *>(data), count, stride);
+  }
+}
+
+void decodeMeshoptQuaternionFilter(unsigned char *data, size_t count, size_t stride)
+{
+  if (stride != 8) {
+    return;
+  }
+  const float scale = 1.f / std::sqrt(2.f);
+  auto q = reinterpret_cast<int16_t *>(data);
+  for (size_t i = 0; i < count; ++i, q += 4) {
+    // The 4th component stores the scale and which component was dropped
+    const int sf = q[3] | 3;
+    const auto ss = scale / float(sf);
+    const auto x = float(q[0]) * ss;
+    const auto y = float(q[1]) * ss;
+    const auto z = float(q[2]) * ss;
+    const auto w = std::sqrt(std::max(1.f - x * x - y * y - z * z, 0.f));
+    const int qc = q[3] & 3;
+    q[(qc + 1) & 3] = int16_t(std::lround(x * 32767.f));
+    q[(qc + 2) & 3] = int16_t(std::lround(y * 32767.f));
+    q[(qc + 3) & 3] = int16_t(std::lround(z * 32767.f));
+    q[(qc + 0) & 3] = int16_t(std::lround(w * 32767.f));
+  }
+}
+
+void decodeMeshoptExponentialFilter(unsigned char *data, size_t count, size_t stride)
+{
+  // Each 32 bits value is a 24 bits mantissa and an 8 bits exponent
+  const auto valueCount = count * stride / 4;
+  size_t i = 0;
+#if MESHOPT_SSE2
+  for (; i + 4 <= valueCount; i += 4) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 4 * i));
+    const auto m = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+    const auto e = _mm_srai_epi32(v, 24);
+    const auto exponent = _mm_castsi128_ps(
+        _mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+    _mm_storeu_ps(reinterpret_cast<float *>(data + 4 * i),
+        _mm_mul_ps(_mm_cvtepi32_ps(m), exponent));
+  }
+#elif MESHOPT_NEON
+  for (; i + 4 <= valueCount; i += 4) {
+    const auto v = vld1q_s32(reinterpret_cast<const int32_t *>(data + 4 * i));
+    const auto m = vshrq_n_s32(vshlq_n_s32(v, 8), 8);
+    const auto e = vshrq_n_s32(v, 24);
+    const auto exponent = vreinterpretq_f32_s32(
+        vshlq_n_s32(vaddq_s32(e, vdupq_n_s32(127)), 23));
+    vst1q_f32(reinterpret_cast<float *>(data + 4 * i),
+        vmulq_f32(vcvtq_f32_s32(m), exponent));
+  }
+#endif
+  for (; i < valueCount; ++i) {
+    int32_t v;
+    std::memcpy(&v, data + 4 * i, 4);
+    const auto m = int32_t(uint32_t(v) << 8) >> 8;
+    const auto e = v >> 24;
+    const auto exponent = uint32_t(e + 127) << 23;
+    float f;
+    std::memcpy(&f, &exponent, 4);
+    f *= float(m);
+    std::memcpy(data + 4 * i, &f, 4);
+  }
+}
+
+void MeshoptDecompressor::apply(
+    nlohmann::json &gltf, VirtualFileSystem &vfs, const std::string &baseDir)
+{
+  static const unsigned char placeholder[1] = {0};
+  const char *const extensionName = "EXT_meshopt_compression";
+
+  if (!gltf.count("bufferViews")) {
+    return;
+  }
+  auto &bufferViews = gltf["bufferViews"];
+  for (size_t i = 0; i < bufferViews.size(); ++i) {
+    const auto &bufferView = bufferViews[i];
+    if (!bufferView.count("extensions") ||
+        !bufferView["extensions"].count(extensionName)) {
+      continue;
+    }
+    const auto &extension = bufferView["extensions"][extensionName];
+    m_bufferViews.push_back({i, extension.value("buffer", -1),
+        extension.value("byteOffset", size_t(0)),
+        extension.value("byteLength", size_t(0)),
+        extension.value("byteStride", size_t(0)), extension.value("count", size_t(0)),
+        extension.value("mode", std::string()),
+        extension.value("filter", std::string("NONE"))});
+  }
+
+  // Fallback buffers only hold data for loaders without the extension, we
+  // don't read it
+  if (m_bufferViews.empty() || !gltf.count("buffers")) {
+    return;
+  }
+  auto &buffers = gltf["buffers"];
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    auto &buffer = buffers[i];
+    if (!buffer.count("extensions") ||
+        !buffer["extensions"].count(extensionName) ||
+        !buffer["extensions"][extensionName].value("fallback", false)) {
+      continue;
+    }
+    m_fallbackBuffers.push_back({i, buffer.value("byteLength", size_t(0))});
+    const auto name = "__meshopt_fallback_" + std::to_string(i);
+    vfs.addFile(VirtualFileSystem::joinPath(baseDir, name), {placeholder, 1});
+    buffer["uri"] = name;
+    buffer["byteLength"] = 1;
+  }
+}
+
+bool MeshoptDecompressor::decompress(tinygltf::Model &model,
+    std::vector<BufferSpan> &bufferSpans, ThreadPool &pool,
+    std::string &err) const
+{
+  // Fallback buffers left empty were skipped as unused
+  for (const auto &fallback : m_fallbackBuffers) {
+    if (fallback.index >= bufferSpans.size() || !bufferSpans[fallback.index].size) {
+      continue;
+    }
+    auto &buffer = model.buffers[fallback.index];
+    buffer.uri.clear();
+    buffer.data.assign(fallback.byteLength, 0);
+    bufferSpans[fallback.index] = {buffer.data.data(), buffer.data.size()};
+  }
+
+  // Decoded data goes in buffers owned by the model, a target that is only a
+  // read-only view (the mapped BIN chunk of a .glb) is copied first
+  for (const auto &compressed : m_bufferViews) {
+    if (compressed.index >= model.bufferViews.size()) {
+      continue;
+    }
+    const auto bufferIdx = model.bufferViews[compressed.index].buffer;
+    if (bufferIdx < 0 || size_t(bufferIdx) >= bufferSpans.size() ||
+        !bufferSpans[bufferIdx].size) {
+      continue;
+    }
+    auto &span = bufferSpans[bufferIdx];
+    auto &data = model.buffers[bufferIdx].data;
+    if (span.data != data.data()) {
+      data.assign(span.data, span.data + span.size);
+      span = {data.data(), data.size()};
+    }
+  }
+
+  // One task per buffer view, they write to disjoint ranges
+  std::vector<std::string> errors(m_bufferViews.size());
+  std::vector<std::future<void>> futures;
+  for (size_t i = 0; i < m_bufferViews.size(); ++i) {
+    futures.emplace_back(pool.submit([&, i]() {
+      const auto &compressed = m_bufferViews[i];
+      auto &error = errors[i];
+      if (compressed.index >= model.bufferViews.size() || compressed.buffer < 0 ||
+          size_t(compressed.buffer) >= bufferSpans.size() ||
+          model.bufferViews[compressed.index].buffer < 0 ||
+          size_t(model.bufferViews[compressed.index].buffer) >= bufferSpans.size()) {
+        error = "invalid buffer";
+        return;
+      }
+      const auto &bufferView = model.bufferViews[compressed.index];
+      const auto &source = bufferSpans[compressed.buffer];
+      const auto &target = bufferSpans[bufferView.buffer];
+      if (!source.size || !target.size) {
+        return; // Not loaded because not used
+      }
+      const auto size = compressed.count * compressed.byteStride;
+      if (compressed.byteOffset + compressed.byteLength > source.size ||
+          bufferView.byteOffset + size > target.size ||
+          size > bufferView.byteLength) {
+        error = "out of bounds";
+        return;
+      }
+      const auto out = const_cast<unsigned char *>(target.data) + bufferView.byteOffset;
+      const auto in = source.data + compressed.byteOffset;
+
+      bool ok = false;
+      if (compressed.mode == "ATTRIBUTES") {
+        ok = decodeMeshoptVertexBuffer(out, compressed.count, compressed.byteStride, in, compressed.byteLength);
+        // Filters apply to the decoded data only
+        if (ok && compressed.filter == "OCTAHEDRAL") {
+          decodeMeshoptOctahedralFilter(out, compressed.count, compressed.byteStride);
+        } else if (ok && compressed.filter == "QUATERNION") {
+          decodeMeshoptQuaternionFilter(out, compressed.count, compressed.byteStride);
+        } else if (ok && compressed.filter == "EXPONENTIAL") {
+          decodeMeshoptExponentialFilter(out, compressed.count, compressed.byteStride);
+        }
+      } else if (compressed.mode == "TRIANGLES") {
+        ok = decodeMeshoptIndexBuffer(out, compressed.count, compressed.byteStride, in, compressed.byteLength);
+      } else if (compressed.mode == "INDICES") {
+        ok = decodeMeshoptIndexSequence(out, compressed.count, compressed.byteStride, in, compressed.byteLength);
+      }
+      if (!ok) {
+        error = "unable to decode " + compressed.mode;
+      }
+    }));
+  }
+  // All tasks are done before errors is read, a throwing one reports there
+  for (auto &future : futures) {
+    future.wait();
+  }
+  for (size_t i = 0; i < futures.size(); ++i) {
+    try {
+      futures[i].get();
+    } catch (const std::exception &e) {
+      errors[i] = e.what();
+    }
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < errors.size(); ++i) {
+    if (!errors[i].empty()) {
+      err += "EXT_meshopt_compression: bufferView " +
+             std::to_string(m_bufferViews[i].index) + ": " + errors[i] + "\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
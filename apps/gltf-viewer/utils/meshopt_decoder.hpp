@@ -0,0 +1,72 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "thread_pool.hpp"
+#include "virtual_fs.hpp"
+
+#include <json.hpp>
+#include <string>
+#include <tiny_gltf.h>
+#include <vector>
+
+// Decoders of the meshoptimizer codecs used by EXT_meshopt_compression
+// https://github.com/KhronosGroup/glTF/tree/master/extensions/2.0/Vendor/EXT_meshopt_compression
+// They return false on malformed input. destination must hold count * stride
+// bytes.
+
+// "ATTRIBUTES" mode, stride is a multiple of 4 up to 256
+bool decodeMeshoptVertexBuffer(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size);
+
+// "TRIANGLES" mode, stride is 2 or 4 and count a multiple of 3
+bool decodeMeshoptIndexBuffer(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size);
+
+// "INDICES" mode, stride is 2 or 4
+bool decodeMeshoptIndexSequence(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size);
+
+// In place filters applied after decoding "ATTRIBUTES"
+void decodeMeshoptOctahedralFilter(unsigned char *data, size_t count, size_t stride);
+void decodeMeshoptQuaternionFilter(unsigned char *data, size_t count, size_t stride);
+void decodeMeshoptExponentialFilter(unsigned char *data, size_t count, size_t stride);
+
+// Makes tinygltf load files using EXT_meshopt_compression, then decodes the
+// compressed buffer views in their (fallback) buffer.
+// apply() is a GltfJsonPatch: fallback buffers, that have no data in the
+// file, get a placeholder so that tinygltf does not complain about them.
+// decompress() allocates them and decodes each buffer view on the pool,
+// targets only mapped from the file (.glb BIN chunk) are copied first.
+class MeshoptDecompressor
+{
+public:
+  void apply(nlohmann::json &gltf, VirtualFileSystem &vfs,
+      const std::string &baseDir);
+
+  bool decompress(tinygltf::Model &model, std::vector<BufferSpan> &bufferSpans,
+      ThreadPool &pool, std::string &err) const;
+
+  size_t compressedBufferViewCount() const { return m_bufferViews.size(); }
+
+private:
+  struct CompressedBufferView
+  {
+    size_t index;
+    int buffer; // Holding the compressed bytes
+    size_t byteOffset;
+    size_t byteLength;
+    size_t byteStride;
+    size_t count;
+    std::string mode;
+    std::string filter;
+  };
+
+  struct FallbackBuffer
+  {
+    size_t index;
+    size_t byteLength;
+  };
+
+  std::vector<CompressedBufferView> m_bufferViews;
+  std::vector<FallbackBuffer> m_fallbackBuffers;
+};
@@ -0,0 +1,300 @@
+#include "mipmaps.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAPS_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MIPMAPS_NEON 1
+#include <arm_neon.h>
+#endif
+
+float srgbToLinear(float value)
+{
+  return value <= 0.04045f ? value / 12.92f
+                           : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float value)
+{
+  return value <= 0.0031308f ? value * 12.92f
+                             : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+namespace
+{
+// Images with fewer pixels are processed by a single task
+const size_t SMALL_IMAGE_PIXEL_COUNT = 256 * 256;
+// Rows of a level computed by a task of a big image
+const int ROWS_PER_TASK = 16;
+
+// Conversions of 8 bits sRGB values, exact without calling pow per pixel
+struct SrgbTables
+{
+  static const int BUCKET_COUNT = 8192;
+
+  float toLinear[256];
+  // Linear value above which code i + 1 is closer than code i
+  float thresholds[256];
+  // Code of the start of each bucket of linear values, the steepest part of
+  // the curve moves less than one code per bucket
+  unsigned char bucketCodes[BUCKET_COUNT];
+
+  SrgbTables()
+  {
+    for (int i = 0; i < 256; ++i) {
+      toLinear[i] = srgbToLinear(i / 255.f);
+      thresholds[i] = i < 255 ? srgbToLinear((i + 0.5f) / 255.f) : 2.f;
+    }
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+      const auto value = float(i) / (BUCKET_COUNT - 1);
+      bucketCodes[i] = (unsigned char)(std::upper_bound(thresholds, thresholds + 255, value) - thresholds);
+    }
+  }
+
+  // value in [0, 1]
+  unsigned char fromLinear(float value) const
+  {
+    int code = bucketCodes[int(value * (BUCKET_COUNT - 1))];
+    while (value > thresholds[code]) {
+      ++code;
+    }
+    return (unsigned char)code;
+  }
+};
+
+const SrgbTables &getSrgbTables()
+{
+  static const SrgbTables tables;
+  return tables;
+}
+
+struct Level
+{
+  unsigned char *pixels;
+  int width;
+  int height;
+};
+
+struct PixelLayout
+{
+  int components;
+  int channelSize; // 1 or 2 bytes
+  uint32_t srgbMask; // Bit k set if channel k is sRGB encoded
+};
+
+// Read a row of pixels as linear floats in [0, 1]
+void readRow(const unsigned char *row, int width, const PixelLayout &layout, float *out)
+{
+  const auto &tables = getSrgbTables();
+  for (int x = 0; x < width; ++x) {
+    for (int k = 0; k < layout.components; ++k) {
+      const auto i = size_t(x) * layout.components + k;
+      const bool srgb = layout.srgbMask >> k & 1;
+      if (layout.channelSize == 1) {
+        out[i] = srgb ? tables.toLinear[row[i]] : row[i] * (1.f / 255.f);
+      } else {
+        uint16_t value;
+        std::memcpy(&value, row + 2 * i, sizeof(value));
+        out[i] = srgb ? srgbToLinear(value / 65535.f) : value / 65535.f;
+      }
+    }
+  }
+}
+
+void writeRow(const float *values, int width, const PixelLayout &layout, unsigned char *row)
+{
+  const auto &tables = getSrgbTables();
+  for (int x = 0; x < width; ++x) {
+    for (int k = 0; k < layout.components; ++k) {
+      const auto i = size_t(x) * layout.components + k;
+      const auto value = std::min(std::max(values[i], 0.f), 1.f);
+      const bool srgb = layout.srgbMask >> k & 1;
+      if (layout.channelSize == 1) {
+        row[i] = srgb ? tables.fromLinear(value) : (unsigned char)(value * 255.f + 0.5f);
+      } else {
+        const auto encoded = uint16_t((srgb ? linearToSrgb(value) : value) * 65535.f + 0.5f);
+        std::memcpy(row + 2 * i, &encoded, sizeof(encoded));
+      }
+    }
+  }
+}
+
+// sums[i] = a[i] + b[i]
+void addRows(const float *a, const float *b, float *sums, size_t count)
+{
+  size_t i = 0;
+#if MIPMAPS_SSE2
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(sums + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  }
+#elif MIPMAPS_NEON
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(sums + i, vaddq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+  }
+#endif
+  for (; i < count; ++i) {
+    sums[i] = a[i] + b[i];
+  }
+}
+
+// Pixel x of dst is the average of pixels 2x and 2x + 1 of the sums of two
+// rows, width is the width of sums
+void averagePairs(const float *sums, int width, int components, float *dst, int dstWidth)
+{
+  int x = 0;
+#if MIPMAPS_SSE2
+  const auto quarter = _mm_set1_ps(0.25f);
+  if (components == 4) {
+    for (; 2 * x + 2 <= width && x < dstWidth; ++x) {
+      const auto sum = _mm_add_ps(_mm_loadu_ps(sums + 8 * x), _mm_loadu_ps(sums + 8 * x + 4));
+      _mm_storeu_ps(dst + 4 * x, _mm_mul_ps(sum, quarter));
+    }
+  } else if (components == 1) {
+    for (; 2 * x + 8 <= width && x + 4 <= dstWidth; x += 4) {
+      const auto lo = _mm_loadu_ps(sums + 2 * x);
+      const auto hi = _mm_loadu_ps(sums + 2 * x + 4);
+      const auto even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+      const auto odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm_storeu_ps(dst + x, _mm_mul_ps(_mm_add_ps(even, odd), quarter));
+    }
+  } else if (components == 2) {
+    for (; 2 * x + 4 <= width && x + 2 <= dstWidth; x += 2) {
+      const auto lo = _mm_loadu_ps(sums + 4 * x);
+      const auto hi = _mm_loadu_ps(sums + 4 * x + 4);
+      const auto even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(1, 0, 1, 0));
+      const auto odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 2, 3, 2));
+      _mm_storeu_ps(dst + 2 * x, _mm_mul_ps(_mm_add_ps(even, odd), quarter));
+    }
+  }
+#elif MIPMAPS_NEON
+  const auto quarter = vdupq_n_f32(0.25f);
+  if (components == 4) {
+    for (; 2 * x + 2 <= width && x < dstWidth; ++x) {
+      const auto sum = vaddq_f32(vld1q_f32(sums + 8 * x), vld1q_f32(sums + 8 * x + 4));
+      vst1q_f32(dst + 4 * x, vmulq_f32(sum, quarter));
+    }
+  } else if (components == 1) {
+    for (; 2 * x + 8 <= width && x + 4 <= dstWidth; x += 4) {
+      const auto pairs = vld2q_f32(sums + 2 * x);
+      vst1q_f32(dst + x, vmulq_f32(vaddq_f32(pairs.val[0], pairs.val[1]), quarter));
+    }
+  }
+#endif
+  for (; x < dstWidth; ++x) {
+    const auto x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+    for (int k = 0; k < components; ++k) {
+      dst[x * components + k] =
+          (sums[x0 * components + k] + sums[x1 * components + k]) * 0.25f;
+    }
+  }
+}
+
+// Rows [firstRow, lastRow) of dst, from the 2x2 pixels of src
+void downsampleRows(const Level &src, const Level &dst, const PixelLayout &layout,
+    int firstRow, int lastRow)
+{
+  const auto srcRowSize = size_t(src.width) * layout.components * layout.channelSize;
+  const auto dstRowSize = size_t(dst.width) * layout.components * layout.channelSize;
+  const auto count = size_t(src.width) * layout.components;
+  std::vector<float> a(count), b(count), sums(count);
+  std::vector<float> dstRow(size_t(dst.width) * layout.components);
+  for (int y = firstRow; y < lastRow; ++y) {
+    const auto y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+    readRow(src.pixels + y0 * srcRowSize, src.width, layout, a.data());
+    readRow(src.pixels + y1 * srcRowSize, src.width, layout, b.data());
+    addRows(a.data(), b.data(), sums.data(), count);
+    averagePairs(sums.data(), src.width, layout.components, dstRow.data(), dst.width);
+    writeRow(dstRow.data(), dst.width, layout, dst.pixels + y * dstRowSize);
+  }
+}
+
+// Bit k set if stored channel k holds sRGB color, alpha is always linear
+uint32_t getSrgbMask(const ImageEncoding &encoding, const ImageUsage &usage)
+{
+  if (!usage.color) {
+    return 0;
+  }
+  uint32_t mask = 0;
+  for (int c = 0; c < 3; ++c) {
+    if (encoding.swizzle[c] < 4) {
+      mask |= 1u << encoding.swizzle[c];
+    }
+  }
+  if (encoding.swizzle[3] < 4) {
+    mask &= ~(1u << encoding.swizzle[3]);
+  }
+  return mask;
+}
+
+// Splits levels by rows on pool if it is not null
+void generateImageMipmaps(tinygltf::Image &image, BufferSpan &span,
+    ImageEncoding &encoding, const PixelLayout &layout, ThreadPool *pool)
+{
+  const auto levelCount = getMipLevelCount(image);
+  std::vector<size_t> levelOffsets(levelCount + 1, 0);
+  for (int level = 0; level < levelCount; ++level) {
+    levelOffsets[level + 1] =
+        levelOffsets[level] + getLevelByteSize(image, TextureFormat::Raw, level);
+  }
+  std::vector<unsigned char> levels(levelOffsets.back());
+  std::memcpy(levels.data(), span.data, std::min(span.size, levelOffsets[1]));
+
+  for (int level = 1; level < levelCount; ++level) {
+    const Level src = {levels.data() + levelOffsets[level - 1],
+        getLevelWidth(image, level - 1), getLevelHeight(image, level - 1)};
+    const Level dst = {levels.data() + levelOffsets[level],
+        getLevelWidth(image, level), getLevelHeight(image, level)};
+    if (pool) {
+      const auto taskCount = size_t(dst.height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+      pool->parallelFor(taskCount, [&](size_t task) {
+        const auto firstRow = int(task) * ROWS_PER_TASK;
+        downsampleRows(src, dst, layout, firstRow, std::min(firstRow + ROWS_PER_TASK, dst.height));
+      });
+    } else {
+      downsampleRows(src, dst, layout, 0, dst.height);
+    }
+  }
+
+  image.image = std::move(levels);
+  span = {image.image.data(), image.image.size()};
+  encoding.levelCount = levelCount;
+}
+
+} // namespace
+
+void generateMipmaps(tinygltf::Model &model,
+    std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool)
+{
+  const auto usages = getImageUsages(model);
+  imageEncodings.resize(model.images.size());
+  std::vector<size_t> smallImages, bigImages;
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    const auto &image = model.images[i];
+    const auto &encoding = imageEncodings[i];
+    if (!usages[i].mipmaps || encoding.format != TextureFormat::Raw ||
+        encoding.levelCount > 1 || (image.bits != 8 && image.bits != 16) ||
+        image.component < 1 || image.component > 4 ||
+        std::max(image.width, image.height) < 2 ||
+        imageSpans[i].size < getLevelByteSize(image, TextureFormat::Raw, 0)) {
+      continue;
+    }
+    const auto pixelCount = size_t(image.width) * image.height;
+    (pixelCount < SMALL_IMAGE_PIXEL_COUNT ? smallImages : bigImages).push_back(i);
+  }
+
+  const auto generate = [&](size_t i, ThreadPool *rowPool) {
+    const auto &image = model.images[i];
+    const PixelLayout layout = {image.component, image.bits / 8,
+        getSrgbMask(imageEncodings[i], usages[i])};
+    generateImageMipmaps(model.images[i], imageSpans[i], imageEncodings[i], layout, rowPool);
+  };
+  pool.parallelFor(smallImages.size(), [&](size_t j) { generate(smallImages[j], nullptr); });
+  for (const auto i : bigImages) {
+    generate(i, &pool);
+  }
+}
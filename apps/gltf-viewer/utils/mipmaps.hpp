@@ -0,0 +1,24 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "texture_compression.hpp"
+#include "thread_pool.hpp"
+
+#include <tiny_gltf.h>
+#include <vector>
+
+// Compute the mip levels of the decoded images sampled with a mipmap filter,
+// on the CPU instead of with glGenerateMipmap on the GL thread. Each level
+// averages 2x2 pixels of the previous one; the channels of color images are
+// filtered in linear space, not in sRGB. Levels are stored one after the
+// other from level 0 in the image and its span, and
+// imageEncodings[i].levelCount is set.
+// Big images are split by rows on the pool, small ones run in parallel.
+void generateMipmaps(tinygltf::Model &model,
+    std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool);
+
+// sRGB transfer functions, for values in [0, 1]
+float srgbToLinear(float value);
+
+float linearToSrgb(float value);
@@ -0,0 +1,184 @@
+#include "node_table.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// glTF requires matrices to be decomposable in TRS (no shear)
+void decomposeMatrix(const std::vector<double> &matrix, glm::vec3 &translation,
+    glm::quat &rotation, glm::vec3 &scale)
+{
+  glm::mat4 m;
+  for (int i = 0; i < 16; ++i) {
+    m[i / 4][i % 4] = float(matrix[i]);
+  }
+  translation = glm::vec3(m[3]);
+  scale = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])),
+      glm::length(glm::vec3(m[2])));
+  if (glm::determinant(glm::mat3(m)) < 0.f) {
+    scale.x = -scale.x; // Mirrored
+  }
+  glm::mat3 r;
+  for (int c = 0; c < 3; ++c) {
+    r[c] = scale[c] != 0.f ? glm::vec3(m[c]) / scale[c] : glm::vec3(0.f);
+  }
+  rotation = glm::normalize(glm::quat_cast(r));
+}
+
+struct NodeTableBuilder
+{
+  const tinygltf::Model &model;
+  const MeshLods &lods;
+  const std::vector<LodRange> &nodeLodRanges;
+  const std::vector<glm::vec4> &meshBounds;
+  NodeTable &table;
+  std::vector<int> path; // Nodes from the root, a level does not add itself again
+
+  void add(int nodeIdx, int parent, int lodOwner)
+  {
+    const auto &node = model.nodes[nodeIdx];
+    const auto entry = table.size();
+    table.nodes.push_back(nodeIdx);
+    table.nextEntries.push_back(table.firstEntries[nodeIdx]);
+    table.firstEntries[nodeIdx] = int(entry);
+    table.meshes.push_back(node.mesh);
+    table.localBounds.push_back(node.mesh >= 0 ? meshBounds[node.mesh] : glm::vec4(0.f));
+    table.parents.push_back(parent);
+    table.lodOwners.push_back(lodOwner);
+    table.childrenEnds.push_back(0);
+    table.subtreeEnds.push_back(0);
+
+    glm::vec3 translation(0.f), scale(1.f);
+    glm::quat rotation(1.f, 0.f, 0.f, 0.f);
+    if (node.matrix.size() == 16) {
+      decomposeMatrix(node.matrix, translation, rotation, scale);
+    } else {
+      if (node.translation.size() == 3) {
+        translation = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+      }
+      if (node.rotation.size() == 4) {
+        // prototype is w, x, y, z
+        rotation = glm::quat(float(node.rotation[3]), float(node.rotation[0]),
+            float(node.rotation[1]), float(node.rotation[2]));
+      }
+      if (node.scale.size() == 3) {
+        scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+      }
+    }
+    table.translations.push_back(translation);
+    table.rotations.push_back(rotation);
+    table.scales.push_back(scale);
+
+    path.push_back(nodeIdx);
+    for (const auto childIdx : node.children) {
+      add(childIdx, int(entry), -1);
+    }
+    table.childrenEnds[entry] = uint32_t(table.size());
+
+    // Levels drawn instead of this node, with its parent
+    const auto &range = nodeLodRanges[nodeIdx];
+    for (size_t i = range.begin; i < range.begin + range.count; ++i) {
+      const auto lodNodeIdx = lods.nodes[i].lodNode;
+      if (std::find(begin(path), end(path), lodNodeIdx) == end(path)) {
+        add(lodNodeIdx, parent, int(entry));
+      }
+    }
+    path.pop_back();
+    table.subtreeEnds[entry] = uint32_t(table.size());
+  }
+};
+} // namespace
+
+NodeTable buildNodeTable(const tinygltf::Model &model, const MeshLods &lods,
+    const std::vector<LodRange> &nodeLodRanges,
+    const std::vector<glm::vec4> &meshBounds)
+{
+  NodeTable table;
+  table.firstEntries.assign(model.nodes.size(), -1);
+  if (model.defaultScene < 0) {
+    return table;
+  }
+  NodeTableBuilder builder{model, lods, nodeLodRanges, meshBounds, table, {}};
+  for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
+    builder.add(nodeIdx, -1, -1);
+  }
+
+  table.worldMatrices.resize(table.size());
+  table.normalMatrices.resize(table.size());
+  table.worldScales.resize(table.size());
+  table.worldBounds.resize(table.size());
+  table.dirty.assign(table.size(), 0);
+  table.proxyValid.assign(table.size(), 1);
+  updateWorldMatrices(table, 0, table.size());
+  return table;
+}
+
+void setLocalTransform(NodeTable &table, int nodeIdx,
+    const glm::vec3 &translation, const glm::quat &rotation,
+    const glm::vec3 &scale)
+{
+  for (auto entry = table.firstEntries[nodeIdx]; entry >= 0;
+       entry = table.nextEntries[entry]) {
+    table.translations[entry] = translation;
+    table.rotations[entry] = rotation;
+    table.scales[entry] = scale;
+    if (!table.dirty[entry]) {
+      table.dirty[entry] = 1;
+      table.dirtyEntries.push_back(uint32_t(entry));
+    }
+
+    // A MSFT_lod level goes up through the node it replaces. Ancestors are
+    // invalidated up to the root, stop at one already done.
+    auto ancestor = entry;
+    while (true) {
+      const auto lodOwner = table.lodOwners[ancestor];
+      ancestor = lodOwner >= 0 ? lodOwner : table.parents[ancestor];
+      if (ancestor < 0 || !table.proxyValid[ancestor]) {
+        break;
+      }
+      table.proxyValid[ancestor] = 0;
+    }
+  }
+}
+
+size_t updateWorldTransforms(NodeTable &table)
+{
+  // Subtrees are nested ranges: in order, a root inside the previous range
+  // was updated with it
+  std::sort(begin(table.dirtyEntries), end(table.dirtyEntries));
+  size_t updatedCount = 0;
+  uint32_t updatedEnd = 0;
+  for (const auto entry : table.dirtyEntries) {
+    table.dirty[entry] = 0;
+    if (entry < updatedEnd) {
+      continue;
+    }
+    updatedEnd = table.subtreeEnds[entry];
+    updateWorldMatrices(table, entry, updatedEnd);
+    updatedCount += updatedEnd - entry;
+  }
+  table.dirtyEntries.clear();
+  return updatedCount;
+}
+
+void updateWorldMatrices(NodeTable &table, size_t begin, size_t end)
+{
+  for (auto i = begin; i < end; ++i) {
+    const auto parent = table.parents[i];
+    const auto localMatrix =
+        glm::scale(glm::translate(glm::mat4(1.f), table.translations[i]) *
+                       glm::mat4_cast(table.rotations[i]),
+            table.scales[i]);
+    const auto &worldMatrix = table.worldMatrices[i] =
+        parent >= 0 ? table.worldMatrices[parent] * localMatrix : localMatrix;
+    table.normalMatrices[i] = glm::transpose(glm::inverse(worldMatrix));
+    table.worldScales[i] = std::max({glm::length(glm::vec3(worldMatrix[0])),
+        glm::length(glm::vec3(worldMatrix[1])), glm::length(glm::vec3(worldMatrix[2]))});
+    const auto &bounds = table.localBounds[i];
+    table.worldBounds[i] = glm::vec4(glm::vec3(worldMatrix * glm::vec4(glm::vec3(bounds), 1.f)),
+        bounds.w * table.worldScales[i]);
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "mesh_lod.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// The nodes of the default scene flattened in arrays, in depth-first order
+// (parents before children), so that the frame loop walks them linearly
+// instead of recursing in model.nodes. A node referenced as a MSFT_lod level
+// gets entries for its subtree after the children of the node it replaces,
+// with the parent of that node.
+// The entries of the subtree of entry i are i + 1 to subtreeEnds[i] - 1.
+// Changing a local transform marks the subtrees of the node, only those are
+// updated (see updateWorldTransforms).
+struct NodeTable
+{
+  std::vector<int> nodes; // In model.nodes
+  std::vector<int> nextEntries; // Of the same node, -1 for the last
+  std::vector<int> firstEntries; // By node, -1 if not in the scene
+  std::vector<int> meshes; // -1 without
+  std::vector<int> parents; // Entry, -1 for the roots of the scene
+  std::vector<int> lodOwners; // Entry of the node it is a MSFT_lod level of, else -1
+  std::vector<uint32_t> childrenEnds; // After its children, where its MSFT_lod levels start
+  std::vector<uint32_t> subtreeEnds; // After its children and MSFT_lod levels
+
+  // Local transforms, from the matrix of the node if it has one
+  std::vector<glm::vec3> translations;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+
+  // Computed from the above by updateWorldMatrices
+  std::vector<glm::mat4> worldMatrices;
+  std::vector<glm::mat4> normalMatrices; // Inverse transpose of the world matrix
+  std::vector<float> worldScales; // Biggest scale of the world matrix, for bounding spheres
+  // Bounding spheres of the meshes, in mesh space and in world space
+  std::vector<glm::vec4> localBounds;
+  std::vector<glm::vec4> worldBounds;
+
+  // Roots of the subtrees to update, flagged in dirty
+  std::vector<uint32_t> dirtyEntries;
+  std::vector<uint8_t> dirty;
+
+  // 0 once a transform changed in the subtree (or MSFT_lod levels) of the
+  // entry: its HLOD proxy was baked with the previous one
+  std::vector<uint8_t> proxyValid;
+
+  size_t size() const { return nodes.size(); }
+};
+
+// nodeLodRanges as given by getNodeLodRanges, meshBounds the bounding sphere
+// of each mesh. World matrices and bounds are computed.
+NodeTable buildNodeTable(const tinygltf::Model &model, const MeshLods &lods,
+    const std::vector<LodRange> &nodeLodRanges,
+    const std::vector<glm::vec4> &meshBounds);
+
+// Change the local transform of a node (animation, gizmo...): the subtrees
+// of its entries are updated by the next updateWorldTransforms. The HLOD
+// proxies of the entries above are no longer valid, those of the entries
+// themselves move with them.
+void setLocalTransform(NodeTable &table, int nodeIdx,
+    const glm::vec3 &translation, const glm::quat &rotation,
+    const glm::vec3 &scale);
+
+// Update the world matrices and bounds of the subtrees marked since the last
+// call, each entry once. Returns the number of entries updated.
+size_t updateWorldTransforms(NodeTable &table);
+
+// World matrices and bounds of the entries from begin to end from their
+// local transforms, those of their parents must be up to date
+void updateWorldMatrices(NodeTable &table, size_t begin, size_t end);
@@ -0,0 +1,176 @@
+#include "program_cache.hpp"
+#include "hash.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace
+{
+const uint32_t PROGRAM_MAGIC = 0x31505647; // "GVP1"
+
+// Header of a cached binary, followed by its bytes
+struct ProgramHeader
+{
+  uint32_t magic;
+  uint32_t format; // GLenum given by glGetProgramBinary
+  uint64_t key;
+};
+
+std::string getDriverString(GLenum name)
+{
+  const auto str = reinterpret_cast<const char *>(glGetString(name));
+  return str ? str : "";
+}
+
+fs::path getProgramPath(const fs::path &directory, uint64_t key)
+{
+  return directory / (hashToHex(key) + ".glprog");
+}
+
+// Random suffix, two viewers may write the same program at once
+fs::path getTemporaryPath(const fs::path &path)
+{
+  std::random_device device;
+  const auto suffix = (uint64_t(device()) << 32) ^ device() ^
+                      uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+  return fs::path(path.string() + "." + hashToHex(suffix) + ".tmp");
+}
+
+bool readProgramBinary(const fs::path &path, uint64_t key, GLenum &format,
+    std::vector<char> &binary)
+{
+  std::ifstream in(path.string(), std::ios::binary);
+  ProgramHeader header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != PROGRAM_MAGIC || header.key != key) {
+    return false;
+  }
+  format = header.format;
+  binary.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return !binary.empty();
+}
+
+void writeProgramBinary(const fs::path &path, uint64_t key, const GLProgram &program)
+{
+  GLint length = 0;
+  glGetProgramiv(program.glId(), GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program.glId(), length, &length, &format, binary.data());
+  if (length <= 0) {
+    return;
+  }
+
+  // Same as the asset cache: a temporary file renamed once complete
+  const auto tmpPath = getTemporaryPath(path);
+  try {
+    fs::create_directories(path.parent_path());
+  } catch (const std::exception &) {
+    return;
+  }
+  auto ok = false;
+  {
+    std::ofstream out(tmpPath.string(), std::ios::binary);
+    const ProgramHeader header{PROGRAM_MAGIC, format, key};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(binary.data(), length);
+    ok = bool(out);
+  }
+  std::error_code error;
+  if (ok) {
+    fs::rename(tmpPath, path, error);
+  }
+  if (!ok || error) {
+    fs::remove(tmpPath, error);
+  }
+}
+} // namespace
+
+void ProgramCache::init(const fs::path &directory, bool parallelCompile)
+{
+  m_parallelCompile = parallelCompile;
+  m_builds.clear();
+  m_directory.clear();
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  if (directory.empty() || formatCount <= 0) {
+    return;
+  }
+  m_directory = directory;
+  // Binaries are only valid for the driver that made them
+  m_driverKey = 0;
+  for (const auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+    m_driverKey = hashString(getDriverString(name), m_driverKey);
+  }
+}
+
+size_t ProgramCache::submit(std::vector<fs::path> shaderPaths,
+    const std::vector<std::string> &defines)
+{
+  m_builds.emplace_back();
+  auto &build = m_builds.back();
+  if (m_directory.empty()) {
+    ++m_missCount;
+    build.pending = std::make_unique<PendingProgram>(std::move(shaderPaths), defines);
+    return m_builds.size() - 1;
+  }
+
+  // Names give the stage of each shader. Embedded shaders were hashed with
+  // their includes at build time, others are preprocessed.
+  build.key = m_driverKey;
+  for (const auto &path : shaderPaths) {
+    build.key = hashString(path.filename().string(), build.key);
+    const auto shader = findEmbeddedShader(path);
+    build.key = shader ? hashBytes(&shader->hash, sizeof(shader->hash), build.key)
+                       : hashString(preprocessShaderSource(path), build.key);
+  }
+  for (const auto &define : defines) {
+    build.key = hashString(define, build.key);
+  }
+  const auto path = getProgramPath(m_directory, build.key);
+
+  GLenum format = 0;
+  std::vector<char> binary;
+  if (readProgramBinary(path, build.key, format, binary)) {
+    auto program = std::make_unique<GLProgram>();
+    glProgramBinary(program->glId(), format, binary.data(), GLsizei(binary.size()));
+    if (program->getLinkStatus()) {
+      ++m_hitCount;
+      build.program = std::move(program);
+      return m_builds.size() - 1;
+    }
+    // After a driver update that kept its version string, for instance
+    std::clog << "Program binary " << path << " rejected by the driver" << std::endl;
+  }
+
+  ++m_missCount;
+  build.pending = std::make_unique<PendingProgram>(std::move(shaderPaths), defines, true);
+  return m_builds.size() - 1;
+}
+
+bool ProgramCache::isReady(size_t build) const
+{
+  const auto &pending = m_builds[build].pending;
+  return !pending || !m_parallelCompile || pending->isComplete();
+}
+
+GLProgram ProgramCache::finish(size_t build)
+{
+  auto &state = m_builds[build];
+  if (state.program) {
+    return std::move(*state.program);
+  }
+  auto program = state.pending->finish();
+  state.pending.reset();
+  if (!m_directory.empty()) {
+    writeProgramBinary(getProgramPath(m_directory, state.key), state.key, program);
+  }
+  return program;
+}
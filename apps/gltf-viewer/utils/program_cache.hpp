@@ -0,0 +1,60 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "shaders.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked programs (glGetProgramBinary), so that shaders are
+// only compiled on the first start and when their sources or the driver
+// change. The key of a program hashes its shader sources (with their
+// includes) and defines with the vendor, renderer and version strings of the
+// driver.
+// Programs are submitted first and finished later: the missing ones are
+// compiled meanwhile, in parallel if the driver can.
+// Needs a current GL context.
+class ProgramCache
+{
+public:
+  // Binaries are stored in directory. Nothing is cached if it is empty or if
+  // the driver has no binary format. parallelCompile: the driver supports
+  // KHR_parallel_shader_compile, so isReady can poll it.
+  void init(const fs::path &directory, bool parallelCompile = false);
+
+  // Start building a program from shaderPaths with defines (see
+  // preprocessShaderSource): from the binary stored by a previous run if the
+  // driver accepts it, else by compiling them. Returns the index to give to
+  // isReady and finish.
+  size_t submit(std::vector<fs::path> shaderPaths,
+      const std::vector<std::string> &defines = {});
+
+  // finish would not wait. Always true without KHR_parallel_shader_compile,
+  // the driver then compiles when finish asks for the status.
+  bool isReady(size_t build) const;
+
+  // Wait for the program, and store its binary if it was compiled. Throws on
+  // compile or link errors, like compileProgram.
+  GLProgram finish(size_t build);
+
+  size_t hitCount() const { return m_hitCount; }
+
+  size_t missCount() const { return m_missCount; }
+
+private:
+  struct Build
+  {
+    uint64_t key = 0;
+    std::unique_ptr<GLProgram> program; // Loaded from its binary
+    std::unique_ptr<PendingProgram> pending; // Or being compiled
+  };
+
+  fs::path m_directory;
+  bool m_parallelCompile = false;
+  uint64_t m_driverKey = 0;
+  std::vector<Build> m_builds;
+  size_t m_hitCount = 0;
+  size_t m_missCount = 0;
+};
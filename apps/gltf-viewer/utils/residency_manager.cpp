@@ -0,0 +1,123 @@
+#include "residency_manager.hpp"
+
+#include <algorithm>
+
+void ResidencyManager::init(std::vector<size_t> byteSizes, Callback load,
+    Callback evict, size_t budget)
+{
+  clear();
+  m_resources.clear();
+  m_resources.reserve(byteSizes.size());
+  for (const auto byteSize : byteSizes) {
+    m_resources.push_back({byteSize});
+  }
+  m_load = std::move(load);
+  m_evict = std::move(evict);
+  m_budget = budget;
+  m_requests.clear();
+  m_evictableFrame = 0;
+  m_pendingCount = 0;
+}
+
+void ResidencyManager::setBudget(size_t budget)
+{
+  m_budget = budget;
+  makeRoom(0);
+}
+
+void ResidencyManager::update(size_t bytesPerFrame)
+{
+  // Visible first, by size on screen, then prefetched ones
+  std::sort(begin(m_requests), end(m_requests), [&](size_t a, size_t b) {
+    return m_resources[a].priority > m_resources[b].priority;
+  });
+
+  size_t loadedBytes = 0;
+  m_pendingCount = 0;
+  for (const auto resource : m_requests) {
+    auto &state = m_resources[resource];
+    if (state.resident) {
+      continue; // Requested twice
+    }
+    if ((loadedBytes && loadedBytes + state.byteSize > bytesPerFrame) ||
+        !makeRoom(state.byteSize)) {
+      ++m_pendingCount;
+      continue;
+    }
+    m_load(resource);
+    state.resident = true;
+    m_residentBytes += state.byteSize;
+    ++m_residentCount;
+    loadedBytes += state.byteSize;
+  }
+
+  m_requests.clear();
+  ++m_frame;
+}
+
+void ResidencyManager::clear()
+{
+  for (size_t resource = 0; resource < m_resources.size(); ++resource) {
+    if (m_resources[resource].resident) {
+      evict(resource);
+    }
+  }
+}
+
+void ResidencyManager::markResident(size_t resource)
+{
+  auto &state = m_resources[resource];
+  if (!state.resident) {
+    state.resident = true;
+    m_residentBytes += state.byteSize;
+    ++m_residentCount;
+  }
+}
+
+void ResidencyManager::resize(size_t resource, size_t byteSize)
+{
+  if (m_resources[resource].resident) {
+    evict(resource);
+  }
+  m_resources[resource].byteSize = byteSize;
+}
+
+bool ResidencyManager::makeRoom(size_t byteSize)
+{
+  if (!m_budget || m_residentBytes + byteSize <= m_budget) {
+    return true;
+  }
+  // Sorted once per frame, only when the budget is full
+  if (m_evictableFrame != m_frame) {
+    m_evictableFrame = m_frame;
+    m_evictable.clear();
+    for (size_t resource = 0; resource < m_resources.size(); ++resource) {
+      const auto &state = m_resources[resource];
+      if (state.resident && state.lastRequest < m_frame) {
+        m_evictable.push_back(resource);
+      }
+    }
+    std::sort(begin(m_evictable), end(m_evictable), [&](size_t a, size_t b) {
+      return m_resources[a].lastRequest > m_resources[b].lastRequest;
+    });
+  }
+  while (m_residentBytes + byteSize > m_budget && !m_evictable.empty()) {
+    const auto resource = m_evictable.back();
+    m_evictable.pop_back();
+    // Skip those evicted or requested again since the list was made
+    const auto &state = m_resources[resource];
+    if (state.resident && state.lastRequest < m_frame) {
+      evict(resource);
+    }
+  }
+  return m_residentBytes + byteSize <= m_budget;
+}
+
+void ResidencyManager::evict(size_t resource)
+{
+  auto &state = m_resources[resource];
+  m_evict(resource);
+  state.resident = false;
+  m_residentBytes -= state.byteSize;
+  --m_residentCount;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Keeps the GPU copies of resources (primitives, textures...) under a memory
+// budget. Each frame, the traversal requests the resources it needs with a
+// priority, higher first. update() then loads the requested resources that
+// are not resident, within a number of bytes per frame, and evicts the least
+// recently requested ones when the budget is full. Resources requested in the
+// current frame are never evicted, those that don't fit wait.
+// Nothing here touches GL, resources are loaded and evicted by callbacks.
+class ResidencyManager
+{
+public:
+  using Callback = std::function<void(size_t resource)>;
+
+  // Resources are numbered from 0 to byteSizes.size() - 1, none is resident.
+  // budget is in bytes, 0 for no limit.
+  void init(std::vector<size_t> byteSizes, Callback load, Callback evict,
+      size_t budget = 0);
+
+  // Evict the least recently requested resources if needed to fit in budget
+  void setBudget(size_t budget);
+
+  size_t budget() const { return m_budget; }
+
+  // The resource is needed in this frame (or soon, with a lower priority)
+  void request(size_t resource, float priority)
+  {
+    auto &state = m_resources[resource];
+    if (state.lastRequest == m_frame) {
+      state.priority = std::max(state.priority, priority);
+      return;
+    }
+    state.lastRequest = m_frame;
+    state.priority = priority;
+    if (!state.resident) {
+      m_requests.push_back(resource);
+    }
+  }
+
+  bool isResident(size_t resource) const
+  {
+    return m_resources[resource].resident;
+  }
+
+  // Load the resources requested in this frame that are not resident, by
+  // decreasing priority, until bytesPerFrame bytes have been loaded (at least
+  // one resource is). Then start a new frame.
+  void update(size_t bytesPerFrame);
+
+  // Evict all resident resources
+  void clear();
+
+  // The resource was loaded elsewhere (kept from a previous scene), it is
+  // resident without calling load. The budget is not checked.
+  void markResident(size_t resource);
+
+  // The content of the resource changed: evict it if resident, it is loaded
+  // again with its new size when requested
+  void resize(size_t resource, size_t byteSize);
+
+  size_t residentBytes() const { return m_residentBytes; }
+
+  size_t residentCount() const { return m_residentCount; }
+
+  // Requested in the last frame and still not resident
+  size_t pendingCount() const { return m_pendingCount; }
+
+private:
+  struct Resource
+  {
+    size_t byteSize;
+    uint64_t lastRequest = 0; // Frame
+    float priority = 0.f;
+    bool resident = false;
+  };
+
+  // Evict resources not requested in this frame, least recently requested
+  // first, until byteSize more bytes fit in the budget
+  bool makeRoom(size_t byteSize);
+
+  void evict(size_t resource);
+
+  std::vector<Resource> m_resources;
+  Callback m_load;
+  Callback m_evict;
+  size_t m_budget = 0;
+  uint64_t m_frame = 1;
+  std::vector<size_t> m_requests; // Not resident, in this frame
+  // Resident resources that can be evicted in this frame, least recently
+  // requested last
+  std::vector<size_t> m_evictable;
+  uint64_t m_evictableFrame = 0;
+  size_t m_residentBytes = 0;
+  size_t m_residentCount = 0;
+  size_t m_pendingCount = 0;
+};
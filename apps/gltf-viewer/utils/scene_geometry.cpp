@@ -0,0 +1,90 @@
+#include "scene_geometry.hpp"
+#include "hlod.hpp"
+
+#include <limits>
+
+namespace
+{
+std::vector<PrimitiveLayout> layoutPrimitives(const tinygltf::Model &model,
+    const QuantizedVertices &vertices, const MeshLods &lods,
+    const std::vector<std::vector<LodRange>> &primitiveLodRanges)
+{
+  std::vector<PrimitiveLayout> layouts;
+
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &mesh = model.meshes[meshIdx];
+    for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
+      layouts.emplace_back();
+      auto &layout = layouts.back();
+      const auto &primitive = mesh.primitives[primIdx];
+      const auto &quantized = vertices.primitives[meshIdx][primIdx];
+      if (!quantized.vertexCount) {
+        continue; // Not drawn, never loaded
+      }
+
+      // Index data keeps its 4 bytes alignment
+      const auto addSource = [&](int buffer, size_t byteOffset, size_t byteSize) {
+        const auto offset = (layout.byteSize + 3) & ~size_t(3);
+        layout.sources.push_back({int32_t(buffer), byteOffset, byteSize, offset});
+        layout.byteSize = offset + byteSize;
+        return offset;
+      };
+      const auto addIndices = [&](int accessorIdx) {
+        const auto &accessor = model.accessors[accessorIdx];
+        const auto &bufferView = model.bufferViews[accessor.bufferView];
+        return addSource(bufferView.buffer,
+            bufferView.byteOffset + accessor.byteOffset,
+            accessor.count * tinygltf::GetComponentSizeInBytes(accessor.componentType));
+      };
+      addSource(vertices.buffer, quantized.byteOffset,
+          quantized.vertexCount * sizeof(QuantizedVertex));
+      if (primitive.indices >= 0) {
+        layout.indexOffset = addIndices(primitive.indices);
+      }
+      const auto &lodRange = primitiveLodRanges[meshIdx][primIdx];
+      for (size_t i = lodRange.begin; i < lodRange.begin + lodRange.count; ++i) {
+        layout.lodOffsets.push_back(addIndices(lods.primitives[i].indices));
+      }
+    }
+  }
+
+  return layouts;
+}
+
+// Bounding sphere of each mesh, in mesh space
+std::vector<glm::vec4> getMeshBounds(
+    const tinygltf::Model &model, const QuantizedVertices &vertices)
+{
+  std::vector<glm::vec4> meshBounds(model.meshes.size(), glm::vec4(0.f));
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    glm::vec3 bboxMin(std::numeric_limits<float>::max());
+    glm::vec3 bboxMax(std::numeric_limits<float>::lowest());
+    for (const auto &quantized : vertices.primitives[meshIdx]) {
+      if (quantized.vertexCount) {
+        bboxMin = glm::min(bboxMin, quantized.positionMin);
+        bboxMax = glm::max(bboxMax, quantized.positionMin + quantized.positionScale);
+      }
+    }
+    if (bboxMin.x <= bboxMax.x) {
+      meshBounds[meshIdx] = glm::vec4(0.5f * (bboxMin + bboxMax), 0.5f * glm::length(bboxMax - bboxMin));
+    }
+  }
+  return meshBounds;
+}
+} // namespace
+
+void buildSceneGeometry(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &bufferSpans, const MeshLods &lods,
+    SceneGeometry &geometry)
+{
+  const auto &vertices = geometry.quantizedVertices;
+  geometry.meshlets = buildMeshlets(model, bufferSpans, vertices);
+  // Levels of detail are drawn from the same buffers
+  geometry.primitiveLodRanges = getPrimitiveLodRanges(model, lods);
+  geometry.nodeLodRanges = getNodeLodRanges(model, lods);
+  geometry.primitiveLayouts = layoutPrimitives(model, vertices, lods, geometry.primitiveLodRanges);
+  geometry.hlodProxyIndices = getHlodProxyIndices(model, lods.proxies);
+  geometry.meshBounds = getMeshBounds(model, vertices);
+  // Flattened for the traversal in each frame, with world matrices and bounds
+  geometry.nodeTable = buildNodeTable(model, lods, geometry.nodeLodRanges, geometry.meshBounds);
+}
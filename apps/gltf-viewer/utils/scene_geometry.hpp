@@ -0,0 +1,62 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "mesh_lod.hpp"
+#include "meshlets.hpp"
+#include "node_table.hpp"
+#include "vertex_quantizer.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Content of the GL buffer of a primitive: its quantized vertices, then its
+// indices and those of its levels of detail, copied from the model buffers
+struct PrimitiveLayout
+{
+  struct Source
+  {
+    int32_t buffer; // In model.buffers
+    uint64_t byteOffset; // In the buffer
+    uint64_t byteSize;
+    uint64_t offset; // In the GL buffer
+  };
+
+  size_t byteSize = 0; // 0 if not drawn
+  std::vector<Source> sources;
+  size_t indexOffset = 0;
+  // Of the index accessors of its levels of detail, in MeshLods order
+  std::vector<size_t> lodOffsets;
+};
+
+// What the frame loop draws from, derived from the model once its buffers
+// are final. Stored in the asset cache, so that a cache hit only maps it.
+struct SceneGeometry
+{
+  QuantizedVertices quantizedVertices;
+  Meshlets meshlets;
+  std::vector<std::vector<LodRange>> primitiveLodRanges; // [mesh][primitive]
+  std::vector<LodRange> nodeLodRanges;
+  std::vector<int> hlodProxyIndices;
+  std::vector<glm::vec4> meshBounds; // Bounding sphere of each mesh, in mesh space
+  std::vector<PrimitiveLayout> primitiveLayouts; // Of all primitives, mesh by mesh
+  NodeTable nodeTable;
+};
+
+// Everything but quantizedVertices, which must be set (see quantizeVertices
+// and optimizeIndices)
+void buildSceneGeometry(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &bufferSpans, const MeshLods &lods,
+    SceneGeometry &geometry);
+
+// Bytes of source, clamped to the buffer
+inline BufferSpan getSourceBytes(const std::vector<BufferSpan> &bufferSpans,
+    const PrimitiveLayout::Source &source)
+{
+  const auto &span = bufferSpans[source.buffer];
+  const auto offset = std::min<uint64_t>(span.size, source.byteOffset);
+  return {span.data + offset, size_t(std::min<uint64_t>(source.byteSize, span.size - offset))};
+}
@@ -0,0 +1,317 @@
+#include "scene_resources.hpp"
+
+#include "filesystem.hpp"
+
+namespace
+{
+using json = nlohmann::json;
+
+// What tinygltf reads in place of a skipped resource
+const unsigned char placeholder[1] = {0};
+
+size_t count(const json &gltf, const char *key)
+{
+  const auto it = gltf.find(key);
+  return it != gltf.end() && it->is_array() ? it->size() : 0;
+}
+
+// value if it is a valid index in an array of `size` elements, else -1
+int toIndex(const json &value, size_t size)
+{
+  if (!value.is_number_integer()) {
+    return -1;
+  }
+  const auto idx = value.get<int64_t>();
+  return idx >= 0 && size_t(idx) < size ? int(idx) : -1;
+}
+
+int getIndex(const json &object, const char *key, size_t size)
+{
+  const auto it = object.find(key);
+  return it != object.end() ? toIndex(*it, size) : -1;
+}
+
+bool endsWith(const std::string &str, const std::string &suffix)
+{
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Flags the objects of the file used by one scene, following the references
+// from nodes down to buffers
+struct Reachable
+{
+  explicit Reachable(const json &gltf) :
+      m_gltf(gltf),
+      nodes(count(gltf, "nodes")),
+      meshes(count(gltf, "meshes")),
+      materials(count(gltf, "materials")),
+      textures(count(gltf, "textures")),
+      images(count(gltf, "images")),
+      accessors(count(gltf, "accessors")),
+      bufferViews(count(gltf, "bufferViews")),
+      buffers(count(gltf, "buffers"))
+  {
+  }
+
+  void visitScene(int sceneIdx)
+  {
+    std::vector<int> stack;
+    const auto &scene = m_gltf["scenes"][sceneIdx];
+    for (const auto &node : scene.value("nodes", json::array())) {
+      if (node.is_number_integer()) {
+        stack.push_back(node.get<int>());
+      }
+    }
+    while (!stack.empty()) {
+      const auto nodeIdx = stack.back();
+      stack.pop_back();
+      if (nodeIdx < 0 || size_t(nodeIdx) >= nodes.size() || nodes[nodeIdx]) {
+        continue;
+      }
+      nodes[nodeIdx] = true;
+      const auto &node = m_gltf["nodes"][nodeIdx];
+      for (const auto &child : node.value("children", json::array())) {
+        if (child.is_number_integer()) {
+          stack.push_back(child.get<int>());
+        }
+      }
+      // Coarser levels of MSFT_lod are not children but are drawn too
+      const auto extensions = node.value("extensions", json::object());
+      const auto lod = extensions.value("MSFT_lod", json::object());
+      for (const auto &lodNode : lod.value("ids", json::array())) {
+        if (lodNode.is_number_integer()) {
+          stack.push_back(lodNode.get<int>());
+        }
+      }
+      visitMesh(getIndex(node, "mesh", meshes.size()));
+      const auto skinIdx = getIndex(node, "skin", count(m_gltf, "skins"));
+      if (skinIdx >= 0) {
+        visitAccessor(getIndex(m_gltf["skins"][skinIdx], "inverseBindMatrices", accessors.size()));
+      }
+    }
+
+    // Animations of the nodes we keep
+    for (const auto &animation : m_gltf.value("animations", json::array())) {
+      const auto samplers = animation.value("samplers", json::array());
+      for (const auto &channel : animation.value("channels", json::array())) {
+        const auto target = channel.value("target", json::object());
+        const auto nodeIdx = getIndex(target, "node", nodes.size());
+        const auto samplerIdx = getIndex(channel, "sampler", samplers.size());
+        if (nodeIdx >= 0 && nodes[nodeIdx] && samplerIdx >= 0) {
+          visitAccessor(getIndex(samplers[samplerIdx], "input", accessors.size()));
+          visitAccessor(getIndex(samplers[samplerIdx], "output", accessors.size()));
+        }
+      }
+    }
+  }
+
+  const json &m_gltf;
+  std::vector<bool> nodes, meshes, materials, textures, images, accessors,
+      bufferViews, buffers;
+
+  void visitMesh(int meshIdx)
+  {
+    if (meshIdx < 0 || meshes[meshIdx]) {
+      return;
+    }
+    meshes[meshIdx] = true;
+    for (const auto &primitive :
+        m_gltf["meshes"][meshIdx].value("primitives", json::array())) {
+      for (const auto &attribute : primitive.value("attributes", json::object())) {
+        visitAccessor(toIndex(attribute, accessors.size()));
+      }
+      for (const auto &target : primitive.value("targets", json::array())) {
+        for (const auto &attribute : target) {
+          visitAccessor(toIndex(attribute, accessors.size()));
+        }
+      }
+      visitAccessor(getIndex(primitive, "indices", accessors.size()));
+      visitMaterial(getIndex(primitive, "material", materials.size()));
+      // Compressed geometry (KHR_draco_mesh_compression...)
+      for (const auto &extension : primitive.value("extensions", json::object())) {
+        if (extension.is_object()) {
+          visitBufferView(getIndex(extension, "bufferView", bufferViews.size()));
+        }
+      }
+    }
+  }
+
+  void visitMaterial(int materialIdx)
+  {
+    if (materialIdx < 0 || materials[materialIdx]) {
+      return;
+    }
+    materials[materialIdx] = true;
+    visitTextureInfos(m_gltf["materials"][materialIdx]);
+  }
+
+  // Texture infos are the objects named "...Texture", in the material itself,
+  // pbrMetallicRoughness or material extensions
+  void visitTextureInfos(const json &object)
+  {
+    for (auto it = object.begin(); it != object.end(); ++it) {
+      if (!it->is_object()) {
+        continue;
+      }
+      if (endsWith(it.key(), "Texture")) {
+        visitTexture(getIndex(*it, "index", textures.size()));
+      }
+      visitTextureInfos(*it);
+    }
+  }
+
+  void visitTexture(int textureIdx)
+  {
+    if (textureIdx < 0 || textures[textureIdx]) {
+      return;
+    }
+    textures[textureIdx] = true;
+    const auto &texture = m_gltf["textures"][textureIdx];
+    visitImage(getIndex(texture, "source", images.size()));
+    // Alternative sources (KHR_texture_basisu, MSFT_texture_dds...)
+    for (const auto &extension : texture.value("extensions", json::object())) {
+      if (extension.is_object()) {
+        visitImage(getIndex(extension, "source", images.size()));
+      }
+    }
+  }
+
+  void visitImage(int imageIdx)
+  {
+    if (imageIdx < 0 || images[imageIdx]) {
+      return;
+    }
+    images[imageIdx] = true;
+    visitBufferView(getIndex(m_gltf["images"][imageIdx], "bufferView", bufferViews.size()));
+  }
+
+  void visitAccessor(int accessorIdx)
+  {
+    if (accessorIdx < 0 || accessors[accessorIdx]) {
+      return;
+    }
+    accessors[accessorIdx] = true;
+    const auto &accessor = m_gltf["accessors"][accessorIdx];
+    visitBufferView(getIndex(accessor, "bufferView", bufferViews.size()));
+    if (accessor.count("sparse") && accessor["sparse"].is_object()) {
+      const auto &sparse = accessor["sparse"];
+      for (const auto key : {"indices", "values"}) {
+        if (sparse.count(key)) {
+          visitBufferView(getIndex(sparse[key], "bufferView", bufferViews.size()));
+        }
+      }
+    }
+  }
+
+  void visitBufferView(int bufferViewIdx)
+  {
+    if (bufferViewIdx < 0 || bufferViews[bufferViewIdx]) {
+      return;
+    }
+    bufferViews[bufferViewIdx] = true;
+    const auto &bufferView = m_gltf["bufferViews"][bufferViewIdx];
+    const auto bufferIdx = getIndex(bufferView, "buffer", buffers.size());
+    if (bufferIdx >= 0) {
+      buffers[bufferIdx] = true;
+    }
+    // Compressed data in another buffer (EXT_meshopt_compression)
+    for (const auto &extension : bufferView.value("extensions", json::object())) {
+      if (extension.is_object()) {
+        const auto idx = getIndex(extension, "buffer", buffers.size());
+        if (idx >= 0) {
+          buffers[idx] = true;
+        }
+      }
+    }
+  }
+};
+
+// Size of what tinygltf would read for uri: a file or base64 data
+size_t getUriByteSize(const std::string &uri, const std::string &baseDir)
+{
+  if (uri.compare(0, 5, "data:") == 0) {
+    const auto comma = uri.find(',');
+    return comma != std::string::npos ? (uri.size() - comma - 1) / 4 * 3 : 0;
+  }
+  try {
+    return size_t(fs::file_size(VirtualFileSystem::joinPath(baseDir, uri)));
+  } catch (const std::exception &) {
+    return 0; // tinygltf would have reported it
+  }
+}
+
+} // namespace
+
+void SceneResourceFilter::apply(
+    json &gltf, VirtualFileSystem &vfs, const std::string &baseDir)
+{
+  const auto sceneIdx = getIndex(gltf, "scene", count(gltf, "scenes"));
+  if (sceneIdx < 0) {
+    return; // The viewer would show nothing, don't guess
+  }
+  Reachable reachable(gltf);
+  reachable.visitScene(sceneIdx);
+
+  // Only buffers with a uri: the BIN chunk of a glb is mapped, never read
+  for (size_t i = 0; i < reachable.buffers.size(); ++i) {
+    auto &buffer = gltf["buffers"][i];
+    if (reachable.buffers[i] || !buffer.count("uri") || !buffer["uri"].is_string()) {
+      continue;
+    }
+    m_skippedBytes += buffer.value("byteLength", size_t(0));
+    m_buffers.push_back({i, {{"uri", buffer["uri"]}}});
+    const auto name = "__skipped_buffer_" + std::to_string(i);
+    vfs.addFile(VirtualFileSystem::joinPath(baseDir, name), {placeholder, 1});
+    buffer["uri"] = name;
+    buffer["byteLength"] = 1;
+  }
+
+  m_skippedImages.assign(reachable.images.size(), false);
+  for (size_t i = 0; i < reachable.images.size(); ++i) {
+    auto &image = gltf["images"][i];
+    if (reachable.images[i]) {
+      continue;
+    }
+    json original = json::object();
+    if (image.count("uri") && image["uri"].is_string()) {
+      m_skippedBytes += getUriByteSize(image["uri"].get<std::string>(), baseDir);
+      original["uri"] = image["uri"];
+    }
+    if (image.count("bufferView")) {
+      // tinygltf reads it from the buffer without checking its size
+      original["bufferView"] = image["bufferView"];
+      image.erase("bufferView");
+    }
+    m_images.push_back({i, original});
+    m_skippedImages[i] = true;
+    const auto name = "__skipped_image_" + std::to_string(i);
+    vfs.addFile(VirtualFileSystem::joinPath(baseDir, name), {placeholder, 1});
+    image["uri"] = name;
+  }
+}
+
+void SceneResourceFilter::restore(
+    tinygltf::Model &model, std::vector<BufferSpan> &bufferSpans) const
+{
+  for (const auto &skipped : m_buffers) {
+    if (skipped.index >= model.buffers.size()) {
+      continue;
+    }
+    auto &buffer = model.buffers[skipped.index];
+    buffer.uri = skipped.original["uri"].get<std::string>();
+    buffer.data.clear();
+    buffer.data.shrink_to_fit();
+    if (skipped.index < bufferSpans.size()) {
+      bufferSpans[skipped.index] = {};
+    }
+  }
+  for (const auto &skipped : m_images) {
+    if (skipped.index >= model.images.size()) {
+      continue;
+    }
+    auto &image = model.images[skipped.index];
+    image.uri = skipped.original.value("uri", std::string());
+    image.bufferView = skipped.original.value("bufferView", -1);
+  }
+}
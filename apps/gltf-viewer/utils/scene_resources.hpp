@@ -0,0 +1,47 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "virtual_fs.hpp"
+
+#include <json.hpp>
+#include <string>
+#include <tiny_gltf.h>
+#include <vector>
+
+// Keeps tinygltf from reading the buffers and images that no node of the
+// default scene uses (other scenes, unused LODs or materials...).
+// apply() is a GltfJsonPatch: skipped resources get a one byte placeholder
+// served from memory instead of their uri. After loading, restore() puts the
+// original uris back and leaves the skipped buffers empty; skipped images
+// are left undecoded if the image loader honours skippedImages().
+// Nothing is skipped if the file does not have a default scene.
+class SceneResourceFilter
+{
+public:
+  void apply(nlohmann::json &gltf, VirtualFileSystem &vfs,
+      const std::string &baseDir);
+
+  void restore(tinygltf::Model &model, std::vector<BufferSpan> &bufferSpans) const;
+
+  // skippedImages()[i] is true if model.images[i] must not be decoded
+  const std::vector<bool> &skippedImages() const { return m_skippedImages; }
+
+  size_t skippedBufferCount() const { return m_buffers.size(); }
+
+  size_t skippedImageCount() const { return m_images.size(); }
+
+  // Bytes of external files and embedded data that were not read
+  size_t skippedBytes() const { return m_skippedBytes; }
+
+private:
+  struct Skipped
+  {
+    size_t index;
+    nlohmann::json original; // Fields we replaced
+  };
+
+  std::vector<Skipped> m_buffers;
+  std::vector<Skipped> m_images;
+  std::vector<bool> m_skippedImages;
+  size_t m_skippedBytes = 0;
+};
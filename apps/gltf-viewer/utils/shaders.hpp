@@ -1,6 +1,8 @@
 #pragma once
 
+#include "embedded_shaders.hpp"
 #include "filesystem.hpp"
+#include <algorithm>
 #include <fstream>
 #include <glad/glad.h>
 #include <iostream>
@@ -9,6 +11,7 @@
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 
 class GLShader
@@ -66,8 +69,14 @@ public:
   }
 };
 
+// The embedded copy of the shader unless shaders are read from disk (see
+// setEmbeddedShadersEnabled)
 inline std::string loadShaderSource(const fs::path &filepath)
 {
+  if (const auto shader = findEmbeddedShader(filepath)) {
+    return std::string(shader->source, shader->size);
+  }
+
   std::ifstream input(filepath.string());
   if (!input) {
     std::stringstream ss;
@@ -81,6 +90,75 @@ inline std::string loadShaderSource(const fs::path &filepath)
   return buffer.str();
 }
 
+// Append the source of filepath to output, with its #include "file"
+// directives replaced by the files (relative to the including one, each
+// included once). #line directives keep the line numbers of compile errors,
+// their source string numbers are the indices of the files in files.
+inline void appendShaderSource(const fs::path &filepath,
+    std::vector<fs::path> &files, std::string &output)
+{
+  const auto fileIdx = files.size();
+  files.push_back(filepath);
+  std::istringstream input(loadShaderSource(filepath));
+  std::string line;
+  for (size_t lineIdx = 1; std::getline(input, line); ++lineIdx) {
+    const auto start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+      output += line;
+      output += '\n';
+      continue;
+    }
+    const auto open = line.find('"', start + 8);
+    const auto close =
+        open == std::string::npos ? open : line.find('"', open + 1);
+    if (close == std::string::npos) {
+      std::stringstream ss;
+      ss << "Invalid #include in " << filepath << ":" << lineIdx;
+      throw std::runtime_error(ss.str());
+    }
+    const auto includePath =
+        filepath.parent_path() / line.substr(open + 1, close - open - 1);
+    if (std::find(begin(files), end(files), includePath) != end(files)) {
+      output += '\n';
+      continue;
+    }
+    output += "#line 1 " + std::to_string(files.size()) + "\n";
+    appendShaderSource(includePath, files, output);
+    output += "#line " + std::to_string(lineIdx + 1) + " " +
+              std::to_string(fileIdx) + "\n";
+  }
+}
+
+// Source of the shader with its includes (see appendShaderSource) and a
+// #define for each of defines after its #version line
+inline std::string preprocessShaderSource(
+    const fs::path &filepath, const std::vector<std::string> &defines = {})
+{
+  std::vector<fs::path> files;
+  std::string source;
+  appendShaderSource(filepath, files, source);
+  if (defines.empty()) {
+    return source;
+  }
+
+  auto position = source.find("#version");
+  size_t lineIdx = 1;
+  if (position == std::string::npos) {
+    position = 0;
+  } else {
+    position = source.find('\n', position);
+    position = position == std::string::npos ? source.size() : position + 1;
+    lineIdx += std::count(source.begin(), source.begin() + position, '\n');
+  }
+  std::string header;
+  for (const auto &define : defines) {
+    header += "#define " + define + "\n";
+  }
+  header += "#line " + std::to_string(lineIdx) + " 0\n";
+  source.insert(position, header);
+  return source;
+}
+
 template <typename StringType>
 GLShader compileShader(GLenum type, StringType &&src)
 {
@@ -93,12 +171,15 @@ GLShader compileShader(GLenum type, StringType &&src)
   return shader;
 }
 
-// Load and compile a shader according to the following naming convention:
+// Load a shader (see preprocessShaderSource) and start its compilation,
+// without waiting for its status, according to the following naming
+// convention:
 // *.vs.glsl -> vertex shader
 // *.fs.glsl -> fragment shader
 // *.gs.glsl -> geometry shader
 // *.cs.glsl -> compute shader
-inline GLShader loadShader(const fs::path &shaderPath)
+inline GLShader submitShader(
+    const fs::path &shaderPath, const std::vector<std::string> &defines = {})
 {
   static auto extToShaderType =
       std::unordered_map<std::string, std::pair<GLenum, std::string>>(
@@ -118,8 +199,15 @@ inline GLShader loadShader(const fs::path &shaderPath)
             << "\n";
 
   GLShader shader{(*it).second.first};
-  shader.setSource(loadShaderSource(shaderPath));
-  shader.compile();
+  shader.setSource(preprocessShaderSource(shaderPath, defines));
+  glCompileShader(shader.glId());
+  return shader;
+}
+
+// Load and compile a shader, see submitShader
+inline GLShader loadShader(const fs::path &shaderPath)
+{
+  auto shader = submitShader(shaderPath);
   if (!shader.getCompileStatus()) {
     std::cerr << "Shader compilation error:" << shader.getInfoLog()
               << std::endl;
@@ -244,17 +332,70 @@ template <typename CSrc> GLProgram buildComputeProgram(CSrc &&src)
   ;
 }
 
-inline GLProgram compileProgram(std::vector<fs::path> shaderPaths)
+// Program compiled and linked by the driver without waiting: statuses are
+// only read by finish(), so that a driver with KHR_parallel_shader_compile
+// builds several programs in the background, in parallel.
+// defines are given to every shader, retrievableBinary: the driver keeps
+// what glGetProgramBinary needs
+class PendingProgram
 {
-  GLProgram program;
-  for (const auto &path : shaderPaths) {
-    auto shader = loadShader(path);
-    program.attachShader(shader);
+public:
+  explicit PendingProgram(std::vector<fs::path> shaderPaths,
+      const std::vector<std::string> &defines = {},
+      bool retrievableBinary = false)
+      : m_shaderPaths(std::move(shaderPaths))
+  {
+    if (retrievableBinary) {
+      glProgramParameteri(
+          m_program.glId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    for (const auto &path : m_shaderPaths) {
+      m_shaders.push_back(submitShader(path, defines));
+      m_program.attachShader(m_shaders.back());
+    }
+    glLinkProgram(m_program.glId());
+  }
+
+  // Only with KHR_parallel_shader_compile, without it the driver blocks on
+  // the first status query anyway
+  bool isComplete() const
+  {
+    const GLenum COMPLETION_STATUS_KHR = 0x91B1; // Not in our GL loader
+    GLint complete = GL_FALSE;
+    glGetProgramiv(m_program.glId(), COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
   }
-  program.link();
-  if (!program.getLinkStatus()) {
-    std::cerr << "Program link error:" << program.getInfoLog() << std::endl;
-    throw std::runtime_error("Program link error:" + program.getInfoLog());
+
+  // Wait for the program, throws on compile or link errors
+  GLProgram finish()
+  {
+    if (!m_program.getLinkStatus()) {
+      // The link fails if a shader did not compile, its log says why
+      for (size_t i = 0; i < m_shaders.size(); ++i) {
+        if (!m_shaders[i].getCompileStatus()) {
+          std::cerr << "Shader compilation error in " << m_shaderPaths[i]
+                    << ":" << m_shaders[i].getInfoLog() << std::endl;
+          throw std::runtime_error(
+              "Shader compilation error:" + m_shaders[i].getInfoLog());
+        }
+      }
+      std::cerr << "Program link error:" << m_program.getInfoLog()
+                << std::endl;
+      throw std::runtime_error("Program link error:" + m_program.getInfoLog());
+    }
+    m_shaders.clear();
+    return std::move(m_program);
   }
-  return program;
+
+private:
+  GLProgram m_program;
+  std::vector<GLShader> m_shaders;
+  std::vector<fs::path> m_shaderPaths;
+};
+
+// retrievableBinary: the driver keeps what glGetProgramBinary needs
+inline GLProgram compileProgram(
+    std::vector<fs::path> shaderPaths, bool retrievableBinary = false)
+{
+  return PendingProgram(std::move(shaderPaths), {}, retrievableBinary).finish();
 }
@@ -0,0 +1,102 @@
+#include "texture_channels.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+bool isOpaque(const BufferSpan &pixels, int components, int channel, int channelSize)
+{
+  const auto pixelSize = size_t(components) * channelSize;
+  for (size_t offset = channel * channelSize; offset < pixels.size; offset += pixelSize) {
+    if (channelSize == 2) {
+      uint16_t value;
+      std::memcpy(&value, pixels.data + offset, sizeof(value));
+      if (value != 0xffff) {
+        return false;
+      }
+    } else if (pixels.data[offset] != 0xff) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+void packImageChannels(tinygltf::Model &model,
+    std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool)
+{
+  const auto usages = getImageUsages(model);
+  imageEncodings.resize(model.images.size());
+  pool.parallelFor(model.images.size(), [&](size_t i) {
+    auto &image = model.images[i];
+    auto &encoding = imageEncodings[i];
+    const auto &usage = usages[i];
+    const auto components = image.component;
+    const auto channelSize = image.bits / 8;
+    if (encoding.format != TextureFormat::Raw || encoding.levelCount > 1 ||
+        !imageSpans[i].size || components < 1 || components > 4 || channelSize < 1 ||
+        (!usage.color && !usage.metallicRoughness && !usage.normal && !usage.occlusion)) {
+      return;
+    }
+
+    // Stored channel of R, G, B and A, -1 if there is none. Gray images have
+    // one channel for R, G and B.
+    int sources[4] = {0, 1, 2, components == 4 ? 3 : -1};
+    if (components <= 2) {
+      sources[1] = sources[2] = 0;
+      sources[3] = components == 2 ? 1 : -1;
+    }
+    bool needed[4] = {
+        usage.color || usage.normal || usage.occlusion,
+        usage.color || usage.normal || usage.metallicRoughness,
+        usage.color || usage.normal || usage.metallicRoughness,
+        usage.color && sources[3] >= 0,
+    };
+    if (needed[3] && isOpaque(imageSpans[i], components, sources[3], channelSize)) {
+      needed[3] = false;
+    }
+
+    // Kept channels in their stored order
+    bool kept[4] = {false, false, false, false};
+    for (int c = 0; c < 4; ++c) {
+      if (needed[c]) {
+        kept[sources[c]] = true;
+      }
+    }
+    int packedIndex[4] = {-1, -1, -1, -1};
+    int packedCount = 0;
+    for (int k = 0; k < components; ++k) {
+      if (kept[k]) {
+        packedIndex[k] = packedCount++;
+      }
+    }
+    for (int c = 0; c < 4; ++c) {
+      if (sources[c] >= 0 && packedIndex[sources[c]] >= 0) {
+        encoding.swizzle[c] = uint8_t(packedIndex[sources[c]]);
+      } else {
+        encoding.swizzle[c] = c == 3 ? SWIZZLE_ONE : SWIZZLE_ZERO;
+      }
+    }
+    if (packedCount == components) {
+      return; // Nothing to drop
+    }
+
+    const auto pixelCount = size_t(image.width) * image.height;
+    std::vector<unsigned char> packed(pixelCount * packedCount * channelSize);
+    const auto src = imageSpans[i].data;
+    auto dst = packed.data();
+    for (size_t p = 0; p < pixelCount; ++p) {
+      for (int k = 0; k < components; ++k) {
+        if (kept[k]) {
+          std::memcpy(dst, src + (p * components + k) * channelSize, channelSize);
+          dst += channelSize;
+        }
+      }
+    }
+    image.image = std::move(packed);
+    image.component = packedCount;
+    imageSpans[i] = {image.image.data(), image.image.size()};
+  });
+}
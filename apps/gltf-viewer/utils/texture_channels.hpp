@@ -0,0 +1,19 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "texture_compression.hpp"
+#include "thread_pool.hpp"
+
+#include <tiny_gltf.h>
+#include <vector>
+
+// Keep only the channels of the decoded images that the materials sample: R
+// for occlusion maps, G and B for metallic-roughness maps, all three for
+// packed occlusion-roughness-metallic maps, RGB and alpha (if not opaque) for
+// colors. The kept channels are packed, so that R8, RG8 or RGB8 storage can
+// be used, and imageEncodings[i].swizzle tells where each one is.
+// Images that are compressed, have stored mip levels or are unused are left
+// as they are.
+void packImageChannels(tinygltf::Model &model,
+    std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool);
@@ -0,0 +1,255 @@
+#include "texture_compression.hpp"
+#include "bcn_encoder.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+void addUsage(const tinygltf::Model &model, int textureIdx,
+    std::vector<ImageUsage> &usages, bool ImageUsage::*flag)
+{
+  if (textureIdx < 0 || size_t(textureIdx) >= model.textures.size()) {
+    return;
+  }
+  const auto source = model.textures[textureIdx].source;
+  if (source >= 0 && size_t(source) < usages.size()) {
+    usages[source].*flag = true;
+  }
+}
+
+// Encode an 8 bits image, one task per row of blocks. Blocks on the right and
+// bottom edges repeat the last pixels. Missing channels are 0, alpha is 255.
+void compressLevel(TextureFormat format, const unsigned char *pixels,
+    int width, int height, int components, unsigned char *out, ThreadPool &pool)
+{
+  const auto blocksX = size_t(width + 3) / 4;
+  const auto blocksY = size_t(height + 3) / 4;
+  const auto blockByteSize = getBlockByteSize(format);
+  pool.parallelFor(blocksY, [&](size_t by) {
+    unsigned char block[64];
+    for (int i = 0; i < 16; ++i) {
+      block[i * 4 + 1] = block[i * 4 + 2] = 0;
+      block[i * 4 + 3] = 255;
+    }
+    for (size_t bx = 0; bx < blocksX; ++bx) {
+      for (int y = 0; y < 4; ++y) {
+        const auto srcY = std::min(by * 4 + y, size_t(height - 1));
+        for (int x = 0; x < 4; ++x) {
+          const auto srcX = std::min(bx * 4 + x, size_t(width - 1));
+          std::copy_n(pixels + (srcY * width + srcX) * components, components,
+              block + (y * 4 + x) * 4);
+        }
+      }
+      const auto dst = out + (by * blocksX + bx) * blockByteSize;
+      switch (format) {
+      case TextureFormat::BC1:
+        encodeBC1Block(block, dst);
+        break;
+      case TextureFormat::BC3:
+        encodeBC3Block(block, dst);
+        break;
+      case TextureFormat::BC4:
+        encodeBC4Block(block, 0, dst);
+        break;
+      case TextureFormat::BC5:
+        encodeBC5Block(block, dst);
+        break;
+      case TextureFormat::BC7:
+        encodeBC7Block(block, dst);
+        break;
+      default:
+        break;
+      }
+    }
+  });
+}
+
+} // namespace
+
+size_t getBlockByteSize(TextureFormat format)
+{
+  switch (format) {
+  case TextureFormat::BC1:
+    return BC1_BLOCK_SIZE;
+  case TextureFormat::BC3:
+    return BC3_BLOCK_SIZE;
+  case TextureFormat::BC4:
+    return BC4_BLOCK_SIZE;
+  case TextureFormat::BC5:
+    return BC5_BLOCK_SIZE;
+  case TextureFormat::BC7:
+    return BC7_BLOCK_SIZE;
+  default:
+    return 0;
+  }
+}
+
+int getLevelWidth(const tinygltf::Image &image, int level)
+{
+  return std::max(image.width >> level, 1);
+}
+
+int getLevelHeight(const tinygltf::Image &image, int level)
+{
+  return std::max(image.height >> level, 1);
+}
+
+size_t getLevelByteSize(
+    const tinygltf::Image &image, TextureFormat format, int level)
+{
+  const size_t width = getLevelWidth(image, level);
+  const size_t height = getLevelHeight(image, level);
+  if (format == TextureFormat::Raw) {
+    return width * height * image.component * (image.bits / 8);
+  }
+  return (width + 3) / 4 * ((height + 3) / 4) * getBlockByteSize(format);
+}
+
+int getMipLevelCount(const tinygltf::Image &image)
+{
+  return int(std::log2(std::max(image.width, image.height))) + 1;
+}
+
+bool isMipmapFilter(int minFilter)
+{
+  return minFilter == TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST ||
+         minFilter == TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR ||
+         minFilter == TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST ||
+         minFilter == TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR;
+}
+
+std::vector<ImageUsage> getImageUsages(const tinygltf::Model &model)
+{
+  std::vector<ImageUsage> usages(model.images.size());
+  for (const auto &material : model.materials) {
+    const auto &pbr = material.pbrMetallicRoughness;
+    addUsage(model, pbr.baseColorTexture.index, usages, &ImageUsage::color);
+    addUsage(model, material.emissiveTexture.index, usages, &ImageUsage::color);
+    addUsage(model, pbr.metallicRoughnessTexture.index, usages,
+        &ImageUsage::metallicRoughness);
+    addUsage(model, material.normalTexture.index, usages, &ImageUsage::normal);
+    addUsage(model, material.occlusionTexture.index, usages, &ImageUsage::occlusion);
+  }
+  for (const auto &texture : model.textures) {
+    if (texture.source >= 0 && size_t(texture.source) < usages.size() &&
+        texture.sampler >= 0 && size_t(texture.sampler) < model.samplers.size() &&
+        isMipmapFilter(model.samplers[texture.sampler].minFilter)) {
+      usages[texture.source].mipmaps = true;
+    }
+  }
+  return usages;
+}
+
+TextureFormat chooseTextureFormat(const tinygltf::Image &image,
+    const BufferSpan &pixels, const ImageUsage &usage, bool allowS3tc)
+{
+  if (image.bits != 8 || !pixels.size) {
+    return TextureFormat::Raw;
+  }
+  if (image.component == 1) {
+    return TextureFormat::BC4;
+  }
+  if (image.component == 2 || (usage.normal && !usage.color && !usage.metallicRoughness)) {
+    return TextureFormat::BC5;
+  }
+  if (usage.occlusion && !usage.color && !usage.metallicRoughness && !usage.normal) {
+    return TextureFormat::BC4;
+  }
+
+  bool hasAlpha = false;
+  for (size_t i = 3; image.component == 4 && i < pixels.size && !hasAlpha; i += 4) {
+    hasAlpha = pixels.data[i] != 255;
+  }
+  if (!allowS3tc || (usage.color && hasAlpha)) {
+    return TextureFormat::BC7;
+  }
+  return hasAlpha ? TextureFormat::BC3 : TextureFormat::BC1;
+}
+
+void compressImages(tinygltf::Model &model, std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool, bool allowS3tc)
+{
+  const auto usages = getImageUsages(model);
+  imageEncodings.resize(model.images.size());
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    auto &image = model.images[i];
+    if (imageEncodings[i].format != TextureFormat::Raw) {
+      continue;
+    }
+    const auto format = chooseTextureFormat(image, imageSpans[i], usages[i], allowS3tc);
+    if (format == TextureFormat::Raw) {
+      continue;
+    }
+    // Compressed textures can't use glGenerateMipmap, all the levels
+    // computed by generateMipmaps are encoded
+    const auto levelCount = imageEncodings[i].levelCount;
+    std::vector<size_t> levelOffsets(levelCount + 1, 0);
+    for (int level = 0; level < levelCount; ++level) {
+      levelOffsets[level + 1] = levelOffsets[level] + getLevelByteSize(image, format, level);
+    }
+
+    std::vector<unsigned char> compressed(levelOffsets.back());
+    auto pixels = imageSpans[i].data;
+    for (int level = 0; level < levelCount; ++level) {
+      const auto width = getLevelWidth(image, level);
+      const auto height = getLevelHeight(image, level);
+      compressLevel(format, pixels, width, height, image.component,
+          compressed.data() + levelOffsets[level], pool);
+      pixels += getLevelByteSize(image, TextureFormat::Raw, level);
+    }
+
+    image.image = std::move(compressed);
+    imageSpans[i] = {image.image.data(), image.image.size()};
+    imageEncodings[i].format = format;
+  }
+}
+
+std::vector<size_t> findDuplicateImages(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &imageSpans,
+    const std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool)
+{
+  std::vector<uint64_t> hashes(model.images.size(), 0);
+  pool.parallelFor(model.images.size(), [&](size_t i) {
+    const auto &image = model.images[i];
+    const auto &encoding = imageEncodings[i];
+    const int32_t header[] = {image.width, image.height, image.component,
+        image.bits, int32_t(encoding.format), encoding.levelCount};
+    const auto seed = hashBytes(encoding.swizzle, sizeof(encoding.swizzle),
+        hashBytes(header, sizeof(header)));
+    hashes[i] = hashBytes(imageSpans[i].data, imageSpans[i].size, seed);
+  });
+
+  std::vector<size_t> firstImages(model.images.size());
+  std::unordered_multimap<uint64_t, size_t> uniqueImages;
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    firstImages[i] = i;
+    const auto &span = imageSpans[i];
+    if (!span.size) {
+      continue;
+    }
+    const auto range = uniqueImages.equal_range(hashes[i]);
+    for (auto it = range.first; it != range.second; ++it) {
+      const auto &image = model.images[i];
+      const auto &other = model.images[it->second];
+      const auto &otherSpan = imageSpans[it->second];
+      if (image.width == other.width && image.height == other.height &&
+          image.component == other.component && image.bits == other.bits &&
+          imageEncodings[i].format == imageEncodings[it->second].format &&
+          imageEncodings[i].levelCount == imageEncodings[it->second].levelCount &&
+          std::memcmp(imageEncodings[i].swizzle, imageEncodings[it->second].swizzle, 4) == 0 &&
+          span.size == otherSpan.size &&
+          std::memcmp(span.data, otherSpan.data, span.size) == 0) {
+        firstImages[i] = it->second;
+        break;
+      }
+    }
+    if (firstImages[i] == i) {
+      uniqueImages.emplace(hashes[i], i);
+    }
+  }
+  return firstImages;
+}
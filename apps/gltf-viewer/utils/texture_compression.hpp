@@ -0,0 +1,81 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+#include <tiny_gltf.h>
+#include <vector>
+
+// Formats of the bytes of the images, as stored in their span and uploaded
+enum class TextureFormat : uint32_t
+{
+  Raw, // Decoded pixels, described by the tinygltf::Image
+  BC1, // RGB, 4 bits per pixel
+  BC3, // RGBA, 8 bits per pixel
+  BC4, // R, 4 bits per pixel
+  BC5, // RG, 8 bits per pixel
+  BC7, // RGBA, 8 bits per pixel
+};
+
+// Values of ImageEncoding::swizzle for channels that are not stored
+const uint8_t SWIZZLE_ZERO = 4;
+const uint8_t SWIZZLE_ONE = 5;
+
+// Layout of the bytes of an image: its format and its number of mip levels,
+// stored one after the other from level 0
+struct ImageEncoding
+{
+  TextureFormat format = TextureFormat::Raw;
+  int32_t levelCount = 1;
+  // Stored channel read for R, G, B and A, see packImageChannels
+  uint8_t swizzle[4] = {0, 1, 2, 3};
+};
+
+// Bytes of a 4x4 block, 0 for Raw
+size_t getBlockByteSize(TextureFormat format);
+
+int getLevelWidth(const tinygltf::Image &image, int level);
+
+int getLevelHeight(const tinygltf::Image &image, int level);
+
+size_t getLevelByteSize(
+    const tinygltf::Image &image, TextureFormat format, int level);
+
+// Number of levels of a full mip chain
+int getMipLevelCount(const tinygltf::Image &image);
+
+bool isMipmapFilter(int minFilter);
+
+// How the materials of a model sample an image
+struct ImageUsage
+{
+  bool color = false; // Base color or emissive
+  bool metallicRoughness = false;
+  bool normal = false;
+  bool occlusion = false;
+  bool mipmaps = false; // Through a sampler with a mipmap filter
+};
+
+std::vector<ImageUsage> getImageUsages(const tinygltf::Model &model);
+
+// BC4 for one channel and occlusion maps, BC5 for two channels and normal
+// maps, BC7 or BC1 (without alpha)
+// for colors and BC3 or BC1 for the rest. Without S3TC support, BC7 replaces
+// BC1 and BC3. Raw if the image is not 8 bits.
+TextureFormat chooseTextureFormat(const tinygltf::Image &image,
+    const BufferSpan &pixels, const ImageUsage &usage, bool allowS3tc);
+
+// Compress the 8 bits images of model, with the mip levels they store (see
+// generateMipmaps). The compressed bytes replace the pixels in model.images
+// and imageSpans, and the format of each image is set in imageEncodings.
+// Images already compressed are left as they are.
+void compressImages(tinygltf::Model &model, std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool, bool allowS3tc);
+
+// For each image, index of the first image with the same size, encoding,
+// swizzle and bytes, so that they share their texture storage. Unique and empty images
+// are their own. Bytes are hashed on the pool, then compared on collisions.
+std::vector<size_t> findDuplicateImages(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &imageSpans,
+    const std::vector<ImageEncoding> &imageEncodings, ThreadPool &pool);
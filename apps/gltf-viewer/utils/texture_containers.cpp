@@ -0,0 +1,461 @@
+#include "texture_containers.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+using json = nlohmann::json;
+
+// What tinygltf reads in place of a container image
+const unsigned char placeholder[1] = {0};
+
+const unsigned char KTX2_IDENTIFIER[12] = {
+    0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+const size_t KTX2_HEADER_SIZE = 80; // Header and index, before the levels
+const size_t KTX2_LEVEL_SIZE = 24;
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+const size_t DDS_HEADER_SIZE = 128; // Magic and DDS_HEADER
+const size_t DDS_DX10_HEADER_SIZE = 20;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDPF_ALPHAPIXELS = 0x1;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDPF_RGB = 0x40;
+const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+// Levels of a container, pointing in its bytes
+struct ContainerLevels
+{
+  TextureFormat format = TextureFormat::Raw; // Raw is RGBA8
+  int width = 0;
+  int height = 0;
+  std::vector<BufferSpan> levels;
+};
+
+uint32_t readU32(const unsigned char *bytes)
+{
+  uint32_t value;
+  std::memcpy(&value, bytes, sizeof(value)); // Both are little endian
+  return value;
+}
+
+uint64_t readU64(const unsigned char *bytes)
+{
+  uint64_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+constexpr uint32_t fourCC(const char (&code)[5])
+{
+  return uint32_t(code[0]) | uint32_t(code[1]) << 8 | uint32_t(code[2]) << 16 |
+         uint32_t(code[3]) << 24;
+}
+
+bool isKtx2(const BufferSpan &data)
+{
+  return data.size >= sizeof(KTX2_IDENTIFIER) &&
+         std::memcmp(data.data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+}
+
+bool isDds(const BufferSpan &data)
+{
+  return data.size >= 4 && readU32(data.data) == DDS_MAGIC;
+}
+
+// sRGB variants are read as UNORM, the shaders do the conversion
+bool getKtx2Format(uint32_t vkFormat, TextureFormat &format)
+{
+  switch (vkFormat) {
+  case 37: // VK_FORMAT_R8G8B8A8_UNORM
+  case 43: // VK_FORMAT_R8G8B8A8_SRGB
+    format = TextureFormat::Raw;
+    return true;
+  case 131: // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+  case 132: // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+    format = TextureFormat::BC1;
+    return true;
+  case 137: // VK_FORMAT_BC3_UNORM_BLOCK
+  case 138: // VK_FORMAT_BC3_SRGB_BLOCK
+    format = TextureFormat::BC3;
+    return true;
+  case 139: // VK_FORMAT_BC4_UNORM_BLOCK
+    format = TextureFormat::BC4;
+    return true;
+  case 141: // VK_FORMAT_BC5_UNORM_BLOCK
+    format = TextureFormat::BC5;
+    return true;
+  case 145: // VK_FORMAT_BC7_UNORM_BLOCK
+  case 146: // VK_FORMAT_BC7_SRGB_BLOCK
+    format = TextureFormat::BC7;
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool getDxgiFormat(uint32_t dxgiFormat, TextureFormat &format)
+{
+  switch (dxgiFormat) {
+  case 28: // DXGI_FORMAT_R8G8B8A8_UNORM
+  case 29: // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+    format = TextureFormat::Raw;
+    return true;
+  case 71: // DXGI_FORMAT_BC1_UNORM
+  case 72: // DXGI_FORMAT_BC1_UNORM_SRGB
+    format = TextureFormat::BC1;
+    return true;
+  case 77: // DXGI_FORMAT_BC3_UNORM
+  case 78: // DXGI_FORMAT_BC3_UNORM_SRGB
+    format = TextureFormat::BC3;
+    return true;
+  case 80: // DXGI_FORMAT_BC4_UNORM
+    format = TextureFormat::BC4;
+    return true;
+  case 83: // DXGI_FORMAT_BC5_UNORM
+    format = TextureFormat::BC5;
+    return true;
+  case 98: // DXGI_FORMAT_BC7_UNORM
+  case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+    format = TextureFormat::BC7;
+    return true;
+  default:
+    return false;
+  }
+}
+
+tinygltf::Image makeImage(int width, int height)
+{
+  tinygltf::Image image;
+  image.width = width;
+  image.height = height;
+  image.component = 4;
+  image.bits = 8;
+  image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+  return image;
+}
+
+// https://github.khronos.org/KTX-Specification/
+bool parseKtx2(const BufferSpan &data, ContainerLevels &out, std::string &err)
+{
+  if (data.size < KTX2_HEADER_SIZE) {
+    err = "truncated KTX2 header";
+    return false;
+  }
+  const auto bytes = data.data;
+  out.width = int(readU32(bytes + 20));
+  out.height = int(readU32(bytes + 24));
+  const auto depth = readU32(bytes + 28);
+  const auto layerCount = readU32(bytes + 32);
+  const auto faceCount = readU32(bytes + 36);
+  const auto levelCount = std::max(readU32(bytes + 40), 1u);
+  if (readU32(bytes + 44) != 0) {
+    err = "supercompressed KTX2 is not supported";
+    return false;
+  }
+  if (depth > 1 || layerCount > 1 || faceCount != 1 || out.width <= 0 || out.height <= 0) {
+    err = "only 2D KTX2 textures are supported";
+    return false;
+  }
+  if (!getKtx2Format(readU32(bytes + 12), out.format)) {
+    err = "unsupported KTX2 vkFormat " + std::to_string(readU32(bytes + 12));
+    return false;
+  }
+  if (KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_SIZE > data.size) {
+    err = "truncated KTX2 level index";
+    return false;
+  }
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const auto entry = bytes + KTX2_HEADER_SIZE + level * KTX2_LEVEL_SIZE;
+    const auto offset = readU64(entry);
+    const auto length = readU64(entry + 8);
+    if (offset > data.size || length > data.size - offset) {
+      err = "KTX2 level out of the file";
+      return false;
+    }
+    out.levels.push_back({bytes + offset, size_t(length)});
+  }
+  return true;
+}
+
+// https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+bool parseDds(const BufferSpan &data, ContainerLevels &out, std::string &err)
+{
+  if (data.size < DDS_HEADER_SIZE || readU32(data.data + 4) != 124) {
+    err = "truncated DDS header";
+    return false;
+  }
+  const auto bytes = data.data;
+  const auto flags = readU32(bytes + 8);
+  out.height = int(readU32(bytes + 12));
+  out.width = int(readU32(bytes + 16));
+  const auto pixelFlags = readU32(bytes + 80);
+  const auto code = readU32(bytes + 84);
+  if (readU32(bytes + 112) & DDSCAPS2_CUBEMAP || out.width <= 0 || out.height <= 0) {
+    err = "only 2D DDS textures are supported";
+    return false;
+  }
+
+  auto offset = DDS_HEADER_SIZE;
+  bool supported = true;
+  if (pixelFlags & DDPF_FOURCC) {
+    if (code == fourCC("DXT1")) {
+      out.format = TextureFormat::BC1;
+    } else if (code == fourCC("DXT5")) {
+      out.format = TextureFormat::BC3;
+    } else if (code == fourCC("ATI1") || code == fourCC("BC4U")) {
+      out.format = TextureFormat::BC4;
+    } else if (code == fourCC("ATI2") || code == fourCC("BC5U")) {
+      out.format = TextureFormat::BC5;
+    } else if (code == fourCC("DX10")) {
+      offset += DDS_DX10_HEADER_SIZE;
+      if (data.size < offset) {
+        err = "truncated DDS DX10 header";
+        return false;
+      }
+      if (readU32(bytes + 132) != DDS_DIMENSION_TEXTURE2D || readU32(bytes + 140) > 1) {
+        err = "only 2D DDS textures are supported";
+        return false;
+      }
+      supported = getDxgiFormat(readU32(bytes + 128), out.format);
+    } else {
+      supported = false;
+    }
+  } else {
+    // Uncompressed, only in the RGBA8 layout
+    supported = pixelFlags & DDPF_RGB && readU32(bytes + 88) == 32 &&
+                readU32(bytes + 92) == 0xff && readU32(bytes + 96) == 0xff00 &&
+                readU32(bytes + 100) == 0xff0000 &&
+                (!(pixelFlags & DDPF_ALPHAPIXELS) || readU32(bytes + 104) == 0xff000000);
+    out.format = TextureFormat::Raw;
+  }
+  if (!supported) {
+    err = "unsupported DDS pixel format";
+    return false;
+  }
+
+  // Levels are stored one after the other from level 0
+  const auto levelCount = flags & DDSD_MIPMAPCOUNT ? std::max(readU32(bytes + 28), 1u) : 1u;
+  const auto image = makeImage(out.width, out.height);
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const auto size = getLevelByteSize(image, out.format, int(level));
+    if (size > data.size - offset) {
+      err = "DDS level out of the file";
+      return false;
+    }
+    out.levels.push_back({bytes + offset, size});
+    offset += size;
+  }
+  return true;
+}
+
+bool parseContainer(const BufferSpan &data, ContainerLevels &out, std::string &err)
+{
+  if (isKtx2(data)) {
+    return parseKtx2(data, out, err);
+  }
+  if (isDds(data)) {
+    return parseDds(data, out, err);
+  }
+  err = "neither a KTX2 nor a DDS file";
+  return false;
+}
+
+bool hasExtension(const std::string &uri, const std::string &extension)
+{
+  if (uri.size() < extension.size()) {
+    return false;
+  }
+  return std::equal(end(uri) - extension.size(), end(uri), begin(extension),
+      [](char a, char b) { return std::tolower(a) == b; });
+}
+
+bool isContainerImage(const json &image)
+{
+  const auto mimeType = image.value("mimeType", std::string());
+  if (mimeType == "image/ktx2" || mimeType == "image/vnd-ms.dds") {
+    return true;
+  }
+  const auto it = image.find("uri");
+  if (it == image.end() || !it->is_string()) {
+    return false;
+  }
+  const auto &uri = it->get_ref<const std::string &>();
+  return uri.compare(0, 5, "data:") != 0 &&
+         (hasExtension(uri, ".ktx2") || hasExtension(uri, ".dds"));
+}
+
+} // namespace
+
+bool TextureContainerLoader::mapFile(
+    const json &image, size_t i, const std::string &baseDir)
+{
+  if (m_files[i]) {
+    return true;
+  }
+  const auto it = image.find("uri");
+  if (it == image.end() || !it->is_string() ||
+      it->get_ref<const std::string &>().compare(0, 5, "data:") == 0) {
+    return false;
+  }
+  auto file = std::make_unique<MappedFile>();
+  if (!file->open(VirtualFileSystem::joinPath(baseDir, it->get<std::string>()))) {
+    return false;
+  }
+  m_files[i] = std::move(file);
+  return true;
+}
+
+void TextureContainerLoader::selectTextureSources(
+    json &gltf, const std::string &baseDir)
+{
+  if (!gltf.count("textures") || !gltf.count("images")) {
+    return;
+  }
+  const auto &images = gltf["images"];
+  m_files.resize(images.size());
+  for (auto &texture : gltf["textures"]) {
+    if (!texture.count("extensions") || !texture["extensions"].count("MSFT_texture_dds")) {
+      continue;
+    }
+    const auto source = texture["extensions"]["MSFT_texture_dds"].value("source", -1);
+    if (source < 0 || size_t(source) >= images.size()) {
+      continue;
+    }
+    // Images in buffer views can only be checked once loaded
+    const auto &image = images[source];
+    if (!image.count("bufferView")) {
+      ContainerLevels levels;
+      std::string err;
+      if (!mapFile(image, source, baseDir) ||
+          !parseContainer({m_files[source]->data(), m_files[source]->size()}, levels, err)) {
+        continue;
+      }
+    }
+    texture["source"] = source;
+  }
+}
+
+void TextureContainerLoader::apply(
+    json &gltf, VirtualFileSystem &vfs, const std::string &baseDir)
+{
+  if (!gltf.count("images")) {
+    return;
+  }
+  auto &images = gltf["images"];
+  m_files.resize(images.size());
+  m_containerImages.assign(images.size(), false);
+  for (size_t i = 0; i < images.size(); ++i) {
+    auto &image = images[i];
+    if ((m_skippedImages && i < m_skippedImages->size() && (*m_skippedImages)[i]) ||
+        !isContainerImage(image)) {
+      continue;
+    }
+    json original = json::object();
+    if (image.count("uri")) {
+      original["uri"] = image["uri"];
+      mapFile(image, i, baseDir);
+    }
+    if (image.count("bufferView")) {
+      original["bufferView"] = image["bufferView"];
+      image.erase("bufferView");
+    }
+    m_images.push_back({i, original});
+    m_containerImages[i] = true;
+    const auto name = "__container_image_" + std::to_string(i);
+    vfs.addFile(VirtualFileSystem::joinPath(baseDir, name), {placeholder, 1});
+    image["uri"] = name;
+  }
+}
+
+void TextureContainerLoader::load(tinygltf::Model &model,
+    const std::vector<BufferSpan> &bufferSpans,
+    std::vector<BufferSpan> &imageSpans,
+    std::vector<ImageEncoding> &imageEncodings,
+    std::vector<std::unique_ptr<MappedFile>> &files, std::string &warn)
+{
+  for (const auto &container : m_images) {
+    if (container.index >= model.images.size()) {
+      continue;
+    }
+    auto &image = model.images[container.index];
+    image.uri = container.original.value("uri", std::string());
+    image.bufferView = container.original.value("bufferView", -1);
+    const auto fail = [&](const std::string &err) {
+      warn += "Image " + std::to_string(container.index) + ": " + err + "\n";
+    };
+
+    BufferSpan data;
+    if (container.index < m_files.size() && m_files[container.index]) {
+      const auto &file = *m_files[container.index];
+      data = {file.data(), file.size()};
+    } else if (image.bufferView >= 0 && size_t(image.bufferView) < model.bufferViews.size()) {
+      const auto &bufferView = model.bufferViews[image.bufferView];
+      if (bufferView.buffer < 0 || size_t(bufferView.buffer) >= bufferSpans.size() ||
+          bufferView.byteOffset + bufferView.byteLength > bufferSpans[bufferView.buffer].size) {
+        fail("buffer view out of its buffer");
+        continue;
+      }
+      data = {bufferSpans[bufferView.buffer].data + bufferView.byteOffset, bufferView.byteLength};
+    } else {
+      fail("unable to read the KTX2 or DDS file " + image.uri);
+      continue;
+    }
+
+    ContainerLevels levels;
+    std::string err;
+    if (!parseContainer(data, levels, err)) {
+      fail(err);
+      continue;
+    }
+
+    // Levels in order and without padding are used in place
+    const auto layout = makeImage(levels.width, levels.height);
+    bool inPlace = true;
+    size_t size = 0;
+    const auto levelCount = std::min<int>(int(levels.levels.size()), getMipLevelCount(layout));
+    for (int level = 0; level < levelCount; ++level) {
+      const auto levelSize = getLevelByteSize(layout, levels.format, level);
+      if (levels.levels[level].size < levelSize) {
+        err = "level " + std::to_string(level) + " is too small";
+        break;
+      }
+      inPlace = inPlace && levels.levels[level].data == levels.levels[0].data + size;
+      size += levelSize;
+    }
+    if (!err.empty()) {
+      fail(err);
+      continue;
+    }
+
+    image.width = layout.width;
+    image.height = layout.height;
+    image.component = layout.component;
+    image.bits = layout.bits;
+    image.pixel_type = layout.pixel_type;
+    if (inPlace) {
+      imageSpans[container.index] = {levels.levels[0].data, size};
+    } else {
+      // KTX2 stores the smallest level first
+      image.image.resize(size);
+      size_t offset = 0;
+      for (int level = 0; level < levelCount; ++level) {
+        const auto levelSize = getLevelByteSize(layout, levels.format, level);
+        std::memcpy(image.image.data() + offset, levels.levels[level].data, levelSize);
+        offset += levelSize;
+      }
+      imageSpans[container.index] = {image.image.data(), size};
+    }
+    imageEncodings[container.index] = {levels.format, levelCount};
+  }
+
+  for (auto &file : m_files) {
+    if (file) {
+      files.push_back(std::move(file));
+    }
+  }
+  m_files.clear();
+}
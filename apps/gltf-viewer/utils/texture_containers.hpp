@@ -0,0 +1,69 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "mapped_file.hpp"
+#include "texture_compression.hpp"
+#include "virtual_fs.hpp"
+
+#include <json.hpp>
+#include <memory>
+#include <string>
+#include <tiny_gltf.h>
+#include <vector>
+
+// Loads the images stored in KTX2 or DDS files, already in a GPU format and
+// with their mip levels, instead of decoding them. Images are recognized by
+// the extension of their uri or by their mimeType ("image/ktx2",
+// "image/vnd-ms.dds"). Supported formats are BC1, BC3, BC4, BC5, BC7 and
+// RGBA8, without supercompression.
+// Usage, around the scene filter: selectTextureSources() then apply() while
+// patching the JSON, load() once tinygltf is done. The image loader must skip
+// containerImages().
+class TextureContainerLoader
+{
+public:
+  // Images i with (*skipped)[i] set are ignored.
+  // skipped must stay alive until load().
+  void setSkippedImages(const std::vector<bool> *skipped)
+  {
+    m_skippedImages = skipped;
+  }
+
+  // Use the DDS image of the textures with MSFT_texture_dds instead of their
+  // fallback source, if it is readable. Called before the scene filter, so
+  // that the fallbacks are not loaded.
+  void selectTextureSources(nlohmann::json &gltf, const std::string &baseDir);
+
+  // GltfJsonPatch: container images get a placeholder, their files are
+  // mapped
+  void apply(nlohmann::json &gltf, VirtualFileSystem &vfs,
+      const std::string &baseDir);
+
+  // containerImages()[i] is true if model.images[i] must not be decoded
+  const std::vector<bool> &containerImages() const { return m_containerImages; }
+
+  // Set the size, span and encoding of the container images. Levels stored in
+  // order are used in place, in the mapped files (moved to files) or in
+  // bufferSpans. Images that can't be read stay empty, with a warning.
+  void load(tinygltf::Model &model, const std::vector<BufferSpan> &bufferSpans,
+      std::vector<BufferSpan> &imageSpans,
+      std::vector<ImageEncoding> &imageEncodings,
+      std::vector<std::unique_ptr<MappedFile>> &files, std::string &warn);
+
+  size_t imageCount() const { return m_images.size(); }
+
+private:
+  struct ContainerImage
+  {
+    size_t index;
+    nlohmann::json original; // Fields we replaced
+  };
+
+  // Map the file of image i if it has a uri, returns false if it can't
+  bool mapFile(const nlohmann::json &image, size_t i, const std::string &baseDir);
+
+  std::vector<ContainerImage> m_images;
+  std::vector<bool> m_containerImages;
+  std::vector<std::unique_ptr<MappedFile>> m_files; // By image
+  const std::vector<bool> *m_skippedImages = nullptr;
+};
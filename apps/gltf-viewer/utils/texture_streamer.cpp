@@ -0,0 +1,248 @@
+#include "texture_streamer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// S3TC is not core, but supported by every desktop driver
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace
+{
+const size_t maxRowSize = 16384 * 4 * sizeof(float);
+
+bool isCompressed(const ImageEncoding &encoding)
+{
+  return encoding.format != TextureFormat::Raw;
+}
+
+// Bytes of a row of pixels, or of a row of blocks if compressed
+size_t rowSize(const tinygltf::Image &image, const ImageEncoding &encoding, int level)
+{
+  const size_t width = getLevelWidth(image, level);
+  if (isCompressed(encoding)) {
+    return (width + 3) / 4 * getBlockByteSize(encoding.format);
+  }
+  return width * image.component * (image.bits / 8);
+}
+
+int rowCount(const tinygltf::Image &image, const ImageEncoding &encoding, int level)
+{
+  const auto height = getLevelHeight(image, level);
+  return isCompressed(encoding) ? (height + 3) / 4 : height;
+}
+
+GLenum pixelFormat(const tinygltf::Image &image)
+{
+  switch (image.component) {
+  case 1:
+    return GL_RED;
+  case 2:
+    return GL_RG;
+  case 3:
+    return GL_RGB;
+  default:
+    return GL_RGBA;
+  }
+}
+} // namespace
+
+GLenum getTextureInternalFormat(
+    const tinygltf::Image &image, TextureFormat format)
+{
+  switch (format) {
+  case TextureFormat::BC1:
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case TextureFormat::BC3:
+    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  case TextureFormat::BC4:
+    return GL_COMPRESSED_RED_RGTC1;
+  case TextureFormat::BC5:
+    return GL_COMPRESSED_RG_RGTC2;
+  case TextureFormat::BC7:
+    return GL_COMPRESSED_RGBA_BPTC_UNORM;
+  default:
+    break;
+  }
+  switch (image.component) {
+  case 1:
+    return image.bits == 16 ? GL_R16 : GL_R8;
+  case 2:
+    return image.bits == 16 ? GL_RG16 : GL_RG8;
+  case 3:
+    return image.bits == 16 ? GL_RGB16 : GL_RGB8;
+  default:
+    return image.bits == 16 ? GL_RGBA16 : GL_RGBA8;
+  }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  for (auto &slot : m_slots) {
+    if (slot.fence) {
+      glDeleteSync(slot.fence);
+    }
+  }
+  if (m_stagingBuffer) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &m_stagingBuffer);
+  }
+}
+
+void TextureStreamer::init(size_t bytesPerFrame, size_t ringSize)
+{
+  // A slot must at least hold one row of the widest possible texture
+  m_slotSize = std::max(bytesPerFrame, maxRowSize);
+  m_slots.assign(ringSize, Slot{0, nullptr});
+  for (size_t i = 0; i < ringSize; ++i) {
+    m_slots[i].offset = i * m_slotSize;
+  }
+
+  // One persistent mapping for the whole ring, the fences tell us when the
+  // GPU is done reading a slot and we can write in it again
+  const auto flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &m_stagingBuffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_slotSize * ringSize, nullptr, flags);
+  m_stagingData = static_cast<unsigned char *>(glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, m_slotSize * ringSize, flags));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::enqueue(GLuint texture, const tinygltf::Image &image,
+    const BufferSpan &pixels, const ImageEncoding &encoding,
+    bool generateMipmaps)
+{
+  m_queue.push_back({texture, &image, pixels.data, encoding,
+      generateMipmaps && !isCompressed(encoding), 0, 0});
+  m_pendingTextures.insert(texture);
+  for (int level = 0; level < encoding.levelCount; ++level) {
+    m_pendingBytes += rowSize(image, encoding, level) * rowCount(image, encoding, level);
+  }
+}
+
+void TextureStreamer::cancel(GLuint texture)
+{
+  if (!m_pendingTextures.erase(texture)) {
+    return;
+  }
+  const auto upload = std::find_if(begin(m_queue), end(m_queue),
+      [&](const Upload &queued) { return queued.texture == texture; });
+  const auto &image = *upload->image;
+  // Rows of the current level already submitted were already counted out
+  m_pendingBytes += rowSize(image, upload->encoding, upload->level) * upload->nextRow;
+  for (int level = upload->level; level < upload->encoding.levelCount; ++level) {
+    m_pendingBytes -= rowSize(image, upload->encoding, level) * rowCount(image, upload->encoding, level);
+  }
+  m_queue.erase(upload);
+}
+
+void TextureStreamer::update()
+{
+  if (m_queue.empty()) {
+    return;
+  }
+  auto &slot = m_slots[m_nextSlot];
+  if (slot.fence) {
+    if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      return; // The GPU is late, don't stall the frame
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+  }
+  if (uploadSlot(slot)) {
+    m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+  }
+}
+
+void TextureStreamer::flush()
+{
+  while (!m_queue.empty()) {
+    auto &slot = m_slots[m_nextSlot];
+    if (slot.fence) {
+      glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+      glDeleteSync(slot.fence);
+      slot.fence = nullptr;
+    }
+    uploadSlot(slot);
+    m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+  }
+}
+
+bool TextureStreamer::uploadSlot(Slot &slot)
+{
+  if (m_queue.empty()) {
+    return false;
+  }
+
+  GLint previousTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  size_t used = 0;
+  while (!m_queue.empty()) {
+    auto &upload = m_queue.front();
+    const auto &image = *upload.image;
+    const auto bytesPerRow = rowSize(image, upload.encoding, upload.level);
+    const auto levelRowCount = rowCount(image, upload.encoding, upload.level);
+
+    const auto count = int(std::min<size_t>(
+        levelRowCount - upload.nextRow, (m_slotSize - used) / bytesPerRow));
+    if (count == 0) {
+      break; // No room left in this slot
+    }
+
+    const auto srcOffset = size_t(upload.nextRow) * bytesPerRow;
+    const auto size = size_t(count) * bytesPerRow;
+    std::memcpy(m_stagingData + slot.offset + used,
+        upload.pixels + srcOffset, size);
+
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    const auto width = getLevelWidth(image, upload.level);
+    if (isCompressed(upload.encoding)) {
+      // Rows of 4x4 blocks, the last one may be cut by the level height
+      const auto y = 4 * upload.nextRow;
+      const auto height = std::min(4 * count, getLevelHeight(image, upload.level) - y);
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, y, width,
+          height, getTextureInternalFormat(image, upload.encoding.format),
+          GLsizei(size), (const GLvoid *)(slot.offset + used));
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, upload.nextRow, width,
+          count, pixelFormat(image), image.pixel_type,
+          (const GLvoid *)(slot.offset + used));
+    }
+
+    used += size;
+    m_pendingBytes -= size;
+    upload.nextRow += count;
+
+    if (upload.nextRow == levelRowCount) {
+      upload.pixels += size_t(levelRowCount) * bytesPerRow;
+      upload.nextRow = 0;
+      if (++upload.level < upload.encoding.levelCount) {
+        continue;
+      }
+      if (upload.generateMipmaps) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+      }
+      m_pendingTextures.erase(upload.texture);
+      m_queue.pop_front();
+    }
+  }
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, previousTexture);
+
+  return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "texture_compression.hpp"
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <tiny_gltf.h>
+#include <unordered_set>
+#include <vector>
+
+// Internal format of the storage of textures holding image, stored in format
+GLenum getTextureInternalFormat(
+    const tinygltf::Image &image, TextureFormat format);
+
+// Streams texture images to the GPU over several frames through a ring of
+// persistently mapped pixel buffer objects.
+// Each update() copies at most `bytesPerFrame` bytes of pixels in the next
+// ring slot and issues the matching glTexSubImage2D calls, so that loading
+// big textures does not freeze the render loop. A texture is resident once
+// all its rows have been submitted (and its mipmaps generated).
+// Compressed images are uploaded level by level, by rows of blocks.
+// Needs a current GL context for every call except the constructor.
+class TextureStreamer
+{
+public:
+  TextureStreamer() = default;
+
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer &) = delete;
+
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  // Allocate the staging ring. Each slot holds one frame worth of uploads.
+  void init(size_t bytesPerFrame, size_t ringSize = 3);
+
+  // Queue the upload of pixels, described by image and encoding, in the
+  // levels of texture which must already have immutable storage of matching
+  // size and format. Nothing is copied: image and pixels must stay alive
+  // until the texture is resident. Mipmaps are only generated for Raw images.
+  void enqueue(GLuint texture, const tinygltf::Image &image,
+      const BufferSpan &pixels, const ImageEncoding &encoding,
+      bool generateMipmaps);
+
+  // Drop the uploads left for texture, before deleting it
+  void cancel(GLuint texture);
+
+  // Upload the next rows of pending textures, within the per-frame budget.
+  // Returns immediately if the GPU still uses the next ring slot.
+  void update();
+
+  // Upload everything that is still pending, blocking on the GPU as needed
+  void flush();
+
+  // False for 0, a texture without storage has nothing to sample
+  bool isResident(GLuint texture) const
+  {
+    return texture &&
+           (m_pendingTextures.empty() || !m_pendingTextures.count(texture));
+  }
+
+  size_t pendingCount() const { return m_pendingTextures.size(); }
+
+  size_t pendingBytes() const { return m_pendingBytes; }
+
+private:
+  struct Upload
+  {
+    GLuint texture;
+    const tinygltf::Image *image;
+    const unsigned char *pixels; // Of the current level
+    ImageEncoding encoding;
+    bool generateMipmaps;
+    int level;
+    int nextRow; // First row (of blocks if compressed) not submitted yet
+  };
+
+  struct Slot
+  {
+    size_t offset; // Of the slot in the staging buffer
+    GLsync fence;
+  };
+
+  // Fill the slot from the queue, returns false if nothing was left to do
+  bool uploadSlot(Slot &slot);
+
+  GLuint m_stagingBuffer = 0;
+  unsigned char *m_stagingData = nullptr;
+  size_t m_slotSize = 0;
+  std::vector<Slot> m_slots;
+  size_t m_nextSlot = 0;
+
+  std::deque<Upload> m_queue;
+  std::unordered_set<GLuint> m_pendingTextures;
+  size_t m_pendingBytes = 0;
+};
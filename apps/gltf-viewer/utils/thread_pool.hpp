@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads consuming a FIFO queue of tasks.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(
+      size_t threadCount = std::max(1u, std::thread::hardware_concurrency()))
+  {
+    for (size_t i = 0; i < threadCount; ++i) {
+      m_workers.emplace_back([this]() { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto &worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return m_workers.size(); }
+
+  // Queue a task, the returned future gives its result (or its exception)
+  template <typename Function>
+  auto submit(Function &&function) -> std::future<decltype(function())>
+  {
+    using Result = decltype(function());
+    const auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Function>(function));
+    auto future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace([task]() { (*task)(); });
+    }
+    m_condition.notify_one();
+    return future;
+  }
+
+  // Call function(i) for i in [0, count), split in about one batch per worker,
+  // and wait for all of them. Must not be called from a worker thread.
+  template <typename Function>
+  void parallelFor(size_t count, Function &&function)
+  {
+    const auto batchCount = std::min(count, size());
+    std::vector<std::future<void>> futures;
+    for (size_t batch = 0; batch < batchCount; ++batch) {
+      const auto first = count * batch / batchCount;
+      const auto last = count * (batch + 1) / batchCount;
+      futures.emplace_back(submit([&function, first, last]() {
+        for (auto i = first; i < last; ++i) {
+          function(i);
+        }
+      }));
+    }
+    for (auto &future : futures) {
+      future.wait(); // All batches reference function, wait before any throw
+    }
+    for (auto &future : futures) {
+      future.get();
+    }
+  }
+
+private:
+  void workerLoop()
+  {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(
+            lock, [this]() { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return; // Stopping and nothing left to do
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> m_workers;
+  std::queue<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping = false;
+};
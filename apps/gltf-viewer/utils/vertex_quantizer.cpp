@@ -0,0 +1,242 @@
+#include "vertex_quantizer.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+
+namespace
+{
+// Reads the elements of an accessor as floats, applying the normalization
+// rules of the spec for integer components
+class AccessorReader
+{
+public:
+  AccessorReader(const tinygltf::Model &model,
+      const std::vector<BufferSpan> &buffers, int accessorIdx)
+  {
+    if (accessorIdx < 0 || size_t(accessorIdx) >= model.accessors.size()) {
+      return;
+    }
+    const auto &accessor = model.accessors[accessorIdx];
+    if (accessor.bufferView < 0 ||
+        size_t(accessor.bufferView) >= model.bufferViews.size()) {
+      return;
+    }
+    const auto &bufferView = model.bufferViews[accessor.bufferView];
+    if (bufferView.buffer < 0 || size_t(bufferView.buffer) >= buffers.size()) {
+      return;
+    }
+    const auto &buffer = buffers[bufferView.buffer];
+    m_componentType = accessor.componentType;
+    m_normalized = accessor.normalized;
+    m_componentCount = tinygltf::GetNumComponentsInType(accessor.type);
+    const auto componentSize =
+        tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    if (m_componentCount <= 0 || componentSize <= 0) {
+      return;
+    }
+    m_stride = bufferView.byteStride ? bufferView.byteStride
+                                     : size_t(m_componentCount * componentSize);
+    const auto offset = bufferView.byteOffset + accessor.byteOffset;
+    const auto elementSize = size_t(m_componentCount * componentSize);
+    // Only read elements that are inside both the view and the buffer
+    const auto viewEnd = std::min(bufferView.byteOffset + bufferView.byteLength, buffer.size);
+    if (!accessor.count || offset + elementSize > viewEnd) {
+      return;
+    }
+    m_data = buffer.data + offset;
+    m_count = std::min(accessor.count, (viewEnd - offset - elementSize) / m_stride + 1);
+  }
+
+  size_t count() const { return m_count; }
+
+  int componentCount() const { return m_componentCount; }
+
+  float get(size_t element, int component) const
+  {
+    const auto ptr = m_data + element * m_stride;
+    switch (m_componentType) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      return read<float>(ptr, component);
+    case TINYGLTF_COMPONENT_TYPE_BYTE: {
+      const float v = read<int8_t>(ptr, component);
+      return m_normalized ? std::max(v / 127.f, -1.f) : v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+      const float v = read<uint8_t>(ptr, component);
+      return m_normalized ? v / 255.f : v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_SHORT: {
+      const float v = read<int16_t>(ptr, component);
+      return m_normalized ? std::max(v / 32767.f, -1.f) : v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+      const float v = read<uint16_t>(ptr, component);
+      return m_normalized ? v / 65535.f : v;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+      return float(read<uint32_t>(ptr, component));
+    }
+    return 0.f;
+  }
+
+  glm::vec3 getVec3(size_t element) const
+  {
+    glm::vec3 v(0.f);
+    for (int c = 0; c < std::min(m_componentCount, 3); ++c) {
+      v[c] = get(element, c);
+    }
+    return v;
+  }
+
+private:
+  template <typename T> static T read(const unsigned char *ptr, int component)
+  {
+    T value;
+    std::memcpy(&value, ptr + component * sizeof(T), sizeof(T));
+    return value;
+  }
+
+  const unsigned char *m_data = nullptr;
+  size_t m_count = 0;
+  size_t m_stride = 0;
+  int m_componentType = 0;
+  int m_componentCount = 0;
+  bool m_normalized = false;
+};
+
+int16_t packSnorm16(float v)
+{
+  return int16_t(std::round(glm::clamp(v, -1.f, 1.f) * 32767.f));
+}
+
+uint16_t packUnorm16(float v)
+{
+  return uint16_t(std::round(glm::clamp(v, 0.f, 1.f) * 65535.f));
+}
+
+// https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+glm::vec2 octEncode(glm::vec3 n)
+{
+  const auto sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (sum == 0.f) {
+    return glm::vec2(0.f); // Degenerated normal, decoded as +Z
+  }
+  n /= sum;
+  glm::vec2 p(n.x, n.y);
+  if (n.z < 0.f) {
+    p = (1.f - glm::abs(glm::vec2(n.y, n.x))) *
+        glm::vec2(p.x >= 0.f ? 1.f : -1.f, p.y >= 0.f ? 1.f : -1.f);
+  }
+  return p;
+}
+
+int findAttribute(const tinygltf::Primitive &primitive, const char *name)
+{
+  const auto it = primitive.attributes.find(name);
+  return it != end(primitive.attributes) ? (*it).second : -1;
+}
+
+} // namespace
+
+glm::mat4 QuantizedPrimitive::getDequantizationMatrix() const
+{
+  return glm::scale(glm::translate(glm::mat4(1), positionMin), positionScale);
+}
+
+QuantizedVertices quantizeVertices(
+    tinygltf::Model &model, std::vector<BufferSpan> &buffers)
+{
+  QuantizedVertices vertices;
+  vertices.primitives.resize(model.meshes.size());
+  tinygltf::Buffer buffer;
+  // Primitives by accessors of their attributes, quantized once
+  std::map<std::array<int, 3>, QuantizedPrimitive> quantizedAttributes;
+
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &mesh = model.meshes[meshIdx];
+    auto &quantizedPrimitives = vertices.primitives[meshIdx];
+    quantizedPrimitives.resize(mesh.primitives.size());
+
+    for (size_t primIdx = 0; primIdx < mesh.primitives.size(); ++primIdx) {
+      const auto &primitive = mesh.primitives[primIdx];
+      auto &quantized = quantizedPrimitives[primIdx];
+      const std::array<int, 3> attributes = {findAttribute(primitive, "POSITION"),
+          findAttribute(primitive, "NORMAL"), findAttribute(primitive, "TEXCOORD_0")};
+      const auto it = quantizedAttributes.find(attributes);
+      if (it != end(quantizedAttributes)) {
+        quantized = it->second;
+        continue;
+      }
+      const AccessorReader positions(model, buffers, attributes[0]);
+      const AccessorReader normals(model, buffers, attributes[1]);
+      const AccessorReader texCoords(model, buffers, attributes[2]);
+      if (!positions.count()) {
+        quantizedAttributes.emplace(attributes, quantized);
+        continue;
+      }
+
+      // Box of the decoded positions, accessor min/max are optional and in
+      // quantized units with KHR_mesh_quantization
+      glm::vec3 bboxMin(std::numeric_limits<float>::max());
+      glm::vec3 bboxMax(std::numeric_limits<float>::lowest());
+      for (size_t i = 0; i < positions.count(); ++i) {
+        const auto p = positions.getVec3(i);
+        bboxMin = glm::min(bboxMin, p);
+        bboxMax = glm::max(bboxMax, p);
+      }
+      const auto extent = bboxMax - bboxMin;
+
+      quantized.byteOffset = buffer.data.size();
+      quantized.vertexCount = positions.count();
+      quantized.positionMin = bboxMin;
+      quantized.positionScale = extent;
+      quantizedAttributes.emplace(attributes, quantized);
+
+      buffer.data.resize(buffer.data.size() + positions.count() * sizeof(QuantizedVertex));
+      auto out = reinterpret_cast<QuantizedVertex *>(buffer.data.data() + quantized.byteOffset);
+      for (size_t i = 0; i < positions.count(); ++i, ++out) {
+        const auto p = positions.getVec3(i);
+        for (int c = 0; c < 3; ++c) {
+          out->position[c] = extent[c] > 0.f ? packUnorm16((p[c] - bboxMin[c]) / extent[c]) : 0;
+        }
+        out->position[3] = 0;
+
+        const auto n = i < normals.count() ? octEncode(normals.getVec3(i)) : glm::vec2(0.f);
+        out->normal[0] = packSnorm16(n.x);
+        out->normal[1] = packSnorm16(n.y);
+
+        for (int c = 0; c < 2; ++c) {
+          out->texCoord[c] = glm::packHalf1x16(
+              i < texCoords.count() && c < texCoords.componentCount() ? texCoords.get(i, c) : 0.f);
+        }
+      }
+    }
+  }
+
+  if (!buffer.data.empty()) {
+    // Buffers are moved (not copied) on reallocation, other spans stay valid
+    vertices.buffer = int(model.buffers.size());
+    model.buffers.push_back(std::move(buffer));
+    buffers.push_back({model.buffers.back().data.data(), model.buffers.back().data.size()});
+  }
+  return vertices;
+}
+
+std::vector<glm::vec3> readAttribute(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, const tinygltf::Primitive &primitive,
+    const char *name)
+{
+  const AccessorReader reader(model, buffers, findAttribute(primitive, name));
+  std::vector<glm::vec3> positions(reader.count());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    positions[i] = reader.getVec3(i);
+  }
+  return positions;
+}
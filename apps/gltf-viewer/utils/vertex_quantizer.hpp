@@ -0,0 +1,76 @@
+#pragma once
+
+#include "gltf.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Interleaved vertex of the geometry pass, 16 bytes instead of 32 for float
+// POSITION, NORMAL and TEXCOORD_0 in separate streams:
+// - position: unsigned normalized 16 bits in the box of its primitive,
+// - normal: octahedral encoding, signed normalized 16 bits,
+// - texCoord: half floats.
+struct QuantizedVertex
+{
+  uint16_t position[4]; // Last one is padding
+  int16_t normal[2];
+  uint16_t texCoord[2];
+};
+
+struct QuantizedPrimitive
+{
+  size_t byteOffset = 0; // Of its first vertex in the buffer of QuantizedVertices
+  size_t vertexCount = 0; // 0 if the primitive has no POSITION
+  // Position in the mesh is positionMin + positionScale * quantized position
+  glm::vec3 positionMin{0.f};
+  glm::vec3 positionScale{1.f};
+
+  // Mesh space from quantized space, to append to the model matrix
+  glm::mat4 getDequantizationMatrix() const;
+
+  glm::vec3 dequantize(const QuantizedVertex &vertex) const
+  {
+    return positionMin + positionScale * glm::vec3(vertex.position[0],
+                                             vertex.position[1],
+                                             vertex.position[2]) /
+                             65535.f;
+  }
+};
+
+struct QuantizedVertices
+{
+  // Index in model.buffers (and the buffer spans) of the vertices of all
+  // primitives, -1 if there are none
+  int buffer = -1;
+  std::vector<std::vector<QuantizedPrimitive>> primitives; // [mesh][primitive]
+
+  const QuantizedVertex *getVertices(const std::vector<BufferSpan> &buffers,
+      const QuantizedPrimitive &primitive) const
+  {
+    return reinterpret_cast<const QuantizedVertex *>(
+        buffers[buffer].data + primitive.byteOffset);
+  }
+};
+
+// Read POSITION, NORMAL and TEXCOORD_0 of all primitives, whatever their
+// component types (including the integer ones of KHR_mesh_quantization),
+// and repack them as QuantizedVertex in a buffer appended to model.buffers
+// (and buffers), so that they are cached with the others. Primitives with the
+// same attribute accessors share their vertices.
+QuantizedVertices quantizeVertices(
+    tinygltf::Model &model, std::vector<BufferSpan> &buffers);
+
+// Decoded values of an attribute of primitive, whatever its component type
+// (missing components are 0). Empty if it has none.
+std::vector<glm::vec3> readAttribute(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, const tinygltf::Primitive &primitive,
+    const char *name);
+
+inline std::vector<glm::vec3> readPositions(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &buffers, const tinygltf::Primitive &primitive)
+{
+  return readAttribute(model, buffers, primitive, "POSITION");
+}
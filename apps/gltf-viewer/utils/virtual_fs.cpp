@@ -0,0 +1,56 @@
+#include "virtual_fs.hpp"
+
+void VirtualFileSystem::install(tinygltf::TinyGLTF &loader)
+{
+  loader.SetFsCallbacks(
+      {fileExists, expandFilePath, readWholeFile, writeWholeFile, this});
+}
+
+void VirtualFileSystem::uninstall(tinygltf::TinyGLTF &loader)
+{
+  loader.SetFsCallbacks({tinygltf::FileExists, tinygltf::ExpandFilePath,
+      tinygltf::ReadWholeFile, tinygltf::WriteWholeFile, nullptr});
+}
+
+// Same as tinygltf JoinPath, so that our paths match what it looks for
+std::string VirtualFileSystem::joinPath(
+    const std::string &baseDir, const std::string &uri)
+{
+  if (baseDir.empty()) {
+    return uri;
+  }
+  return baseDir.back() == '/' ? baseDir + uri : baseDir + "/" + uri;
+}
+
+bool VirtualFileSystem::fileExists(const std::string &path, void *userData)
+{
+  const auto &vfs = *static_cast<const VirtualFileSystem *>(userData);
+  return vfs.m_files.count(path) || tinygltf::FileExists(path, nullptr);
+}
+
+std::string VirtualFileSystem::expandFilePath(
+    const std::string &path, void *userData)
+{
+  const auto &vfs = *static_cast<const VirtualFileSystem *>(userData);
+  return vfs.m_files.count(path) ? path
+                                 : tinygltf::ExpandFilePath(path, nullptr);
+}
+
+bool VirtualFileSystem::readWholeFile(std::vector<unsigned char> *out,
+    std::string *err, const std::string &path, void *userData)
+{
+  const auto &vfs = *static_cast<const VirtualFileSystem *>(userData);
+  const auto it = vfs.m_files.find(path);
+  if (it == end(vfs.m_files)) {
+    return tinygltf::ReadWholeFile(out, err, path, nullptr);
+  }
+  out->assign((*it).second.data, (*it).second.data + (*it).second.size);
+  return true;
+}
+
+bool VirtualFileSystem::writeWholeFile(std::string *err,
+    const std::string &path, const std::vector<unsigned char> &contents,
+    void *)
+{
+  return tinygltf::WriteWholeFile(err, path, contents, nullptr);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "gltf.hpp"
+
+#include <string>
+#include <tiny_gltf.h>
+#include <unordered_map>
+
+// Overlay on tinygltf default file system callbacks: reads of registered
+// paths are served from memory, everything else goes to the disk.
+// Paths must be registered the way tinygltf builds them, see joinPath().
+class VirtualFileSystem
+{
+public:
+  // data must stay alive while the loader may read it
+  void addFile(const std::string &path, const BufferSpan &data)
+  {
+    m_files[path] = data;
+  }
+
+  // Route the file accesses of loader through this until uninstall()
+  void install(tinygltf::TinyGLTF &loader);
+
+  static void uninstall(tinygltf::TinyGLTF &loader);
+
+  // Path tinygltf reads for uri relative to the glTF directory baseDir
+  static std::string joinPath(const std::string &baseDir, const std::string &uri);
+
+private:
+  static bool fileExists(const std::string &path, void *userData);
+  static std::string expandFilePath(const std::string &path, void *userData);
+  static bool readWholeFile(std::vector<unsigned char> *out, std::string *err,
+      const std::string &path, void *userData);
+  static bool writeWholeFile(std::string *err, const std::string &path,
+      const std::vector<unsigned char> &contents, void *userData);
+
+  std::unordered_map<std::string, BufferSpan> m_files;
+};
@@ -18,6 +18,66 @@
 # OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 # THE SOFTWARE.
 
+# Script mode of c2ba_embed_shader_directory: cmake -DSHADER_DIRECTORY=... -DHEADER_FILE=... -DOUTPUT_FILE=... -P c2ba-glsl-shaders.cmake
+if(CMAKE_SCRIPT_MODE_FILE)
+    # Append to the list out_var the file and those it includes (#include "file", relative to the including one)
+    function(c2ba_shader_closure file out_var)
+        set(closure ${${out_var}})
+        list(FIND closure ${file} found)
+        if(NOT found EQUAL -1)
+            return()
+        endif()
+        list(APPEND closure ${file})
+        file(READ ${file} content)
+        string(REGEX MATCHALL "#include[ \t]*\"[^\"]+\"" includes "${content}")
+        get_filename_component(directory ${file} PATH)
+        foreach(include ${includes})
+            string(REGEX REPLACE "#include[ \t]*\"([^\"]+)\"" "\\1" include_file "${include}")
+            c2ba_shader_closure(${directory}/${include_file} closure)
+        endforeach()
+        set(${out_var} ${closure} PARENT_SCOPE)
+    endfunction()
+
+    file(GLOB_RECURSE relative_files RELATIVE ${SHADER_DIRECTORY} ${SHADER_DIRECTORY}/*.glsl)
+
+    set(sources "")
+    set(entries "")
+    set(idx 0)
+    foreach(relative_file ${relative_files})
+        set(file ${SHADER_DIRECTORY}/${relative_file})
+        # Bytes as a char array: no escaping, no limit on the length of string literals
+        file(READ ${file} hex HEX)
+        string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+        set(sources "${sources}const unsigned char source${idx}[] = {${bytes}0};\n")
+
+        # Hash of the file and the files it includes, as a program cache key
+        set(closure "")
+        c2ba_shader_closure(${file} closure)
+        set(hashes "")
+        foreach(closure_file ${closure})
+            file(SHA1 ${closure_file} file_hash)
+            set(hashes "${hashes}${file_hash}")
+        endforeach()
+        string(SHA1 hash "${hashes}")
+        string(SUBSTRING ${hash} 0 16 hash)
+        set(entries "${entries}    {\"${relative_file}\", reinterpret_cast<const char *>(source${idx}), sizeof(source${idx}) - 1, 0x${hash}ull},\n")
+
+        math(EXPR idx "${idx} + 1")
+    endforeach()
+    if(idx EQUAL 0)
+        set(entries "    {nullptr, nullptr, 0, 0},\n")
+    endif()
+
+    set(output "// Generated by c2ba-glsl-shaders.cmake from ${SHADER_DIRECTORY}, do not edit\n")
+    set(output "${output}#include \"${HEADER_FILE}\"\n\nnamespace\n{\n${sources}} // namespace\n\n")
+    set(output "${output}const EmbeddedShader EMBEDDED_SHADERS[] = {\n${entries}};\n")
+    set(output "${output}const size_t EMBEDDED_SHADER_COUNT = ${idx};\n")
+    file(WRITE ${OUTPUT_FILE} "${output}")
+    return()
+endif()
+
+set(C2BA_GLSL_SHADERS_SCRIPT ${CMAKE_CURRENT_LIST_FILE})
+
 # A macro adding all GLSL shaders from a directory as custom targets for the generated solution.
 # The compilation target for glsl shaders is a copy in a "glsl" folder located in the executable directory, with the same file path layout
 # Recognized extensions:
@@ -42,3 +102,20 @@ macro(c2ba_add_shader_directory src_directory dst_directory)
         endforeach()
     endif()
 endmacro()
+
+# A macro compiling all GLSL shaders from a directory into the executable, as the table declared by header_file.
+# The generated source file, regenerated when a shader changes, is returned in output_variable to be added to the sources of the target.
+macro(c2ba_embed_shader_directory src_directory header_file output_variable)
+    file(GLOB_RECURSE embedded_files ${src_directory}/*.glsl)
+    get_filename_component(embedded_name ${src_directory} NAME)
+    get_filename_component(embedded_parent ${src_directory} PATH)
+    get_filename_component(embedded_parent ${embedded_parent} NAME)
+    set(${output_variable} ${CMAKE_CURRENT_BINARY_DIR}/embedded_shaders/${embedded_parent}_${embedded_name}.cpp)
+
+    add_custom_command(
+        OUTPUT ${${output_variable}}
+        COMMAND ${CMAKE_COMMAND} -DSHADER_DIRECTORY=${src_directory} -DHEADER_FILE=${header_file} -DOUTPUT_FILE=${${output_variable}} -P ${C2BA_GLSL_SHADERS_SCRIPT}
+        DEPENDS ${embedded_files} ${C2BA_GLSL_SHADERS_SCRIPT}
+        COMMENT "Embedding GLSL shaders of ${src_directory}"
+    )
+endmacro()